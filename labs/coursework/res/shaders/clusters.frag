@@ -0,0 +1,144 @@
+// Clustered lighting: the point and spot lights whose range reaches the
+// fragment's cluster, or a single one of them for the deferred light volumes.
+// Needs point.frag and spot.frag
+
+// Cluster grid, matching CLUSTER_X, CLUSTER_Y and CLUSTER_Z
+const uint CLUSTER_X = 16;
+const uint CLUSTER_Y = 9;
+const uint CLUSTER_Z = 24;
+// The only shadow map used at the moment is for spotlight 1
+const uint SHADOWED_SPOT = 1;
+
+// Point light information
+#ifndef POINT_LIGHT
+#define POINT_LIGHT
+struct point_light
+{
+	vec4 light_colour;
+	vec3 position;
+	float constant;
+	float linear;
+	float quadratic;
+};
+#endif
+
+// Spot light data
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT
+struct spot_light
+{
+	vec4 light_colour;
+	vec3 position;
+	vec3 direction;
+	float constant;
+	float linear;
+	float quadratic;
+	float power;
+};
+#endif
+
+// Material data
+#ifndef MATERIAL
+#define MATERIAL
+struct material
+{
+	vec4 emissive;
+	vec4 diffuse_reflection;
+	vec4 specular_reflection;
+	float shininess;
+};
+#endif
+
+// Lights as light_clusters.h writes them
+struct clustered_point
+{
+	vec4 colour;
+	vec4 position_range;
+	vec4 attenuation;
+};
+struct clustered_spot
+{
+	vec4 colour;
+	vec4 position_range;
+	vec4 direction_power;
+	vec4 attenuation;
+};
+layout (std430, binding = 3) readonly buffer point_light_buffer
+{
+	clustered_point cluster_points[];
+};
+layout (std430, binding = 4) readonly buffer spot_light_buffer
+{
+	clustered_spot cluster_spots[];
+};
+// Per cluster: first index, point light count, spot light count
+layout (std430, binding = 5) readonly buffer cluster_buffer
+{
+	uvec4 clusters[];
+};
+// Each cluster's point light indices followed by its spot light indices
+layout (std430, binding = 6) readonly buffer light_index_buffer
+{
+	uint light_indices[];
+};
+
+// View the clusters were built for
+uniform mat4 cluster_view;
+// Tiles per pixel across and down
+uniform vec2 cluster_tile_scale;
+// Scale and bias taking log view depth to a depth slice
+uniform vec2 cluster_slice;
+
+vec4 calculate_point(in point_light point, in material mat, in vec3 position, in vec3 normal, in vec3 view_dir,
+                     in vec4 tex_colour);
+vec4 calculate_spot(in spot_light spot, in material mat, in vec3 position, in vec3 normal, in vec3 view_dir,
+                    in vec4 tex_colour);
+
+// Takes a light smoothly to nothing at its range, so the cut off doesn't show
+float range_window(in float d, in float range)
+{
+	float x = d / range;
+	float w = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+	return w * w;
+}
+
+// One point light from the light buffer, faded out at its range
+vec4 clustered_point_light(in uint light_index, in vec3 position, in material mat, in vec3 normal, in vec3 view_dir,
+                           in vec4 tex_colour)
+{
+	clustered_point p = cluster_points[light_index];
+	point_light light = point_light(p.colour, p.position_range.xyz, p.attenuation.x, p.attenuation.y, p.attenuation.z);
+	float window = range_window(distance(light.position, position), p.position_range.w);
+	return calculate_point(light, mat, position, normal, view_dir, tex_colour) * window;
+}
+
+// One spot light from the light buffer, faded out at its range
+vec4 clustered_spot_light(in uint light_index, in vec3 position, in material mat, in vec3 normal, in vec3 view_dir,
+                          in vec4 tex_colour, in float shade_factor)
+{
+	if (light_index == SHADOWED_SPOT && shade_factor <= 0.5)
+		return vec4(0.0);
+	clustered_spot s = cluster_spots[light_index];
+	spot_light light = spot_light(s.colour, s.position_range.xyz, s.direction_power.xyz, s.attenuation.x,
+	                              s.attenuation.y, s.attenuation.z, s.direction_power.w);
+	float window = range_window(distance(light.position, position), s.position_range.w);
+	return calculate_spot(light, mat, position, normal, view_dir, tex_colour) * window;
+}
+
+// Sum of the point and spot lights in the fragment's cluster
+vec4 clustered_lighting(in vec3 position, in material mat, in vec3 normal, in vec3 view_dir, in vec4 tex_colour,
+                        in float shade_factor)
+{
+	float depth = max(-(cluster_view * vec4(position, 1.0)).z, 0.0001);
+	uvec3 cell = uvec3(clamp(ivec3(ivec2(gl_FragCoord.xy * cluster_tile_scale), int(log(depth) * cluster_slice.x + cluster_slice.y)),
+	                         ivec3(0), ivec3(CLUSTER_X, CLUSTER_Y, CLUSTER_Z) - 1));
+	uvec4 cluster = clusters[(cell.z * CLUSTER_Y + cell.y) * CLUSTER_X + cell.x];
+
+	vec4 colour = vec4(0.0);
+	uint index = cluster.x;
+	for (uint i = 0; i < cluster.y; i++, index++)
+		colour += clustered_point_light(light_indices[index], position, mat, normal, view_dir, tex_colour);
+	for (uint i = 0; i < cluster.z; i++, index++)
+		colour += clustered_spot_light(light_indices[index], position, mat, normal, view_dir, tex_colour, shade_factor);
+	return colour;
+}
@@ -1,7 +1,5 @@
-# version 440
+// Post-processing stage: hue, saturation and brightness correction
 
-// Texture uniform
-uniform sampler2D tex;
 // Hue shift uniform
 uniform float hue_offset;
 // Saturation uniform
@@ -9,17 +7,8 @@ uniform float saturation;
 // Brightness uniform
 uniform float brightness;
 
-// Incoming position
-layout(location = 0) in vec3 position;
-// Incoming texture coordinate
-layout(location = 2) in vec2 tex_coord;
-
-// Outgoing colour
-layout(location = 0) out vec4 colour;
-
-void main()
+vec4 colour_correction(in vec4 cl, in vec2 tex_coord)
 {
-	vec4 cl = texture(tex, tex_coord);
 	float mx = max(cl.r, max(cl.g, cl.b));
 	float mn = min(cl.r, min(cl.g, cl.b));
 	float C = mx - mn;
@@ -88,5 +77,5 @@ void main()
 	}
 
 	mn = HCL.z - (0.3 * cl.r + 0.59 * cl.g + 0.11 * cl.b);
-	colour = vec4(cl.r + mn, cl.g + mn, cl.b + mn, 1.0);
-}
\ No newline at end of file
+	return vec4(cl.r + mn, cl.g + mn, cl.b + mn, 1.0);
+}
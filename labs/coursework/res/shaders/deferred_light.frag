@@ -0,0 +1,110 @@
+#version 440 core
+
+// Deferred lighting: one light over the pixels its volume marked, or the directional light and ambient over the
+// whole screen.  This shader requires directional.frag, point.frag, spot.frag, shadow_index.frag, clusters.frag
+// and octahedral.frag
+
+// Directional light structure
+#ifndef DIRECTIONAL_LIGHT
+#define DIRECTIONAL_LIGHT
+struct directional_light {
+  vec4 ambient_intensity;
+  vec4 light_colour;
+  vec3 light_dir;
+};
+#endif
+
+// A material structure
+#ifndef MATERIAL
+#define MATERIAL
+struct material {
+  vec4 emissive;
+  vec4 diffuse_reflection;
+  vec4 specular_reflection;
+  float shininess;
+};
+#endif
+
+// Light types, matching DEFERRED_DIRECTIONAL, DEFERRED_POINT and DEFERRED_SPOT
+const int DIRECTIONAL = 0;
+const int POINT = 1;
+const int SPOT = 2;
+
+// Forward declarations of used functions
+vec4 calculate_directional(in directional_light light, in material mat, in vec3 normal, in vec3 view_dir,
+                         in vec4 tex_colour);
+float calculate_shadow(in sampler2DShadow shadow_map, in vec4 light_space_pos);
+vec4 clustered_point_light(in uint light_index, in vec3 position, in material mat, in vec3 normal, in vec3 view_dir,
+                           in vec4 tex_colour);
+vec4 clustered_spot_light(in uint light_index, in vec3 position, in material mat, in vec3 normal, in vec3 view_dir,
+                          in vec4 tex_colour, in float shade_factor);
+vec3 decode_octahedral(in vec2 e);
+
+// Directional light information
+uniform directional_light light;
+// Materials of the objects drawn into the G-buffer
+layout (std430, binding = 1) readonly buffer material_buffer
+{
+	material materials[];
+};
+// Light being drawn: its type and its index in the point or spot light buffer
+uniform int light_type;
+uniform uint light_index;
+// G-buffer
+uniform sampler2D albedo_map;
+uniform sampler2D normal_buffer;
+uniform sampler2D depth_map;
+// Takes window position and depth back to world space
+uniform mat4 inverse_PV;
+// 1 / the render resolution
+uniform vec2 inverse_render_size;
+// Position of the eye
+uniform vec3 eye_pos;
+// Shadow map to sample from, and the light transformation matrix
+uniform sampler2DShadow shadow_map;
+uniform mat4 lightPV;
+// Half size ambient occlusion in r, and 1 / the render resolution to sample it by pixel
+uniform sampler2D ao_map;
+uniform vec2 ao_scale;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+void main()
+{
+	const mat4 lightbias = mat4(
+		vec4(0.5, 0.0, 0.0, 0.0),
+		vec4(0.0, 0.5, 0.0, 0.0),
+		vec4(0.0, 0.0, 0.5, 0.0),
+		vec4(0.5, 0.5, 0.5, 1.0)
+	);
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(depth_map, pixel, 0).r;
+	// Sky
+	if (depth >= 1.0)
+		discard;
+	vec4 world = inverse_PV * vec4(vec3(gl_FragCoord.xy * inverse_render_size, depth) * 2.0 - 1.0, 1.0);
+	vec3 position = world.xyz / world.w;
+
+	vec4 albedo = texelFetch(albedo_map, pixel, 0);
+	material mat = materials[uint(albedo.a * 255.0 + 0.5)];
+	vec4 tex_colour = vec4(albedo.rgb, 1.0);
+	vec3 normal = decode_octahedral(texelFetch(normal_buffer, pixel, 0).xy);
+	vec3 view_dir = normalize(eye_pos - position);
+
+	if (light_type == DIRECTIONAL)
+	{
+		// Ambient occlusion only darkens the ambient light
+		directional_light occluded = light;
+		occluded.ambient_intensity *= texture(ao_map, gl_FragCoord.xy * ao_scale).r;
+		colour = calculate_directional(occluded, mat, normal, view_dir, tex_colour);
+	}
+	else if (light_type == POINT)
+		colour = clustered_point_light(light_index, position, mat, normal, view_dir, tex_colour);
+	else
+	{
+		float shade_factor = calculate_shadow(shadow_map, lightbias * lightPV * vec4(position, 1.0));
+		colour = clustered_spot_light(light_index, position, mat, normal, view_dir, tex_colour, shade_factor);
+	}
+	colour.a = 1.0;
+}
@@ -0,0 +1,61 @@
+#version 440 core
+
+// Writes the G-buffer for deferred shading.  This shader requires octahedral.frag
+
+// Forward declarations of used functions
+vec2 encode_octahedral(in vec3 n);
+
+// Texture to sample from
+uniform sampler2D tex;
+// Texture to sample normals from
+uniform sampler2D normal_map;
+// 1 to map normals
+uniform float map_norms;
+
+// Incoming position
+layout(location = 0) in vec3 position;
+// Incoming normal
+layout(location = 1) in vec3 normal;
+// Incoming texture coordinate
+layout(location = 2) in vec2 tex_coord;
+// Incoming binormal
+layout (location = 3) in vec3 binormal;
+// Incoming tangent
+layout (location = 4) in vec3 tangent;
+// Incoming material index
+layout(location = 6) flat in uint material_index;
+
+// Texture colour, and the material index in alpha - the lighting reads the rest of the material from its buffer
+layout(location = 0) out vec4 albedo;
+// Octahedral normal
+layout(location = 1) out vec2 packed_normal;
+// Depth, for the lighting to rebuild the position from
+layout(location = 2) out float depth;
+
+void main()
+{
+	vec4 tex_colour = texture(tex, vec2(tex_coord.x, -tex_coord.y));
+
+	vec3 new_normal;
+	if (map_norms > 0.0)
+	{
+		vec3 norm_sample = texture(normal_map, tex_coord).xyz;
+		new_normal = normalize(normal);
+		vec3 new_tangent = normalize(tangent);
+		vec3 new_binormal = normalize(binormal);
+
+		// Transform components to range [0, 1]
+		norm_sample = 2.0 * norm_sample - vec3(1.0, 1.0, 1.0);
+		// Generate TBN matrix
+		mat3 TBN = mat3(new_tangent, new_binormal, new_normal);
+		// Return sampled normal transformed by TBN
+		new_normal = normalize(TBN * norm_sample);
+	}
+	else
+		new_normal = normalize(normal);
+
+	// Up to 256 materials fit the alpha
+	albedo = vec4(tex_colour.rgb, float(material_index) / 255.0);
+	packed_normal = encode_octahedral(new_normal);
+	depth = gl_FragCoord.z;
+}
@@ -0,0 +1,12 @@
+#version 440 core
+
+// Light volume transformation, identity for the screen quad
+uniform mat4 MVP;
+
+// Incoming position
+layout (location = 0) in vec3 position;
+
+void main()
+{
+	gl_Position = MVP * vec4(position, 1.0);
+}
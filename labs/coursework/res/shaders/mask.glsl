@@ -0,0 +1,13 @@
+// Post-processing stage: blends a menu image over the frame by its alpha
+
+// Alpha map
+uniform sampler2D alpha_map;
+
+vec4 apply_mask(in vec4 colour, in vec2 tex_coord)
+{
+	vec4 overlay = texture(alpha_map, tex_coord);
+	colour = mix(colour, overlay, overlay.a);
+	// Ensure alpha is 1
+	colour.a = 1.0;
+	return colour;
+}
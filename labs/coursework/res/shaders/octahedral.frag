@@ -0,0 +1,26 @@
+// Octahedral normal packing: the unit sphere is folded onto an octahedron and
+// flattened into a square, so a normal fits in two [0, 1] components with even
+// precision in every direction
+
+vec2 octahedral_wrap(in vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Packs a unit normal into [0, 1]
+vec2 encode_octahedral(in vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.z >= 0.0 ? n.xy : octahedral_wrap(n.xy);
+	return e * 0.5 + 0.5;
+}
+
+// Unpacks a normal packed by encode_octahedral
+vec3 decode_octahedral(in vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = octahedral_wrap(n.xy);
+	return normalize(n);
+}
@@ -33,7 +33,7 @@ vec4 calculate_point(in point_light point, in material mat, in vec3 position, in
 	vec4 diffuse = (mat.diffuse_reflection * c) * max(dot(normal, light_dir), 0);
 	vec3 half_vector = normalize(light_dir + view_dir);
 	vec4 specular = (mat.specular_reflection * c) * pow(max(dot(normal, half_vector), 0), mat.shininess);
-	vec4 primary = mat.emissive + diffuse;
-	vec4 colour = primary * tex_colour + specular;
+	// Emissive is added once, with the directional light
+	vec4 colour = diffuse * tex_colour + specular;
 	return colour;
 }
\ No newline at end of file
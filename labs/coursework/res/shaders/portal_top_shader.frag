@@ -1,6 +1,6 @@
 #version 440 core
 
-// This shader requires direction.frag, point.frag and spot.frag
+// This shader requires direction.frag, point.frag, spot.frag and clusters.frag
 
 // Directional light structure
 #ifndef DIRECTIONAL_LIGHT
@@ -57,19 +57,18 @@ vec4 calculate_point(in point_light point, in material mat, in vec3 position, in
 vec4 calculate_spot(in spot_light spot, in material mat, in vec3 position, in vec3 normal, in vec3 view_dir,
                     in vec4 tex_colour);
 float calculate_shadow(in sampler2DShadow   shadow_map, in vec4 light_space_pos);
+vec4 clustered_lighting(in vec3 position, in material mat, in vec3 normal, in vec3 view_dir, in vec4 tex_colour,
+                        in float shade_factor);
 
 // Directional light information
 uniform directional_light light;
-// Point lights being used in the scene
-uniform point_light points[10];
-// Spot lights being used in the scene
-uniform spot_light spots[10];
-// Number of point lights used
-uniform int pn;
-// Number of spot lights used
-uniform int sn;
+// Materials of the objects being drawn, streamed through a ring buffer each frame
+layout (std430, binding = 1) readonly buffer material_buffer
+{
+	material materials[];
+};
 // Material of the object being rendered
-uniform material mat;
+material mat;
 // Position of the eye
 uniform vec3 eye_pos;
 // Texture to sample from
@@ -101,12 +100,16 @@ layout (location = 3) in vec3 binormal;
 layout (location = 4) in vec3 tangent;
 // Incoming texture coordinate
 layout(location = 5) in vec4 light_space_pos;
+// Incoming material index
+layout(location = 6) flat in uint material_index;
 
 // Outgoing colour
 layout(location = 0) out vec4 colour;
 
 void main()
 {
+	mat = materials[material_index];
+
 	if (dot(eye_pos - portal_pos, portal_normal) < 0)
 	{
 		if (dot(other_portal_normal, ((offset * vec4(portal_pos, 1.0)).xyz - position)) > 0)
@@ -144,15 +147,7 @@ void main()
 
 
 	colour += calculate_directional(light, mat, new_normal, view_dir, tex_colour);
-    for (int i = 0; i < pn; i++)
-	{
-		// The only shadow map used at the moment is for spotlight 1
-		if (i != 1)
-			colour += calculate_point(points[i], mat, position, new_normal, view_dir, tex_colour);
-		else if (shade_factor > 0.5f)
-			colour += calculate_point(points[i], mat, position, new_normal, view_dir, tex_colour);
-	}
-    for (int i = 0; i < sn; i++)
-		colour += calculate_spot(spots[i], mat, position, new_normal, view_dir, tex_colour);
+	// Only the point and spot lights reaching this fragment's cluster
+	colour += clustered_lighting(position, mat, new_normal, view_dir, tex_colour, shade_factor);
 	colour.a = 1.0;
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#version 440 core
+
+// Light transformation for the pass
+uniform mat4 PV;
+
+// Per object data, streamed through a ring buffer each frame
+struct object_data
+{
+	// Model transformation matrix
+	mat4 M;
+	// Normal matrix
+	mat3 N;
+	// Texture repeats along each axis of a shared unit primitive
+	vec3 texture_tiling;
+	// Index into the material buffer
+	uint material;
+};
+layout (std430, binding = 0) readonly buffer object_buffer
+{
+	object_data objects[];
+};
+
+// Incoming position
+layout (location = 0) in vec3 position;
+// Object being drawn, the draw command's base instance
+layout (location = 15) in uint object_index;
+
+// Matches vert_shader.vert exactly when used for the depth pre-pass
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = PV * objects[object_index].M * vec4(position, 1.0);
+}
@@ -38,7 +38,8 @@ vec4 calculate_spot(in spot_light spot, in material mat, in vec3 position, in ve
 	vec3 half_vector = normalize(light_dir + view_dir);
 	vec4 specular = (mat.specular_reflection * light_colour) * pow(max(dot(normal, half_vector), 0.0), mat.shininess);
 	
-	vec4 colour = ((mat.emissive + diffuse) * tex_colour) + specular;
+	// Emissive is added once, with the directional light
+	vec4 colour = (diffuse * tex_colour) + specular;
 	colour.a = 1.0;
 
 	return colour;
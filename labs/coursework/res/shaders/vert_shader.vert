@@ -1,24 +1,39 @@
 #version 440 core
 
-// Model transformation matrix
-uniform mat4 M;
-// Transformation matrix
-uniform mat4 MVP;
-// Normal matrix
-uniform mat3 N;
+// Camera transformation for the pass
+uniform mat4 PV;
 // The light transformation matrix
-uniform mat4 lMVP;
+uniform mat4 lightPV;
+
+// Per object data, streamed through a ring buffer each frame
+struct object_data
+{
+	// Model transformation matrix
+	mat4 M;
+	// Normal matrix
+	mat3 N;
+	// Texture repeats along each axis of a shared unit primitive, zero for other meshes
+	vec3 texture_tiling;
+	// Index into the material buffer
+	uint material;
+};
+layout (std430, binding = 0) readonly buffer object_buffer
+{
+	object_data objects[];
+};
 
 // Incoming position
 layout (location = 0) in vec3 position;
 // Incoming normal
 layout (location = 2) in vec3 normal;
-// Incoming binormal
+// Incoming binormal - zero when packed away into the tangent's w
 layout (location = 3) in vec3 binormal;
-// Incoming tangent
-layout (location = 4) in vec3 tangent;
+// Incoming tangent, w is the binormal's direction
+layout (location = 4) in vec4 tangent;
 // Incoming texture coordinate
 layout (location = 10) in vec2 tex_coord_in;
+// Object being drawn, the draw command's base instance
+layout (location = 15) in uint object_index;
 
 // Outgoing position
 layout (location = 0) out vec3 vertex_position;
@@ -32,6 +47,10 @@ layout (location = 3) out vec3 binormal_out;
 layout (location = 4) out vec3 tangent_out;
 // Outgoing position in lightspace
 layout (location = 5) out vec4 light_space_pos;
+// Outgoing material index
+layout (location = 6) flat out uint material_index;
+// Matches the depth pre-pass exactly, so the depth test can pass on equal depths
+invariant gl_Position;
 
 void main()
 {
@@ -41,13 +60,21 @@ void main()
     vec4(0.0f, 0.0f, 0.5f, 0.0f),
     vec4(0.5f, 0.5f, 0.5f, 1.0f)
   );
-  gl_Position = MVP * vec4(position, 1.0);
+  object_data object = objects[object_index];
+  mat4 M = object.M;
+  vec3 texture_tiling = object.texture_tiling;
+  material_index = object.material;
+  gl_Position = PV * M * vec4(position, 1.0);
   
   vertex_position = (M * vec4(position, 1.0)).xyz;
-  transformed_normal = N * normal;
+  transformed_normal = object.N * normal;
   tex_coord_out = tex_coord_in;
+  vec3 b = dot(binormal, binormal) > 0.0 ? binormal : cross(normal, tangent.xyz) * tangent.w;
+  // The tangent and binormal follow the texture axes, so they pick out how far the face was stretched
+  if (texture_tiling != vec3(0.0))
+    tex_coord_out *= vec2(length(texture_tiling * tangent.xyz), length(texture_tiling * b));
 
-  light_space_pos = lightbias * lMVP * vec4(position, 1.0);
-  tangent_out = tangent;
-  binormal_out = binormal;
+  light_space_pos = lightbias * lightPV * M * vec4(position, 1.0);
+  tangent_out = tangent.xyz;
+  binormal_out = b;
 }
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "light_clusters.h"
+
+// G-buffer targets: texture colour with the material index in alpha, the
+// octahedral normal at 16 bits a component, and a copy of the depth to read
+// while the depth-stencil buffer is bound for the light volumes' tests
+const GLenum GBUFFER_ALBEDO_FORMAT = GL_RGBA8;
+const GLenum GBUFFER_NORMAL_FORMAT = GL_RG16;
+const GLenum GBUFFER_DEPTH_FORMAT = GL_R32F;
+// Texture units of the albedo, normal and depth targets, after the ambient occlusion
+const GLint GBUFFER_TEXTURE_UNIT = 4;
+// Segments around the light volumes
+const int LIGHT_VOLUME_SEGMENTS = 16;
+// Spot lights whose cone is wider than this are lit with a sphere instead
+const float LIGHT_VOLUME_MAX_CONE = glm::radians(75.0f);
+// Which light the lighting effect shades, its light_type uniform
+const GLint DEFERRED_DIRECTIONAL = 0;
+const GLint DEFERRED_POINT = 1;
+const GLint DEFERRED_SPOT = 2;
+
+// Deferred shading for the main view.  The scene is drawn once into a packed
+// G-buffer, then each light shades only the pixels it reaches: the directional
+// light and ambient with a screen quad, points with spheres and spots with
+// cones.  Each volume first marks the stencil where a surface lies inside it
+// (back faces behind the surface, front faces in front), then lights the
+// marked pixels and clears the marks again, so the lighting cost follows the
+// lit pixels rather than the scene's overdraw.  The lights are the ones
+// light_clusters holds for the frame, read from its storage buffers
+class gbuffer
+{
+public:
+	// Targets the size of the screen, sharing the scene's depth-stencil texture so the depth pre-pass carries over
+	gbuffer(GLuint width, GLuint height, GLuint depth_stencil)
+	{
+		glGenTextures(3, _textures);
+		const GLenum formats[3] = { GBUFFER_ALBEDO_FORMAT, GBUFFER_NORMAL_FORMAT, GBUFFER_DEPTH_FORMAT };
+		for (int i = 0; i < 3; i++)
+		{
+			glBindTexture(GL_TEXTURE_2D, _textures[i]);
+			glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+		const GLenum draw_buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		for (int i = 0; i < 3; i++)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, draw_buffers[i], GL_TEXTURE_2D, _textures[i], 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_stencil, 0);
+		glDrawBuffers(3, draw_buffers);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "ERROR - gbuffer: frame buffer not complete, status " << status << std::endl;
+			throw std::runtime_error("G-buffer frame buffer not complete");
+		}
+
+		build_volumes();
+	}
+	~gbuffer()
+	{
+		glDeleteFramebuffers(1, &_framebuffer);
+		glDeleteTextures(3, _textures);
+	}
+	gbuffer(const gbuffer &) = delete;
+	gbuffer &operator=(const gbuffer &) = delete;
+
+	// Binds the G-buffer for the geometry pass, clearing the depth copy to the far plane for the sky
+	void begin_geometry()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+		const GLfloat far_depth[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 2, far_depth);
+	}
+
+	// Binds the targets for reading on the lighting effect
+	void bind_textures(const graphics_framework::effect &eff) const
+	{
+		const char *names[3] = { "albedo_map", "normal_buffer", "depth_map" };
+		for (int i = 0; i < 3; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + GBUFFER_TEXTURE_UNIT + i);
+			glBindTexture(GL_TEXTURE_2D, _textures[i]);
+			glUniform1i(eff.get_uniform_location(names[i]), GBUFFER_TEXTURE_UNIT + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// Lights the scene's framebuffer, which must be bound with the G-buffer's depth-stencil and a zero
+	// stencil.  The lighting effect needs its other uniforms set and the lights' buffers bound by light_clusters::bind.
+	// stencil_eff only needs an MVP uniform, as nothing of it is drawn
+	void light(const light_clusters &lights, graphics_framework::effect &light_eff, graphics_framework::effect &stencil_eff, const glm::mat4 &PV)
+	{
+		glDepthMask(GL_FALSE);
+		// The directional light and ambient cover every surface and replace the sky drawn behind them
+		glDisable(GL_DEPTH_TEST);
+		graphics_framework::renderer::bind(light_eff);
+		glUniformMatrix4fv(light_eff.get_uniform_location("MVP"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+		glUniform1i(light_eff.get_uniform_location("light_type"), DEFERRED_DIRECTIONAL);
+		graphics_framework::renderer::render(_quad);
+
+		// The stencil must be zero on entry, as the frame clears it; each volume leaves it zero again
+		glEnable(GL_STENCIL_TEST);
+		glStencilMask(0xFF);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		auto &points = lights.get_points();
+		for (GLuint i = 0; i < points.size(); i++)
+		{
+			float range = points[i].position_range.w * sphere_scale();
+			glm::mat4 M = glm::translate(glm::mat4(1.0f), glm::vec3(points[i].position_range)) * glm::scale(glm::mat4(1.0f), glm::vec3(range));
+			light_volume(_sphere, PV * M, DEFERRED_POINT, i, light_eff, stencil_eff);
+		}
+		auto &spots = lights.get_spots();
+		for (GLuint i = 0; i < spots.size(); i++)
+		{
+			glm::vec3 position(spots[i].position_range);
+			float range = spots[i].position_range.w;
+			glm::vec3 direction = glm::normalize(glm::vec3(spots[i].direction_power));
+			// Angle where the falloff drops below the cut off
+			float angle = std::acos(std::pow(LIGHT_CUTOFF, 1.0f / std::max(spots[i].direction_power.w, 0.001f)));
+			if (angle > LIGHT_VOLUME_MAX_CONE)
+			{
+				glm::mat4 M = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(range * sphere_scale()));
+				light_volume(_sphere, PV * M, DEFERRED_SPOT, i, light_eff, stencil_eff);
+				continue;
+			}
+			// Cone down +z, turned onto the light's direction
+			glm::vec3 up = std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			glm::vec3 x = glm::normalize(glm::cross(up, direction));
+			glm::vec3 y = glm::cross(direction, x);
+			glm::mat4 R(glm::vec4(x, 0.0f), glm::vec4(y, 0.0f), glm::vec4(direction, 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			float radius = range * std::tan(angle);
+			glm::mat4 M = glm::translate(glm::mat4(1.0f), position) * R * glm::scale(glm::mat4(1.0f), glm::vec3(radius, radius, range));
+			light_volume(_cone, PV * M, DEFERRED_SPOT, i, light_eff, stencil_eff);
+		}
+		glDisable(GL_BLEND);
+		glDisable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+		glCullFace(GL_BACK);
+		glEnable(GL_CULL_FACE);
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+	}
+
+	GLuint get_framebuffer() const { return _framebuffer; }
+
+private:
+	// Marks the surfaces inside a volume in the stencil, then lights them and clears the marks
+	void light_volume(graphics_framework::geometry &volume, const glm::mat4 &MVP, GLint type, GLuint index, graphics_framework::effect &light_eff, graphics_framework::effect &stencil_eff)
+	{
+		graphics_framework::renderer::bind(stencil_eff);
+		glUniformMatrix4fv(stencil_eff.get_uniform_location("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
+		glEnable(GL_DEPTH_TEST);
+		glDisable(GL_CULL_FACE);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glStencilFunc(GL_ALWAYS, 0, 0xFF);
+		// Where the surface is in front of a back face but not of a front face, the count ends up non zero.
+		// Counting depth failures keeps this right with the eye inside the volume
+		glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+		glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+		graphics_framework::renderer::render(volume);
+
+		// Back faces, so the volume still draws with the eye inside it
+		graphics_framework::renderer::bind(light_eff);
+		glUniformMatrix4fv(light_eff.get_uniform_location("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
+		glUniform1i(light_eff.get_uniform_location("light_type"), type);
+		glUniform1ui(light_eff.get_uniform_location("light_index"), index);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+		graphics_framework::renderer::render(volume);
+	}
+
+	// Grows the unit sphere so its flat faces still enclose the light's range
+	static float sphere_scale()
+	{
+		float c = std::cos(glm::pi<float>() / LIGHT_VOLUME_SEGMENTS);
+		return 1.0f / (c * c);
+	}
+
+	// Adds a triangle wound anticlockwise seen from outside, judged against a point inside the shape
+	static void add_triangle(std::vector<GLuint> &indices, const std::vector<glm::vec3> &positions, GLuint a, GLuint b, GLuint c, const glm::vec3 &inside)
+	{
+		glm::vec3 n = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+		// Triangles collapsed at the poles
+		if (glm::dot(n, n) < 1.0e-12f)
+			return;
+		if (glm::dot(n, positions[a] - inside) < 0.0f)
+			std::swap(b, c);
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	void build_volumes()
+	{
+		const int n = LIGHT_VOLUME_SEGMENTS;
+		const float pi = glm::pi<float>();
+
+		// Unit sphere of rings from pole to pole
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> indices;
+		for (int i = 0; i <= n; i++)
+		{
+			float phi = pi * i / n;
+			for (int j = 0; j <= n; j++)
+			{
+				float theta = 2.0f * pi * j / n;
+				positions.push_back(glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+			}
+		}
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++)
+			{
+				GLuint a = i * (n + 1) + j, b = a + 1, c = a + n + 1, d = c + 1;
+				add_triangle(indices, positions, a, b, d, glm::vec3(0.0f));
+				add_triangle(indices, positions, a, d, c, glm::vec3(0.0f));
+			}
+		_sphere.add_buffer(positions, graphics_framework::BUFFER_INDEXES::POSITION_BUFFER);
+		_sphere.add_index_buffer(indices);
+
+		// Cone with its tip at the origin and a base of radius 1 at z = 1, the base's edges outside the circle
+		positions = { glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+		indices.clear();
+		float radius = 1.0f / std::cos(pi / n);
+		for (int j = 0; j < n; j++)
+		{
+			float theta = 2.0f * pi * j / n;
+			positions.push_back(glm::vec3(radius * std::cos(theta), radius * std::sin(theta), 1.0f));
+		}
+		glm::vec3 inside(0.0f, 0.0f, 0.5f);
+		for (int j = 0; j < n; j++)
+		{
+			GLuint a = 2 + j, b = 2 + (j + 1) % n;
+			add_triangle(indices, positions, 0, a, b, inside);
+			add_triangle(indices, positions, 1, a, b, inside);
+		}
+		_cone.add_buffer(positions, graphics_framework::BUFFER_INDEXES::POSITION_BUFFER);
+		_cone.add_index_buffer(indices);
+
+		// Screen quad, already in clip space
+		std::vector<glm::vec3> corners{ glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f) };
+		_quad.set_type(GL_TRIANGLE_STRIP);
+		_quad.add_buffer(corners, graphics_framework::BUFFER_INDEXES::POSITION_BUFFER);
+	}
+
+	GLuint _framebuffer;
+	// Albedo, normal and depth
+	GLuint _textures[3];
+	graphics_framework::geometry _sphere;
+	graphics_framework::geometry _cone;
+	graphics_framework::geometry _quad;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+#include <vector>
+#include "../../practicals/67_Compute_Shader/ring_buffer.h"
+
+// Cluster grid: screen tiles across and down, and depth slices, matching clusters.frag
+const GLuint CLUSTER_X = 16;
+const GLuint CLUSTER_Y = 9;
+const GLuint CLUSTER_Z = 24;
+const GLuint CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// Storage buffer bindings, after the object, material and histogram buffers
+const GLuint POINT_LIGHT_BUFFER_BINDING = 3;
+const GLuint SPOT_LIGHT_BUFFER_BINDING = 4;
+const GLuint CLUSTER_BUFFER_BINDING = 5;
+const GLuint LIGHT_INDEX_BUFFER_BINDING = 6;
+// Fraction of a light's brightness below which it is treated as out of range
+const float LIGHT_CUTOFF = 1.0f / 32.0f;
+
+// Point light as clusters.frag reads it
+struct clustered_point
+{
+	glm::vec4 colour;
+	// Position in xyz, range in w
+	glm::vec4 position_range;
+	// Constant, linear and quadratic attenuation
+	glm::vec4 attenuation;
+};
+
+// Spot light as clusters.frag reads it
+struct clustered_spot
+{
+	glm::vec4 colour;
+	// Position in xyz, range in w
+	glm::vec4 position_range;
+	// Direction in xyz, power in w
+	glm::vec4 direction_power;
+	// Constant, linear and quadratic attenuation
+	glm::vec4 attenuation;
+};
+
+// Where a cluster's lights start in the index list, and how many of each kind
+struct cluster_cell
+{
+	GLuint offset;
+	GLuint point_count;
+	GLuint spot_count;
+	GLuint padding;
+};
+
+// Distance where 1 / (constant + linear d + quadratic d^2) falls to LIGHT_CUTOFF of the light's brightest channel
+inline float light_range(const glm::vec4 &colour, float constant, float linear, float quadratic)
+{
+	float target = std::max(std::max(colour.r, colour.g), colour.b) / LIGHT_CUTOFF - constant;
+	if (target <= 0.0f)
+		return 0.0f;
+	if (quadratic > 0.0f)
+		return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * target)) / (2.0f * quadratic);
+	if (linear > 0.0f)
+		return target / linear;
+	// No falloff at all
+	return 1.0e6f;
+}
+
+// Clustered forward shading: the view frustum is split into screen tiles and
+// exponential depth slices, and each cluster lists the lights whose range
+// reaches it.  Fragments find their cluster from gl_FragCoord and view depth
+// and only light themselves with that list, so the cost per fragment follows
+// the lights nearby rather than the lights in the scene.  Lights are assigned
+// on the CPU each frame, bounding each light's sphere by the clusters its
+// screen rectangle and depth span cover, and the lists go out through the
+// frame's ring buffer region
+class light_clusters
+{
+public:
+	// Ring allocations for one view, bound by bind
+	struct view_data
+	{
+		ring_buffer::allocation points;
+		ring_buffer::allocation spots;
+		ring_buffer::allocation cells;
+		ring_buffer::allocation indices;
+		glm::mat4 V;
+	};
+
+	// Converts the scene's lights.  Call once a frame, before build
+	void set_lights(const std::vector<graphics_framework::point_light> &points, const std::vector<graphics_framework::spot_light> &spots)
+	{
+		_points.clear();
+		_spots.clear();
+		for (auto &p : points)
+		{
+			auto colour = p.get_light_colour();
+			float range = light_range(colour, p.get_constant_attenuation(), p.get_linear_attenuation(), p.get_quadratic_attenuation());
+			_points.push_back(clustered_point{ colour, glm::vec4(p.get_position(), range), glm::vec4(p.get_constant_attenuation(), p.get_linear_attenuation(), p.get_quadratic_attenuation(), 0.0f) });
+		}
+		for (auto &s : spots)
+		{
+			auto colour = s.get_light_colour();
+			float range = light_range(colour, s.get_constant_attenuation(), s.get_linear_attenuation(), s.get_quadratic_attenuation());
+			_spots.push_back(clustered_spot{ colour, glm::vec4(s.get_position(), range), glm::vec4(s.get_direction(), s.get_power()), glm::vec4(s.get_constant_attenuation(), s.get_linear_attenuation(), s.get_quadratic_attenuation(), 0.0f) });
+		}
+	}
+
+	// Assigns the lights to clusters for a view and streams the result into the frame's ring region
+	view_data build(ring_buffer &ring, GLsizeiptr alignment, const glm::mat4 &V, const glm::mat4 &P, float near_plane, float far_plane)
+	{
+		_point_cells.resize(CLUSTER_COUNT);
+		_spot_cells.resize(CLUSTER_COUNT);
+		for (GLuint c = 0; c < CLUSTER_COUNT; c++)
+		{
+			_point_cells[c].clear();
+			_spot_cells[c].clear();
+		}
+		for (GLuint i = 0; i < _points.size(); i++)
+			assign(_point_cells, i, glm::vec3(_points[i].position_range), _points[i].position_range.w, V, P, near_plane, far_plane);
+		for (GLuint i = 0; i < _spots.size(); i++)
+			assign(_spot_cells, i, glm::vec3(_spots[i].position_range), _spots[i].position_range.w, V, P, near_plane, far_plane);
+
+		std::vector<cluster_cell> cells(CLUSTER_COUNT);
+		std::vector<GLuint> indices;
+		for (GLuint c = 0; c < CLUSTER_COUNT; c++)
+		{
+			cells[c] = cluster_cell{ static_cast<GLuint>(indices.size()), static_cast<GLuint>(_point_cells[c].size()), static_cast<GLuint>(_spot_cells[c].size()), 0 };
+			indices.insert(indices.end(), _point_cells[c].begin(), _point_cells[c].end());
+			indices.insert(indices.end(), _spot_cells[c].begin(), _spot_cells[c].end());
+		}
+		// Empty buffers can't be bound, so each gets at least one entry
+		indices.push_back(0);
+		clustered_point no_point = {};
+		clustered_spot no_spot = {};
+
+		view_data data;
+		data.points = _points.empty() ? ring.push(&no_point, sizeof(no_point), alignment) : ring.push(_points.data(), _points.size() * sizeof(clustered_point), alignment);
+		data.spots = _spots.empty() ? ring.push(&no_spot, sizeof(no_spot), alignment) : ring.push(_spots.data(), _spots.size() * sizeof(clustered_spot), alignment);
+		data.cells = ring.push(cells.data(), cells.size() * sizeof(cluster_cell), alignment);
+		data.indices = ring.push(indices.data(), indices.size() * sizeof(GLuint), alignment);
+		data.V = V;
+		return data;
+	}
+
+	// Binds a view's lights and clusters, and sets the uniforms clusters.frag needs on the bound effect
+	static void bind(const graphics_framework::effect &eff, const view_data &data, GLuint render_width, GLuint render_height, float near_plane, float far_plane)
+	{
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, POINT_LIGHT_BUFFER_BINDING, data.points.buffer, data.points.offset, data.points.size);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SPOT_LIGHT_BUFFER_BINDING, data.spots.buffer, data.spots.offset, data.spots.size);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, data.cells.buffer, data.cells.offset, data.cells.size);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BUFFER_BINDING, data.indices.buffer, data.indices.offset, data.indices.size);
+		glUniformMatrix4fv(eff.get_uniform_location("cluster_view"), 1, GL_FALSE, glm::value_ptr(data.V));
+		glUniform2f(eff.get_uniform_location("cluster_tile_scale"), float(CLUSTER_X) / render_width, float(CLUSTER_Y) / render_height);
+		// slice = log(depth / near) * CLUSTER_Z / log(far / near)
+		float slice_scale = CLUSTER_Z / std::log(far_plane / near_plane);
+		glUniform2f(eff.get_uniform_location("cluster_slice"), slice_scale, -std::log(near_plane) * slice_scale);
+	}
+
+	size_t get_light_count() const { return _points.size() + _spots.size(); }
+	// The lights as set_lights converted them, in the order their buffers hold them
+	const std::vector<clustered_point> &get_points() const { return _points; }
+	const std::vector<clustered_spot> &get_spots() const { return _spots; }
+
+private:
+	static int depth_slice(float depth, float near_plane, float far_plane)
+	{
+		int slice = static_cast<int>(std::floor(std::log(depth / near_plane) / std::log(far_plane / near_plane) * CLUSTER_Z));
+		return std::max(0, std::min(slice, int(CLUSTER_Z) - 1));
+	}
+
+	// Adds light to every cluster its sphere could touch
+	static void assign(std::vector<std::vector<GLuint>> &cells, GLuint light, const glm::vec3 &position, float range, const glm::mat4 &V, const glm::mat4 &P, float near_plane, float far_plane)
+	{
+		glm::vec3 centre = glm::vec3(V * glm::vec4(position, 1.0f));
+		// View space looks down -z
+		float nearest = -centre.z - range;
+		float furthest = -centre.z + range;
+		if (furthest < near_plane || nearest > far_plane)
+			return;
+		int z0 = depth_slice(std::max(nearest, near_plane), near_plane, far_plane);
+		int z1 = depth_slice(std::min(furthest, far_plane), near_plane, far_plane);
+
+		// Screen rectangle of the sphere's bounding box, the whole screen if it reaches behind the near plane
+		glm::vec2 low(-1.0f), high(1.0f);
+		if (nearest > near_plane)
+		{
+			low = glm::vec2(1.0f);
+			high = glm::vec2(-1.0f);
+			for (int i = 0; i < 8; i++)
+			{
+				glm::vec3 corner = centre + glm::vec3(i & 1 ? range : -range, i & 2 ? range : -range, i & 4 ? range : -range);
+				glm::vec4 clip = P * glm::vec4(corner, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				low = glm::min(low, ndc);
+				high = glm::max(high, ndc);
+			}
+			if (high.x < -1.0f || high.y < -1.0f || low.x > 1.0f || low.y > 1.0f)
+				return;
+		}
+		auto tile = [](float ndc, GLuint tiles) { return std::max(0, std::min(static_cast<int>((ndc * 0.5f + 0.5f) * tiles), int(tiles) - 1)); };
+		int x0 = tile(low.x, CLUSTER_X), x1 = tile(high.x, CLUSTER_X);
+		int y0 = tile(low.y, CLUSTER_Y), y1 = tile(high.y, CLUSTER_Y);
+		for (int z = z0; z <= z1; z++)
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+					cells[(z * CLUSTER_Y + y) * CLUSTER_X + x].push_back(light);
+	}
+
+	std::vector<clustered_point> _points;
+	std::vector<clustered_spot> _spots;
+	// Lights per cluster, kept between frames so the lists don't reallocate
+	std::vector<std::vector<GLuint>> _point_cells;
+	std::vector<std::vector<GLuint>> _spot_cells;
+};
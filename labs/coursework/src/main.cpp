@@ -1,5 +1,15 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "primitive_tables.h"
+#include "../../practicals/36_Loading_Models/mesh_optimizer.h"
+#include "../../practicals/67_Compute_Shader/ring_buffer.h"
+#include "../../practicals/72_Blur/auto_exposure.h"
+#include "../../practicals/72_Blur/dynamic_resolution.h"
+#include "../../practicals/72_Blur/hdr_post.h"
+#include "../../practicals/72_Blur/ssao.h"
+#include "gbuffer.h"
+#include "light_clusters.h"
+#include "scene_batch.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -10,14 +20,61 @@ class turbo_mesh : public mesh
 {
 	// Parent for hierarchies
 	turbo_mesh* _parent = nullptr;
+	// Size of the unit primitive this mesh draws.  Only applies to this mesh, so children aren't stretched with it
+	glm::vec3 _geometry_scale = glm::vec3(1.0f);
+	// Texture repeats along each axis, zero when the texture coordinates are used as they are
+	glm::vec3 _texture_tiling = glm::vec3(0.0f);
+	// Levels of detail of a loaded model, null for meshes that only have one
+	const lod_model *_lods = nullptr;
+	// Level drawn this frame
+	size_t _lod_level = 0;
 
 
 public:
 	turbo_mesh() : mesh() {};
 	turbo_mesh(geometry &geom) : mesh(geom) {};
 	turbo_mesh(geometry &geom, material &mat) : mesh(geom, mat) {};
+	// Shared unit primitive stretched to dims, with the texture repeating once per unit like geometry_builder's shapes
+	turbo_mesh(primitive_type type, const glm::vec3 &dims) : mesh(get_primitive(type)), _geometry_scale(dims), _texture_tiling(dims) {};
+	// Loaded model drawn at the level of detail picked by update_lod
+	turbo_mesh(lod_model &model) : mesh(model.geom), _lods(&model) {};
 	turbo_mesh(const turbo_mesh &other) = default;
 
+	// Gets the texture tiling
+	glm::vec3 get_texture_tiling() const { return _texture_tiling; }
+
+	// Picks the level of detail for how large the mesh is on screen from eye
+	void update_lod(const glm::vec3 &eye, float projection_scale)
+	{
+		if (_lods != nullptr)
+			_lod_level = select_lod(*_lods, _lod_level, get_hierarchical_transform_matrix(), eye, projection_scale);
+	}
+
+	// Draws the mesh at its current level of detail.  The effect and its uniforms must already be set
+	void draw()
+	{
+		if (_lods != nullptr)
+			render_lod(*_lods, _lod_level);
+		else
+			renderer::render(*this);
+	}
+
+	// Level of detail being drawn, null for meshes that only have one
+	const mesh_lod *get_lod() const
+	{
+		if (_lods == nullptr)
+			return nullptr;
+		return &_lods->levels[std::min(_lod_level, _lods->levels.size() - 1)];
+	}
+
+	// Draws the mesh reading only its position stream, for the stencil pass
+	void draw_positions()
+	{
+		if (_lods != nullptr)
+			render_lod(*_lods, _lod_level, true);
+		else
+			render_positions(get_geometry());
+	}
 
 
 	// Gets the parent pointer
@@ -28,7 +85,7 @@ public:
 	// Gets the transform matrix for an object is a hierarchy
 	glm::mat4 get_hierarchical_transform_matrix()
 	{
-		glm::mat4 M = get_transform().get_transform_matrix();
+		glm::mat4 M = get_transform().get_transform_matrix() * glm::scale(glm::mat4(1.0f), _geometry_scale);
 		turbo_mesh *current = this;
 		while (current->get_parent() != nullptr)
 		{
@@ -41,7 +98,7 @@ public:
 	// Gets the normal matrix for an object is a hierarchy
 	glm::mat3 get_hierarchical_normal_matrix()
 	{
-		glm::mat3 N = get_transform().get_normal_matrix();
+		glm::mat3 N = get_transform().get_normal_matrix() * glm::mat3(glm::scale(glm::mat4(1.0f), 1.0f / _geometry_scale));
 		turbo_mesh *current = this;
 		while (current->get_parent() != nullptr)
 		{
@@ -59,12 +116,63 @@ public:
 effect eff;
 effect portal_eff;
 effect shadow_eff;
-effect colour_eff;
 effect sky_eff;
-effect mask_eff;
+effect shadow_batch_eff;
+effect gbuffer_eff;
+effect deferred_eff;
+
+// Per object data, laid out like object_data in the batch vertex shaders (std430)
+struct object_data
+{
+	mat4 M;
+	// mat3 columns are padded to vec4
+	vec4 N[3];
+	vec3 texture_tiling;
+	GLuint material;
+};
+// Material, laid out like material in the lighting shaders (std430)
+struct material_data
+{
+	vec4 emissive;
+	vec4 diffuse_reflection;
+	vec4 specular_reflection;
+	float shininess;
+	float padding[3];
+};
+// Storage buffer bindings of the objects and materials
+const GLuint OBJECT_BUFFER_BINDING = 0;
+const GLuint MATERIAL_BUFFER_BINDING = 1;
+// Room for each frame's objects, materials, draw commands, and the light clusters of the view and both portals
+const GLsizeiptr OBJECT_RING_SIZE = 4 * 1024 * 1024;
+// Streams the per frame batch data, a region per frame in flight
+unique_ptr<ring_buffer> object_ring;
+GLsizeiptr storage_alignment;
+
+// Every mesh's geometry in shared arenas, drawn a pass at a time
+scene_batch batch;
+// Draws sharing a texture and normal map, which one glMultiDrawElementsIndirect can cover
+struct batch_group
+{
+	texture *tex;
+	texture *normal_map;
+	// Byte offset of the group's first command in the ring
+	GLintptr offset;
+	GLsizei count;
+};
+// This frame's batch data in the ring, the commands sorted into groups
+struct
+{
+	ring_buffer::allocation objects;
+	ring_buffer::allocation materials;
+	ring_buffer::allocation commands;
+	GLsizei command_count;
+	vector<batch_group> groups;
+} frame_batch;
 
 // Object containers
 map<string, turbo_mesh> meshes;
+// Loaded models with their levels of detail, shared by every mesh drawing them
+map<string, lod_model> models;
 map<string, texture> texs;
 map<string, texture> normal_maps;
 vector<shadow_map> shadows;
@@ -93,6 +201,18 @@ double cursor_y;
 directional_light light;
 vector<point_light> points;
 vector<spot_light> spots;
+// Lights sorted into clusters for each view, rebuilt every frame
+light_clusters clusters;
+light_clusters::view_data view_lights;
+light_clusters::view_data portal1_lights;
+light_clusters::view_data portal2_lights;
+// Grid of unshadowed street lights, for testing many lights at once
+vector<point_light> street_lights;
+const int STREET_LIGHT_ROWS = 16;
+bool street_lights_on = false;
+// Camera near and far planes, which the clusters' depth slices span
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 1000.0f;
 
 // Skybox
 mesh skybox;
@@ -106,12 +226,34 @@ vec3 portal2_normal;
 float dist_to_p1;
 float dist_to_p2;
 
-// Screen quad for postprocessing
-geometry screen_quad;
-
-// FBO texture
+// Postprocessing passes, declared each frame
+unique_ptr<post_graph> post;
+// Blurs for postprocessing
+unique_ptr<blur_library> blurs;
+// How far the scene behind the menu is blurred, in pixels
+const float MENU_BLUR_RADIUS = 24.0f;
+// Bloom and tonemapping of the HDR scene
+unique_ptr<hdr_post> hdr;
+hdr_settings hdr_controls;
+// Exposure adapting to the scene's brightness, fed to the tonemap without reading it back
+unique_ptr<auto_exposure> exposure;
+// Seconds the last update covered, for exposure adaptation
+float frame_time = 0.0f;
+// Render resolution, scaled to keep the GPU frame time in budget
+unique_ptr<dynamic_resolution> resolution;
+// Ambient occlusion of the main view, from the depth pre-pass
+unique_ptr<ssao> occlusion;
+ssao_settings ssao_controls;
+bool ssao_on = true;
+// Texture unit the occlusion is bound to for the lighting
+const GLint AO_TEXTURE_UNIT = 3;
+// Deferred shading of the main view, instead of the forward clustered lighting.  The portal views stay forward
+unique_ptr<gbuffer> deferred;
+bool deferred_on = false;
+
+// FBO texture, HDR so lights can be brighter than 1.  Full size; dynamic resolution draws into part of it
 GLuint colour_tex;
-// FBO depth-stencil buffer
+// FBO depth-stencil texture, sampled for ambient occlusion
 GLuint depth_stencil_buffer;
 // FBO
 GLuint frame;
@@ -239,65 +381,175 @@ void draw_stencil_mask(turbo_mesh m, int layer)
 	mat4 MVP = calculatePV() * m.get_hierarchical_transform_matrix();
 	glUniformMatrix4fv(shadow_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
 	// Draw to stencil buffer regardless of facing
-	renderer::render(m);
+	m.draw_positions();
 }
 
 
-// Renders the meshes stored in the 'meshes' map using the main effect 'eff'
-void render_scene(mat4 lightProjectionMat)
+// Writes every mesh's transform, material and draw command into this frame's part of the ring.
+// Commands are sorted by texture so each texture set is one multi draw
+void build_frame_batch()
 {
-	mat4 M;
-	mat4 PV = calculatePV();
-	renderer::bind(eff);
-	glUniform1i(eff.get_uniform_location("pn"), points.size());
-	glUniform1i(eff.get_uniform_location("sn"), spots.size());
-	glUniform3fv(eff.get_uniform_location("eye_pos"), 1, value_ptr(eye_pos()));
-	renderer::bind(shadows[1].buffer->get_depth(), 1);
-	glUniform1i(eff.get_uniform_location("shadow_map"), 1);
+	vector<object_data> objects;
+	vector<material_data> materials;
+	// Commands with the textures they need
+	vector<pair<pair<texture*, texture*>, draw_elements_command>> draws;
 	for (auto &e : meshes)
 	{
-		turbo_mesh m = e.second;
-		M = m.get_hierarchical_transform_matrix();
-
-		// Calculate MVP
-		auto MVP = PV * M;
-
-		// Pass uniforms to shaders
-		glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-		glUniformMatrix4fv(eff.get_uniform_location("M"), 1, GL_FALSE, value_ptr(M));
-		glUniformMatrix3fv(eff.get_uniform_location("N"), 1, GL_FALSE, value_ptr(m.get_hierarchical_normal_matrix()));
-		mat4 lMVP = lightProjectionMat * shadows[1].get_view() * M;
-		glUniformMatrix4fv(eff.get_uniform_location("lMVP"), 1, GL_FALSE, value_ptr(lMVP));
-		renderer::bind(m.get_material(), "mat");
-		renderer::bind(light, "light");
-		renderer::bind(points, "points");
-		renderer::bind(spots, "spots");
-
-		// If no texture assigned, assign default
-		if (texs[e.first].get_id() != 0)
-			renderer::bind(texs[e.first], 0);
-		else
-			renderer::bind(texs["check_1"], 0);
+		auto &m = e.second;
+		auto &range = batch.add_geometry(m.get_geometry());
+
+		object_data o;
+		o.M = m.get_hierarchical_transform_matrix();
+		mat3 N = m.get_hierarchical_normal_matrix();
+		for (int i = 0; i < 3; i++)
+			o.N[i] = vec4(N[i], 0.0f);
+		o.texture_tiling = m.get_texture_tiling();
+
+		// Meshes with the same material share one entry
+		auto &mat = m.get_material();
+		material_data md = { mat.get_emissive(), mat.get_diffuse(), mat.get_specular(), mat.get_shininess(), { 0.0f, 0.0f, 0.0f } };
+		o.material = 0;
+		while (o.material < materials.size() && memcmp(&materials[o.material], &md, sizeof(md)) != 0)
+			o.material++;
+		if (o.material == materials.size())
+			materials.push_back(md);
+
+		draw_elements_command c;
+		c.instance_count = 1;
+		c.base_vertex = range.base_vertex;
+		c.base_instance = static_cast<GLuint>(objects.size());
+		auto lod = m.get_lod();
+		c.first_index = range.first_index + (lod != nullptr ? lod->first_index : 0);
+		c.count = lod != nullptr ? lod->index_count : range.index_count;
+		objects.push_back(o);
+
+		// If no texture assigned, use the default.  No normal map turns normal mapping off
+		texture *tex = texs[e.first].get_id() != 0 ? &texs[e.first] : &texs["check_1"];
+		texture *normal_map = normal_maps[e.first].get_id() != 0 ? &normal_maps[e.first] : nullptr;
+		draws.push_back(make_pair(make_pair(tex, normal_map), c));
+	}
+	stable_sort(draws.begin(), draws.end(), [](const pair<pair<texture*, texture*>, draw_elements_command> &a, const pair<pair<texture*, texture*>, draw_elements_command> &b) { return a.first < b.first; });
+
+	frame_batch.objects = object_ring->push(objects.data(), objects.size() * sizeof(object_data), storage_alignment);
+	frame_batch.materials = object_ring->push(materials.data(), materials.size() * sizeof(material_data), storage_alignment);
+	frame_batch.commands = object_ring->allocate(draws.size() * sizeof(draw_elements_command), sizeof(GLuint));
+	frame_batch.command_count = static_cast<GLsizei>(draws.size());
+	frame_batch.groups.clear();
+	auto commands = static_cast<draw_elements_command*>(frame_batch.commands.data);
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		commands[i] = draws[i].second;
+		if (frame_batch.groups.empty() || frame_batch.groups.back().tex != draws[i].first.first || frame_batch.groups.back().normal_map != draws[i].first.second)
+			frame_batch.groups.push_back(batch_group{ draws[i].first.first, draws[i].first.second, static_cast<GLintptr>(frame_batch.commands.offset + i * sizeof(draw_elements_command)), 0 });
+		frame_batch.groups.back().count++;
+	}
+	object_ring->submit(frame_batch.commands);
+}
+
+
+// Binds this frame's objects, materials and draw commands for a batched pass
+void bind_frame_batch()
+{
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, frame_batch.objects.buffer, frame_batch.objects.offset, frame_batch.objects.size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, frame_batch.materials.buffer, frame_batch.materials.offset, frame_batch.materials.size);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frame_batch.commands.buffer);
+}
+
 
-		// If no normal map assigned tell shader to not do normal mapping
-		if (normal_maps[e.first].get_id() != 0)
+// Draws every mesh with the bound lighting effect, one multi draw per texture set
+void draw_batch_groups(effect &e)
+{
+	bind_frame_batch();
+	glUniform1i(e.get_uniform_location("tex"), 0);
+	glUniform1i(e.get_uniform_location("normal_map"), 2);
+	for (auto &g : frame_batch.groups)
+	{
+		renderer::bind(*g.tex, 0);
+		if (g.normal_map != nullptr)
 		{
-			renderer::bind(normal_maps[e.first], 2);
-			glUniform1i(eff.get_uniform_location("normal_map"), 2);
-			glUniform1f(eff.get_uniform_location("map_norms"), 1.0);
+			renderer::bind(*g.normal_map, 2);
+			glUniform1f(e.get_uniform_location("map_norms"), 1.0);
 		}
 		else
-			glUniform1f(eff.get_uniform_location("map_norms"), -1.0);
-
-		glUniform1i(eff.get_uniform_location("tex"), 0);
-		renderer::render(m);
+			glUniform1f(e.get_uniform_location("map_norms"), -1.0);
+		batch.draw(g.offset, g.count);
 	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+// Projection of the selected camera
+mat4 camera_projection()
+{
+	return cam_select == free0 ? free_cam.get_projection() : target_cam.get_projection();
+}
+
+
+// View of the selected camera
+mat4 camera_view()
+{
+	return cam_select == free0 ? free_cam.get_view() : target_cam.get_view();
+}
+
+
+// Renders the meshes stored in the 'meshes' map using the main effect 'eff'.  Depth is already laid down by the pre-pass
+void render_scene(mat4 lightProjectionMat, GLuint ao_texture)
+{
+	mat4 PV = calculatePV();
+	mat4 lightPV = lightProjectionMat * shadows[1].get_view();
+	renderer::bind(eff);
+	glUniform3fv(eff.get_uniform_location("eye_pos"), 1, value_ptr(eye_pos()));
+	renderer::bind(shadows[1].buffer->get_depth(), 1);
+	glUniform1i(eff.get_uniform_location("shadow_map"), 1);
+	glUniformMatrix4fv(eff.get_uniform_location("PV"), 1, GL_FALSE, value_ptr(PV));
+	glUniformMatrix4fv(eff.get_uniform_location("lightPV"), 1, GL_FALSE, value_ptr(lightPV));
+	renderer::bind(light, "light");
+	light_clusters::bind(eff, view_lights, resolution->get_width(), resolution->get_height(), CAMERA_NEAR, CAMERA_FAR);
+	glActiveTexture(GL_TEXTURE0 + AO_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, ao_texture);
+	glUniform1i(eff.get_uniform_location("ao_map"), AO_TEXTURE_UNIT);
+	glUniform2f(eff.get_uniform_location("ao_scale"), 1.0f / resolution->get_width(), 1.0f / resolution->get_height());
+	glDepthFunc(GL_LEQUAL);
+	draw_batch_groups(eff);
+	glDepthFunc(GL_LESS);
+}
+
+
+// Renders the meshes into the G-buffer, then lights it into 'frame' a light at a time.  Depth is already laid down by the pre-pass
+void render_deferred(mat4 lightProjectionMat, GLuint ao_texture)
+{
+	mat4 PV = calculatePV();
+	deferred->begin_geometry();
+	renderer::bind(gbuffer_eff);
+	glUniformMatrix4fv(gbuffer_eff.get_uniform_location("PV"), 1, GL_FALSE, value_ptr(PV));
+	glDepthFunc(GL_LEQUAL);
+	draw_batch_groups(gbuffer_eff);
+	glDepthFunc(GL_LESS);
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, frame);
+	mat4 lightPV = lightProjectionMat * shadows[1].get_view();
+	renderer::bind(deferred_eff);
+	glUniform3fv(deferred_eff.get_uniform_location("eye_pos"), 1, value_ptr(eye_pos()));
+	glUniformMatrix4fv(deferred_eff.get_uniform_location("inverse_PV"), 1, GL_FALSE, value_ptr(inverse(PV)));
+	glUniform2f(deferred_eff.get_uniform_location("inverse_render_size"), 1.0f / resolution->get_width(), 1.0f / resolution->get_height());
+	renderer::bind(shadows[1].buffer->get_depth(), 1);
+	glUniform1i(deferred_eff.get_uniform_location("shadow_map"), 1);
+	glUniformMatrix4fv(deferred_eff.get_uniform_location("lightPV"), 1, GL_FALSE, value_ptr(lightPV));
+	renderer::bind(light, "light");
+	light_clusters::bind(deferred_eff, view_lights, resolution->get_width(), resolution->get_height(), CAMERA_NEAR, CAMERA_FAR);
+	glActiveTexture(GL_TEXTURE0 + AO_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, ao_texture);
+	glUniform1i(deferred_eff.get_uniform_location("ao_map"), AO_TEXTURE_UNIT);
+	glUniform2f(deferred_eff.get_uniform_location("ao_scale"), 1.0f / resolution->get_width(), 1.0f / resolution->get_height());
+	deferred->bind_textures(deferred_eff);
+	deferred->light(clusters, deferred_eff, shadow_eff, PV);
 }
 
 
-// Renders the meshes stored in the 'meshes' map using the main effect 'eff'
-void render_portal(mat4 offsetMatrix, mat4 lightProjectionMat, vec3 portal_pos, vec3 other_portal_normal, vec3 other_portal_pos, vec3 portal_normal)
+// Offset from one portal to the other, turned a little at random when the portals wobble
+mat4 portal_offset(turbo_mesh &from, turbo_mesh &to)
 {
+	mat4 offsetMatrix = from.get_transform().get_transform_matrix() * inverse(to.get_transform().get_transform_matrix());
 	if (portal_wobble)
 	{
 		uniform_real_distribution<float> dist(-0.005f, 0.005f);
@@ -305,8 +557,15 @@ void render_portal(mat4 offsetMatrix, mat4 lightProjectionMat, vec3 portal_pos,
 		offsetMatrix = offsetMatrix * rotate(mat4(1.0), dist(ran), vec3(1.0, 0.0, 0.0));
 		offsetMatrix = offsetMatrix * rotate(mat4(1.0), dist(ran), vec3(0.0, 0.0, 1.0));
 	}
+	return offsetMatrix;
+}
+
 
+// Renders the meshes stored in the 'meshes' map using the main effect 'eff'.  offsetMatrix must be the one the portal's lights were clustered with
+void render_portal(mat4 offsetMatrix, const light_clusters::view_data &lights, mat4 lightProjectionMat, vec3 portal_pos, vec3 other_portal_normal, vec3 other_portal_pos, vec3 portal_normal)
+{
 	mat4 PV = calculatePV() * offsetMatrix;
+	mat4 lightPV = lightProjectionMat * shadows[1].get_view();
 
 	skybox.get_transform().position = other_portal_pos;
 	glDisable(GL_DEPTH_TEST);
@@ -322,54 +581,19 @@ void render_portal(mat4 offsetMatrix, mat4 lightProjectionMat, vec3 portal_pos,
 
 
 	renderer::bind(portal_eff);
-	glUniform1i(portal_eff.get_uniform_location("pn"), points.size());
-	glUniform1i(portal_eff.get_uniform_location("sn"), spots.size());
 	glUniform3fv(portal_eff.get_uniform_location("eye_pos"), 1, value_ptr(eye_pos()));
 	glUniform3fv(portal_eff.get_uniform_location("portal_pos"), 1, value_ptr(portal_pos));
 	glUniform3fv(portal_eff.get_uniform_location("portal_normal"), 1, value_ptr(portal_normal));
 	glUniform3fv(portal_eff.get_uniform_location("other_portal_normal"), 1, value_ptr(other_portal_normal));
 	glUniformMatrix4fv(portal_eff.get_uniform_location("offset"), 1, GL_FALSE, value_ptr(inverse(offsetMatrix)));
-	for (auto &e : meshes)
-	{
-		turbo_mesh m = e.second;
-		M = m.get_hierarchical_transform_matrix();
-
-		// Calculate MVP using M that is transformed to be seen through the portal
-		auto MVP = PV * M;
-
-		// Pass uniforms to shaders
-		glUniformMatrix4fv(portal_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-		glUniformMatrix4fv(portal_eff.get_uniform_location("M"), 1, GL_FALSE, value_ptr(M));
-		glUniformMatrix3fv(portal_eff.get_uniform_location("N"), 1, GL_FALSE, value_ptr(m.get_hierarchical_normal_matrix()));
-		mat4 lMVP = lightProjectionMat * shadows[1].get_view() * M;
-		glUniformMatrix4fv(portal_eff.get_uniform_location("lMVP"), 1, GL_FALSE, value_ptr(lMVP));
-		renderer::bind(m.get_material(), "mat");
-		renderer::bind(light, "light");
-		renderer::bind(points, "points");
-		renderer::bind(spots, "spots");
-
-		// If no texture assigned, assign default
-		if (texs[e.first].get_id() != 0)
-			renderer::bind(texs[e.first], 0);
-		else
-			renderer::bind(texs["check_1"], 0);
-
-		// If no normal map assigned tell shader to not do normal mapping
-		if (normal_maps[e.first].get_id() != 0)
-		{
-			renderer::bind(normal_maps[e.first], 2);
-			glUniform1i(portal_eff.get_uniform_location("normal_map"), 2);
-			glUniform1f(portal_eff.get_uniform_location("map_norms"), 1.0);
-		}
-		else
-			glUniform1f(portal_eff.get_uniform_location("map_norms"), -1.0);
-
-		glUniform1i(portal_eff.get_uniform_location("tex"), 0);
-		renderer::bind(shadows[1].buffer->get_depth(), 1);
-		glUniform1i(portal_eff.get_uniform_location("shadow_map"), 1);
-
-		renderer::render(m);
-	}
+	renderer::bind(shadows[1].buffer->get_depth(), 1);
+	glUniform1i(portal_eff.get_uniform_location("shadow_map"), 1);
+	// MVP uses the view seen through the portal
+	glUniformMatrix4fv(portal_eff.get_uniform_location("PV"), 1, GL_FALSE, value_ptr(PV));
+	glUniformMatrix4fv(portal_eff.get_uniform_location("lightPV"), 1, GL_FALSE, value_ptr(lightPV));
+	renderer::bind(light, "light");
+	light_clusters::bind(portal_eff, lights, resolution->get_width(), resolution->get_height(), CAMERA_NEAR, CAMERA_FAR);
+	draw_batch_groups(portal_eff);
 }
 
 
@@ -385,7 +609,7 @@ bool load_content()
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, colour_tex);
 		// NULL means reserve texture memory, but texels are undefined
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, renderer::get_screen_width(), renderer::get_screen_height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+		glTexImage2D(GL_TEXTURE_2D, 0, HDR_FORMAT, renderer::get_screen_width(), renderer::get_screen_height(), 0, GL_RGB, GL_FLOAT, nullptr);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -398,15 +622,19 @@ bool load_content()
 		// Attach 2D texture to this FBO
 		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, colour_tex, 0);
 		//-------------------------
-		// Generate the depth-stencil buffer
-		glGenRenderbuffersEXT(1, &depth_stencil_buffer);
-		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depth_stencil_buffer);
-		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH24_STENCIL8_EXT, renderer::get_screen_width(), renderer::get_screen_height());
+		// Generate the depth-stencil texture, a texture so SSAO can read depth
+		glGenTextures(1, &depth_stencil_buffer);
+		glBindTexture(GL_TEXTURE_2D, depth_stencil_buffer);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, renderer::get_screen_width(), renderer::get_screen_height());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		//-------------------------
-		// Attach depth buffer to FBO
-		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depth_stencil_buffer);
+		// Attach depth texture to FBO
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_TEXTURE_2D, depth_stencil_buffer, 0);
 		// Also attach as a stencil
-		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depth_stencil_buffer);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_TEXTURE_2D, depth_stencil_buffer, 0);
 		//-------------------------
 		glDrawBuffers(1, &draw_buffer);
 		// Does the GPU support current FBO configuration?
@@ -425,14 +653,16 @@ bool load_content()
 	}
 
 
-	// Seting up the screen quad
-	{
-		vector<vec3> positions{ vec3(-1.0f, -1.0f, 0.0f), vec3(1.0f, -1.0f, 0.0f), vec3(-1.0f, 1.0f, 0.0f),	vec3(1.0f, 1.0f, 0.0f) };
-		vector<vec2> tex_coords{ vec2(0.0, 0.0), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f) };
-		screen_quad.set_type(GL_TRIANGLE_STRIP);
-		screen_quad.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-		screen_quad.add_buffer(tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
-	}
+	// Setting up the postprocessing graph, which owns its screen quad
+	post = unique_ptr<post_graph>(new post_graph());
+	blurs = unique_ptr<blur_library>(new blur_library());
+	hdr = unique_ptr<hdr_post>(new hdr_post(*blurs));
+	exposure = unique_ptr<auto_exposure>(new auto_exposure());
+	hdr_controls.exposure_texture = exposure->get_texture();
+	resolution = unique_ptr<dynamic_resolution>(new dynamic_resolution(renderer::get_screen_width(), renderer::get_screen_height()));
+	occlusion = unique_ptr<ssao>(new ssao());
+	// G-buffer sharing the frame's depth-stencil
+	deferred = unique_ptr<gbuffer>(new gbuffer(renderer::get_screen_width(), renderer::get_screen_height(), depth_stencil_buffer));
 
 
 	// Setting up the portals
@@ -460,7 +690,7 @@ bool load_content()
 
 
 	// Set up skybox
-	skybox = mesh(geometry_builder::create_box());
+	skybox = mesh(get_primitive(box_primitive));
 	skybox.get_transform().scale = vec3(-100, -100, -100);
 	skybox.get_transform().rotate(rotate(mat4(1), pi<float>(), vec3(0.0f, 0.0f, 1.0f)));
 	skybox.get_transform().rotate(rotate(mat4(1), half_pi<float>(), vec3(0.0f, 1.0f, 0.0f)));
@@ -490,46 +720,51 @@ bool load_content()
 			meshes["floor"].get_transform().position = vec3(0.0f, 0.0f, 0.0f);
 			meshes["floor"].set_material(whitePlasticNoShine);
 
-			meshes["arch0"] = turbo_mesh(geometry("models/arch.obj"));
+			models["arch"] = load_lod_model("models/arch.obj");
+			models["lamp"] = load_lod_model("models/lamp.obj");
+			models["street lamp"] = load_lod_model("models/street lamp.obj");
+			models["flashlight"] = load_lod_model("models/Flashlight.obj");
+
+			meshes["arch0"] = turbo_mesh(models["arch"]);
 			meshes["arch0"].get_transform().position = vec3(-19.0f, 5.0f, -1.0f);
 			meshes["arch0"].get_transform().orientation = vec3(0.0f, half_pi<float>(), 0.0f);
 			meshes["arch0"].set_material(whitePlastic);
 
-			meshes["lamppost0"] = turbo_mesh(geometry("models/lamp.obj"));
+			meshes["lamppost0"] = turbo_mesh(models["lamp"]);
 			meshes["lamppost0"].get_transform().position = vec3(25.0f, 0.0f, 18.0f);
 			meshes["lamppost0"].get_transform().scale = vec3(0.05f, 0.05f, 0.05f);
 			meshes["lamppost0"].set_material(whitePlastic);
 
-			meshes["lamppost1"] = turbo_mesh(geometry("models/lamp.obj"));
+			meshes["lamppost1"] = turbo_mesh(models["lamp"]);
 			meshes["lamppost1"].get_transform().position = vec3(25.0f, 0.0f, 0.0f);
 			meshes["lamppost1"].get_transform().scale = vec3(0.05f, 0.05f, 0.05f);
 			meshes["lamppost1"].set_material(whitePlastic);
 
-			meshes["wall0"] = turbo_mesh(geometry_builder::create_box(vec3(2.0f, 12.0f, 60.0f)));
+			meshes["wall0"] = turbo_mesh(box_primitive, vec3(2.0f, 12.0f, 60.0f));
 			meshes["wall0"].get_transform().position = vec3(-20.0f, 6.0f, 0.0f);
 			meshes["wall0"].set_material(whitePlastic);
 
-			meshes["wall1"] = turbo_mesh(geometry_builder::create_box(vec3(60.0f, 12.0f, 2.0f)));
+			meshes["wall1"] = turbo_mesh(box_primitive, vec3(60.0f, 12.0f, 2.0f));
 			meshes["wall1"].get_transform().position = vec3(10.0f, 6.0f, -30.0f);
 			meshes["wall1"].set_material(whitePlasticNoShine);
 
-			meshes["spotlight0"] = turbo_mesh(geometry("models/street lamp.obj"));
+			meshes["spotlight0"] = turbo_mesh(models["street lamp"]);
 			meshes["spotlight0"].get_transform().position = vec3(-18.5f, 0.0f, 5.0f);
 			meshes["spotlight0"].get_transform().scale = vec3(0.1f, 0.1f, 0.1f);
 
-			meshes["flashlight0"] = turbo_mesh(geometry("models/Flashlight.obj"));
+			meshes["flashlight0"] = turbo_mesh(models["flashlight"]);
 			meshes["flashlight0"].get_transform().position = vec3(0.0, 0.0f, 0.25f);
 			meshes["flashlight0"].get_transform().scale = vec3(0.2f, 0.2f, 0.2f);
 			meshes["flashlight0"].get_transform().orientation = vec3(0.0f, pi<float>(), 0.0f);
 
 			// Child to deviceFrameBottom
-			meshes["deviceArmVertical"] = turbo_mesh(geometry_builder::create_box(vec3(0.29f, 7.0f, 0.1f)));
+			meshes["deviceArmVertical"] = turbo_mesh(box_primitive, vec3(0.29f, 7.0f, 0.1f));
 			meshes["deviceArmVertical"].get_transform().position = vec3(0.0f, 3.75f, 0.0f);
 			meshes["deviceArmVertical"].set_material(whiteCopper);
 			meshes["deviceArmVertical"].set_parent(&meshes["deviceFrameBottom"]);
 
 			// Child to deviceFrameBottom
-			meshes["deviceArmHorizontal"] = turbo_mesh(geometry_builder::create_box(vec3(20.0f, 0.3f, 0.1f)));
+			meshes["deviceArmHorizontal"] = turbo_mesh(box_primitive, vec3(20.0f, 0.3f, 0.1f));
 			meshes["deviceArmHorizontal"].get_transform().position = vec3(0.0f, 3.5f, 0.0f);
 			meshes["deviceArmHorizontal"].set_material(whiteCopper);
 			meshes["deviceArmHorizontal"].set_parent(&meshes["deviceFrameBottom"]);
@@ -542,27 +777,43 @@ bool load_content()
 			meshes["deviceRing"].set_parent(&meshes["deviceArmVertical"]);
 
 			// Child to deviceFrameBottom
-			meshes["deviceFrameTop"] = turbo_mesh(geometry_builder::create_box(vec3(20.0f, 0.5f, 0.5f)));
+			meshes["deviceFrameTop"] = turbo_mesh(box_primitive, vec3(20.0f, 0.5f, 0.5f));
 			meshes["deviceFrameTop"].get_transform().position = vec3(0.0f, 7.5f, 0.0f);
 			meshes["deviceFrameTop"].set_material(whiteCopper);
 			meshes["deviceFrameTop"].set_parent(&meshes["deviceFrameBottom"]);
 
 			// Child to deviceFrameBottom
-			meshes["deviceFrameLeft"] = turbo_mesh(geometry_builder::create_box(vec3(0.5f, 8.0f, 0.5f)));
+			meshes["deviceFrameLeft"] = turbo_mesh(box_primitive, vec3(0.5f, 8.0f, 0.5f));
 			meshes["deviceFrameLeft"].get_transform().position = vec3(-10.25f, 3.75f, 0.0f);
 			meshes["deviceFrameLeft"].set_material(whiteCopper);
 			meshes["deviceFrameLeft"].set_parent(&meshes["deviceFrameBottom"]);
 
 			// Child to deviceFrameBottom
-			meshes["deviceFrameRight"] = turbo_mesh(geometry_builder::create_box(vec3(0.5f, 8.0f, 0.5f)));
+			meshes["deviceFrameRight"] = turbo_mesh(box_primitive, vec3(0.5f, 8.0f, 0.5f));
 			meshes["deviceFrameRight"].get_transform().position = vec3(10.25f, 3.75f, 0.0f);
 			meshes["deviceFrameRight"].set_material(whiteCopper);
 			meshes["deviceFrameRight"].set_parent(&meshes["deviceFrameBottom"]);
 
 			// Top dog of the hierarchy tree
-			meshes["deviceFrameBottom"] = turbo_mesh(geometry_builder::create_box(vec3(20.0f, 0.5f, 0.5f)));
+			meshes["deviceFrameBottom"] = turbo_mesh(box_primitive, vec3(20.0f, 0.5f, 0.5f));
 			meshes["deviceFrameBottom"].get_transform().position = vec3(0.0f, 0.25f, -24.0f);
 			meshes["deviceFrameBottom"].set_material(whiteCopper);
+
+			// Pack and interleave the vertices of the built shapes, the loaded models were done as they loaded.  Meshes sharing a primitive share its buffers, which are only done once
+			vertex_compression_stats packed;
+			for (auto &e : meshes)
+			{
+				auto stats = compress_vertices(e.second.get_geometry());
+				interleave_vertices(e.second.get_geometry(), split_positions_layout);
+				packed.bytes_before += stats.bytes_before;
+				packed.bytes_after += stats.bytes_after;
+			}
+			cout << "Vertex data of built shapes packed from " << packed.bytes_before / 1024 << " KB to " << packed.bytes_after / 1024 << " KB" << endl;
+
+			// Copy every mesh into the shared arenas the passes draw from
+			for (auto &e : meshes)
+				batch.add_geometry(e.second.get_geometry());
+			batch.build();
 		}
 
 
@@ -602,6 +853,14 @@ bool load_content()
 	spots.push_back(spot_light(white, vec3(-16.5f, 14.3f, 5.0f), vec3(0.0f, -1.0f, 0.0f), 0.0f, 0.05f, 0.005f, 10.0f));						// spotlight0
 	spots.push_back(spot_light(white, vec3(0.0f, 0.4f, -1.0f), vec3(0.0f, 0.0f, -1.0f), 0.0f, 0.05f, 0.0f, 10.0f));							// flashlight
 
+	// Street lights are kept out of points, which each get six shadow maps
+	for (int x = 0; x < STREET_LIGHT_ROWS; x++)
+		for (int z = 0; z < STREET_LIGHT_ROWS; z++)
+		{
+			vec4 colour = vec4(0.5f + 0.5f * (x % 2), 0.5f + 0.5f * (z % 2), 1.0f - 0.5f * ((x + z) % 2), 1.0f);
+			street_lights.push_back(point_light(colour, vec3(-60.0f + x * 8.0f, 3.0f, -60.0f + z * 8.0f), 1.0f, 0.1f, 0.05f));
+		}
+
 	
 	// Initialize shadow maps
 	for (int i = 0; i < (spots.size() + points.size() * 6); i++)
@@ -613,35 +872,46 @@ bool load_content()
 	// Load in shaders
 	{
 		eff.add_shader("shaders/vert_shader.vert", GL_VERTEX_SHADER);
-		vector<string> frag_shaders{ "shaders/top_shader.frag", "shaders/directional.frag", "shaders/spot.frag", "shaders/point.frag", "shaders/shadow_index.frag" };
+		vector<string> frag_shaders{ "shaders/top_shader.frag", "shaders/directional.frag", "shaders/spot.frag", "shaders/point.frag", "shaders/shadow_index.frag", "shaders/clusters.frag" };
 		eff.add_shader(frag_shaders, GL_FRAGMENT_SHADER);
 
 		portal_eff.add_shader("shaders/vert_shader.vert", GL_VERTEX_SHADER);
-		vector<string> portal_frag_shaders{ "shaders/portal_top_shader.frag", "shaders/directional.frag", "shaders/spot.frag", "shaders/point.frag", "shaders/shadow_index.frag" };
+		vector<string> portal_frag_shaders{ "shaders/portal_top_shader.frag", "shaders/directional.frag", "shaders/spot.frag", "shaders/point.frag", "shaders/shadow_index.frag", "shaders/clusters.frag" };
 		portal_eff.add_shader(portal_frag_shaders, GL_FRAGMENT_SHADER);
 
 		shadow_eff.add_shader("shaders/shadow_depth.vert", GL_VERTEX_SHADER);
 
-		colour_eff.add_shader("shaders/simple.vert", GL_VERTEX_SHADER);
-		colour_eff.add_shader("shaders/colour_correction.frag", GL_FRAGMENT_SHADER);
 
 		sky_eff.add_shader("shaders/skybox.vert", GL_VERTEX_SHADER);
 		sky_eff.add_shader("shaders/skybox.frag", GL_FRAGMENT_SHADER);
 
-		mask_eff.add_shader("shaders/simple.vert", GL_VERTEX_SHADER);
-		mask_eff.add_shader("shaders/mask.frag", GL_FRAGMENT_SHADER);
 
+		shadow_batch_eff.add_shader("shaders/shadow_batch.vert", GL_VERTEX_SHADER);
+
+
+		gbuffer_eff.add_shader("shaders/vert_shader.vert", GL_VERTEX_SHADER);
+		gbuffer_eff.add_shader(vector<string>{ "shaders/gbuffer.frag", "shaders/octahedral.frag" }, GL_FRAGMENT_SHADER);
+
+		deferred_eff.add_shader("shaders/light_volume.vert", GL_VERTEX_SHADER);
+		vector<string> deferred_frag_shaders{ "shaders/deferred_light.frag", "shaders/directional.frag", "shaders/spot.frag", "shaders/point.frag", "shaders/shadow_index.frag", "shaders/clusters.frag", "shaders/octahedral.frag" };
+		deferred_eff.add_shader(deferred_frag_shaders, GL_FRAGMENT_SHADER);
 
 		// Build effect
 		eff.build();
 		shadow_eff.build();
 		portal_eff.build();
-		colour_eff.build();
 		sky_eff.build();
-		mask_eff.build();
+		shadow_batch_eff.build();
+		gbuffer_eff.build();
+		deferred_eff.build();
 	}
 
 
+	// Ring the per frame batch data is streamed through
+	object_ring = unique_ptr<ring_buffer>(new ring_buffer(OBJECT_RING_SIZE));
+	storage_alignment = ring_buffer::get_storage_alignment();
+
+
 	renderer::bind(sky_eff);
 	renderer::bind(cube_map, 0);
 	glUniform1i(sky_eff.get_uniform_location("cubemap"), 0);
@@ -650,13 +920,13 @@ bool load_content()
 	// Set target camera
 	target_cam.set_position(vec3(0.0f, 1.0f, 50.0f));
 	target_cam.set_target(vec3(0.0f, 0.0f, 0.0f));
-	target_cam.set_projection(quarter_pi<float>() * 1.3f, renderer::get_screen_aspect(), 0.1f, 1000.0f);
+	target_cam.set_projection(quarter_pi<float>() * 1.3f, renderer::get_screen_aspect(), CAMERA_NEAR, CAMERA_FAR);
 
 	
 	// Set free camera
 	free_cam.set_position(vec3(30.0f, 1.0f, 50.0f));
 	free_cam.set_target(vec3(0.0f, 0.0f, 0.0f));
-	free_cam.set_projection(quarter_pi<float>() * 1.3f, renderer::get_screen_aspect(), 0.1f, 1000.0f);
+	free_cam.set_projection(quarter_pi<float>() * 1.3f, renderer::get_screen_aspect(), CAMERA_NEAR, CAMERA_FAR);
 
 	// Select starting camera
 	cam_select = free0;
@@ -665,6 +935,7 @@ bool load_content()
 
 bool update(float delta_time)
 {
+	frame_time = delta_time;
 
 	// Assigns positions and directions of the lights to shadows
 	for (int i = 0; i < spots.size(); i++)
@@ -883,13 +1154,45 @@ bool update(float delta_time)
 	// Update skybox position
 	skybox.get_transform().position = eye_pos();
 
+	// Pick each model's level of detail once from the main camera, every pass then draws the same level
+	{
+		mat4 P = camera_projection();
+		float projection_scale = P[1][1] * 0.5f * static_cast<float>(renderer::get_screen_height());
+		for (auto &e : meshes)
+			e.second.update_lod(eye_pos(), projection_scale);
+	}
+
 	// Display frames per second in the console
-	cout << "FPS: " << 1.0f / delta_time << endl;
+	cout << "FPS: " << 1.0f / delta_time << "  GPU: " << resolution->get_frame_time() << "ms at " << resolution->get_scale() * 100.0f << "%";
+	if (ssao_on)
+		cout << "  SSAO: " << occlusion->get_milliseconds() << "ms, " << ssao_controls.samples << " samples";
+	cout << "  Lights: " << clusters.get_light_count() + 1 << (deferred_on ? " deferred" : " forward") << endl;
 	return true;
 }
 
 bool render()
 {
+	// Time the frame's GPU work, which sets the resolution of later frames
+	resolution->begin_frame();
+	// Move on to this frame's part of the ring and fill it with every mesh's draw
+	object_ring->begin_frame();
+	build_frame_batch();
+
+	// Sort the lights into clusters for the view and for the view through each portal.  The offsets, wobble
+	// included, are worked out once here so each portal is drawn with the view its clusters were built for
+	mat4 portal1_offset = portal_offset(portals.first, portals.second);
+	mat4 portal2_offset = portal_offset(portals.second, portals.first);
+	{
+		vector<point_light> lit_points = points;
+		if (street_lights_on)
+			lit_points.insert(lit_points.end(), street_lights.begin(), street_lights.end());
+		clusters.set_lights(lit_points, spots);
+		mat4 P = camera_projection();
+		view_lights = clusters.build(*object_ring, storage_alignment, camera_view(), P, CAMERA_NEAR, CAMERA_FAR);
+		portal1_lights = clusters.build(*object_ring, storage_alignment, camera_view() * portal1_offset, P, CAMERA_NEAR, CAMERA_FAR);
+		portal2_lights = clusters.build(*object_ring, storage_alignment, camera_view() * portal2_offset, P, CAMERA_NEAR, CAMERA_FAR);
+	}
+
 	mat4 V;
 	// Render the shadow map
 	// Set render target to shadow map
@@ -901,25 +1204,43 @@ bool render()
 	// Create a projection matrix for the point of view of the light
 	mat4 lightProjectionMat = perspective<float>(90.0f, renderer::get_screen_aspect(), 0.1f, 1000.f);
 	// Bind shadow shader
-	renderer::bind(shadow_eff);
+	renderer::bind(shadow_batch_eff);
 	V = shadows[1].get_view();
+	glUniformMatrix4fv(shadow_batch_eff.get_uniform_location("PV"), 1, GL_FALSE, value_ptr(lightProjectionMat * V));
 
-	// Render the meshes
-	for (auto &e : meshes)
-	{
-		turbo_mesh m = e.second;
-		// Create MVP matrix
-		auto M = m.get_hierarchical_transform_matrix();
-		mat4 MVP = lightProjectionMat * V * M;
-		glUniformMatrix4fv(shadow_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-		renderer::render(m);
-	}
+	// Render every mesh in one draw, reading only positions
+	bind_frame_batch();
+	batch.draw(frame_batch.commands.offset, frame_batch.command_count, true);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	glCullFace(GL_BACK);
 
 	
-	// Set the render target to 'frame' (frame buffer object)
+	// Set the render target to 'frame' (frame buffer object), drawing into the bottom left at the render resolution
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, frame);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	resolution->set_viewport();
+	GLuint render_width = resolution->get_width();
+	GLuint render_height = resolution->get_height();
+
+
+	// Depth pre-pass, which ambient occlusion reads and which saves shading hidden surfaces
+	renderer::bind(shadow_batch_eff);
+	glUniformMatrix4fv(shadow_batch_eff.get_uniform_location("PV"), 1, GL_FALSE, value_ptr(calculatePV()));
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	bind_frame_batch();
+	batch.draw(frame_batch.commands.offset, frame_batch.command_count, true);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+
+	// Ambient occlusion at half size.  It runs through the post graph, which leaves the screen bound
+	GLuint ao_texture = occlusion->get_unoccluded_texture();
+	if (ssao_on)
+	{
+		ao_texture = occlusion->update(*post, depth_stencil_buffer, renderer::get_screen_width(), renderer::get_screen_height(), render_width, render_height, camera_projection(), ssao_controls);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, frame);
+		resolution->set_viewport();
+	}
 
 
 	// Render skybox
@@ -934,7 +1255,10 @@ bool render()
 	glDepthMask(GL_TRUE);
 
 
-	render_scene(lightProjectionMat);
+	if (deferred_on)
+		render_deferred(lightProjectionMat, ao_texture);
+	else
+		render_scene(lightProjectionMat, ao_texture);
 
 
 	// Mark out portals in the stencil buffer
@@ -968,55 +1292,51 @@ bool render()
 	{
 		// Render image through first portal
 		glStencilFunc(GL_EQUAL, 1, 0xFF);
-		mat4 offset = portals.first.get_transform().get_transform_matrix() * inverse(portals.second.get_transform().get_transform_matrix());
-		render_portal(offset, lightProjectionMat, portals.first.get_transform().position, portal2_normal, portals.second.get_transform().position, portal1_normal);
+		render_portal(portal1_offset, portal1_lights, lightProjectionMat, portals.first.get_transform().position, portal2_normal, portals.second.get_transform().position, portal1_normal);
 		// Render image through second portal
 		glStencilFunc(GL_EQUAL, 2, 0xFF);
-		offset = portals.second.get_transform().get_transform_matrix() * inverse(portals.first.get_transform().get_transform_matrix());
-		render_portal(offset, lightProjectionMat, portals.second.get_transform().position, portal1_normal, portals.first.get_transform().position, portal2_normal);
-		// Disable stencil testing
+		render_portal(portal2_offset, portal2_lights, lightProjectionMat, portals.second.get_transform().position, portal1_normal, portals.first.get_transform().position, portal2_normal);
+		// Disable stencil testing, and let the next frame's clear reach the stencil again
 		glDisable(GL_STENCIL_TEST);
+		glStencilMask(0xFF);
 	}
 	
 
 	// Postprocessing
-	// Colour correction
-	{
-		renderer::bind(colour_eff);
-		glUniformMatrix4fv(colour_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(mat4(1.0)));
-		glBindTexture(GL_TEXTURE_2D, colour_tex);
-		glUniform1i(colour_eff.get_uniform_location("tex"), colour_tex);
-		glUniform1f(colour_eff.get_uniform_location("hue_offset"), hue);
-		glUniform1f(colour_eff.get_uniform_location("saturation"), saturation);
-		glUniform1f(colour_eff.get_uniform_location("brightness"), luma);
-		renderer::render(screen_quad);
-	}
-	
-	
-	// Masking
-	// Set render target to screen
+	// Bloom is blurred from the HDR scene at half size.  Tonemapping, colour correction and masking are
+	// all per pixel, so the graph fuses them into one draw straight to the screen, the only LDR write.
+	// Everything before that draw runs at the render resolution, and that draw scales it up
 	{
-		renderer::set_render_target();
-		renderer::bind(mask_eff);
-		glUniformMatrix4fv(mask_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(mat4(1.0)));
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, colour_tex);
-		glUniform1i(colour_eff.get_uniform_location("tex"), 0);
-		// Set active texture
-		glActiveTexture(GL_TEXTURE0 + 1);
+		// Measure the finished scene, which moves the exposure the tonemap reads on the GPU
+		exposure->update(colour_tex, render_width, render_height, frame_time);
+		hdr_controls.exposure_texture = exposure->get_texture();
+
+		post->reset();
+		// A scene smaller than its target is copied out so passes can read all of their input
+		bool full_size = render_width == renderer::get_screen_width() && render_height == renderer::get_screen_height();
+		auto scene = full_size ? post->import_texture(colour_tex, render_width, render_height, HDR_FORMAT) : post->import_region(frame, render_width, render_height, HDR_FORMAT);
+		auto tonemapped = hdr->resolve(*post, scene, hdr_controls);
+		auto corrected = post->add_stage("colour correction", "shaders/colour_correction.glsl", "colour_correction", tonemapped, {},
+			[](GLuint program)
+			{
+				glUniform1f(glGetUniformLocation(program, "hue_offset"), hue);
+				glUniform1f(glGetUniformLocation(program, "saturation"), saturation);
+				glUniform1f(glGetUniformLocation(program, "brightness"), luma);
+			});
+		// The scene behind an open menu is blurred, which stops the stages fusing that frame
 		if (show_menu)
-		{
-			glBindTexture(current_mask.get_type(), current_mask.get_id());
-			glUniform1i(mask_eff.get_uniform_location("alpha_map"), 1);
-		}
-		else
-		{
-			glBindTexture(masks["helpMenu"].get_type(), masks["helpMenu"].get_id());
-			glUniform1i(mask_eff.get_uniform_location("alpha_map"), 1);
-		}
-		renderer::render(screen_quad);
+			corrected = blurs->blur(*post, corrected, MENU_BLUR_RADIUS);
+		// The help prompt shows when the menu is hidden
+		auto &mask = show_menu ? current_mask : masks["helpMenu"];
+		auto alpha_map = post->import_texture(mask.get_id(), renderer::get_screen_width(), renderer::get_screen_height());
+		auto masked = post->add_stage("mask", "shaders/mask.glsl", "apply_mask", corrected, { { "alpha_map", alpha_map } });
+		post->present(masked);
+		post->execute();
 	}
+	resolution->end_frame();
 
+	// The GPU is done with this frame's object uniforms once it gets here
+	object_ring->end_frame();
 	return true;
 }
 
@@ -1026,6 +1346,20 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	// Whether or not to show menu
 	if (key == GLFW_KEY_F1 && action == GLFW_RELEASE)
 		show_menu = !show_menu;
+	// Whether or not the resolution follows the frame time
+	if (key == GLFW_KEY_F2 && action == GLFW_RELEASE)
+		resolution->set_enabled(!resolution->is_enabled());
+	// Ambient occlusion on or off, and its quality: 8, 16 or 32 samples
+	if (key == GLFW_KEY_F3 && action == GLFW_RELEASE)
+		ssao_on = !ssao_on;
+	if (key == GLFW_KEY_F4 && action == GLFW_RELEASE)
+		ssao_controls.samples = ssao_controls.samples >= SSAO_MAX_SAMPLES ? 8 : ssao_controls.samples * 2;
+	// Grid of street lights on or off
+	if (key == GLFW_KEY_F5 && action == GLFW_RELEASE)
+		street_lights_on = !street_lights_on;
+	// Deferred or forward shading of the main view
+	if (key == GLFW_KEY_F6 && action == GLFW_RELEASE)
+		deferred_on = !deferred_on;
 
 
 	if (menu != main_menu)
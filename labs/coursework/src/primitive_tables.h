@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <graphics_framework.h>
+
+// Vertex of a fixed primitive.  Plain arrays rather than glm types, so the
+// tables below are built entirely by the compiler
+struct primitive_vertex
+{
+	float position[3];
+	float normal[3];
+	float tangent[3];
+	float binormal[3];
+	float tex_coord[2];
+};
+
+// Unit cube centred on the origin.  Each face has its own four vertices so it
+// gets a flat normal and a full texture
+constexpr primitive_vertex box_vertices[] =
+{
+	// Front
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+	{{0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+	{{-0.5f, 0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+	// Back
+	{{0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+	{{-0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+	{{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, -1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+	// Right
+	{{0.5f, -0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+	{{0.5f, 0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+	{{0.5f, 0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+	// Left
+	{{-0.5f, -0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+	{{-0.5f, 0.5f, 0.5f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},
+	{{-0.5f, 0.5f, -0.5f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+	// Top
+	{{-0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 0.0f}},
+	{{0.5f, 0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 0.0f}},
+	{{0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 1.0f}},
+	{{-0.5f, 0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f}},
+	// Bottom
+	{{-0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}}
+};
+
+constexpr uint16_t box_indices[] =
+{
+	0, 1, 2, 0, 2, 3,
+	4, 5, 6, 4, 6, 7,
+	8, 9, 10, 8, 10, 11,
+	12, 13, 14, 12, 14, 15,
+	16, 17, 18, 16, 18, 19,
+	20, 21, 22, 20, 22, 23
+};
+
+// Unit tetrahedron - a triangular base with the apex above its middle
+constexpr primitive_vertex tetrahedron_vertices[] =
+{
+	// Front
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {0.5f, 1.0f}},
+	// Right
+	{{0.5f, -0.5f, 0.5f}, {0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, -0.894427f}, {-0.242536f, 0.970143f, 0.0f}, {0.0f, 0.0f}},
+	{{0.0f, -0.5f, -0.5f}, {0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, -0.894427f}, {-0.242536f, 0.970143f, 0.0f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, -0.894427f}, {-0.242536f, 0.970143f, 0.0f}, {0.5f, 1.0f}},
+	// Left
+	{{0.0f, -0.5f, -0.5f}, {-0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, 0.894427f}, {0.242536f, 0.970143f, 0.0f}, {0.0f, 0.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {-0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, 0.894427f}, {0.242536f, 0.970143f, 0.0f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {-0.872872f, 0.218218f, -0.436436f}, {-0.447214f, 0.0f, 0.894427f}, {0.242536f, 0.970143f, 0.0f}, {0.5f, 1.0f}},
+	// Bottom
+	{{0.0f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.5f, 1.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 0.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 0.0f}}
+};
+
+constexpr uint16_t tetrahedron_indices[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+// Unit square based pyramid
+constexpr primitive_vertex pyramid_vertices[] =
+{
+	// Front
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {0.0f, 0.447214f, 0.894427f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, -0.447214f}, {0.5f, 1.0f}},
+	// Right
+	{{0.5f, -0.5f, 0.5f}, {0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, -1.0f}, {-0.447214f, 0.894427f, 0.0f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, -0.5f}, {0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, -1.0f}, {-0.447214f, 0.894427f, 0.0f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, -1.0f}, {-0.447214f, 0.894427f, 0.0f}, {0.5f, 1.0f}},
+	// Back
+	{{0.5f, -0.5f, -0.5f}, {0.0f, 0.447214f, -0.894427f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, 0.447214f}, {0.0f, 0.0f}},
+	{{-0.5f, -0.5f, -0.5f}, {0.0f, 0.447214f, -0.894427f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, 0.447214f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {0.0f, 0.447214f, -0.894427f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.894427f, 0.447214f}, {0.5f, 1.0f}},
+	// Left
+	{{-0.5f, -0.5f, -0.5f}, {-0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.447214f, 0.894427f, 0.0f}, {0.0f, 0.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {-0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.447214f, 0.894427f, 0.0f}, {1.0f, 0.0f}},
+	{{0.0f, 0.5f, 0.0f}, {-0.894427f, 0.447214f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.447214f, 0.894427f, 0.0f}, {0.5f, 1.0f}},
+	// Bottom
+	{{-0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+	{{0.5f, -0.5f, -0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+	{{-0.5f, -0.5f, 0.5f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+
+};
+
+constexpr uint16_t pyramid_indices[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 12, 14, 15 };
+
+enum primitive_type { box_primitive, tetrahedron_primitive, pyramid_primitive };
+
+// Uploads a primitive table as indexed geometry with the buffers geometry_builder provides
+template <size_t vertex_count, size_t index_count>
+graphics_framework::geometry upload_primitive(const primitive_vertex (&vertices)[vertex_count], const uint16_t (&indices)[index_count])
+{
+	using namespace glm;
+	std::vector<vec3> positions, normals, tangents, binormals;
+	std::vector<vec2> tex_coords;
+	for (auto &v : vertices)
+	{
+		positions.push_back(vec3(v.position[0], v.position[1], v.position[2]));
+		normals.push_back(vec3(v.normal[0], v.normal[1], v.normal[2]));
+		tangents.push_back(vec3(v.tangent[0], v.tangent[1], v.tangent[2]));
+		binormals.push_back(vec3(v.binormal[0], v.binormal[1], v.binormal[2]));
+		tex_coords.push_back(vec2(v.tex_coord[0], v.tex_coord[1]));
+	}
+	graphics_framework::geometry geom;
+	geom.set_type(GL_TRIANGLES);
+	geom.add_buffer(positions, graphics_framework::BUFFER_INDEXES::POSITION_BUFFER);
+	geom.add_buffer(normals, graphics_framework::BUFFER_INDEXES::NORMAL_BUFFER);
+	geom.add_buffer(binormals, graphics_framework::BUFFER_INDEXES::BINORMAL_BUFFER);
+	geom.add_buffer(tangents, graphics_framework::BUFFER_INDEXES::TANGENT_BUFFER);
+	geom.add_buffer(tex_coords, graphics_framework::BUFFER_INDEXES::TEXTURE_COORDS_0);
+	geom.add_index_buffer(std::vector<GLuint>(std::begin(indices), std::end(indices)));
+	return geom;
+}
+
+// Shared unit geometry for the fixed primitives.  Each type is uploaded the
+// first time it is asked for, and meshes copy the geometry's buffer handles, so
+// every box in the scene draws from one set of buffers whatever its size
+inline graphics_framework::geometry &get_primitive(primitive_type type)
+{
+	static graphics_framework::geometry cache[3];
+	static bool loaded[3] = { false, false, false };
+	if (!loaded[type])
+	{
+		switch (type)
+		{
+		case box_primitive:
+			cache[type] = upload_primitive(box_vertices, box_indices);
+			break;
+		case tetrahedron_primitive:
+			cache[type] = upload_primitive(tetrahedron_vertices, tetrahedron_indices);
+			break;
+		case pyramid_primitive:
+			cache[type] = upload_primitive(pyramid_vertices, pyramid_indices);
+			break;
+		}
+		loaded[type] = true;
+	}
+	return cache[type];
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
+#include <graphics_framework.h>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include "../../practicals/35_Geometry_Builder/vertex_layout.h"
+
+// Most objects one batched pass can draw, each picked out by its base instance
+const GLuint MAX_BATCH_OBJECTS = 4096;
+// Attribute carrying the object index into the vertex shader
+const GLuint OBJECT_INDEX_ATTRIBUTE = 15;
+
+// Layout glMultiDrawElementsIndirect reads each draw from
+struct draw_elements_command
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	// Index of the object being drawn, read by the vertex shader through OBJECT_INDEX_ATTRIBUTE
+	GLuint base_instance;
+};
+
+namespace detail
+{
+	// Reads an attribute of the bound vertex array object as floats, whatever
+	// format compress_vertices and interleave_vertices left it in.  Empty if the
+	// attribute is disabled
+	inline std::vector<glm::vec4> read_attribute_values(GLuint index)
+	{
+		using namespace glm;
+		std::vector<vec4> values;
+		vertex_attribute attribute;
+		if (!read_attribute_format(index, attribute))
+			return values;
+		GLint bytes = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+		std::vector<uint8_t> data(bytes);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		auto stride = attribute.stride != 0 ? attribute.stride : attribute.size;
+		for (size_t at = attribute.offset; at + attribute.size <= data.size(); at += stride)
+		{
+			vec4 v(0.0f, 0.0f, 0.0f, 1.0f);
+			auto p = &data[at];
+			switch (attribute.type)
+			{
+			case GL_FLOAT:
+				for (GLint c = 0; c < attribute.components; c++)
+					v[c] = reinterpret_cast<const float*>(p)[c];
+				break;
+			case GL_HALF_FLOAT:
+				for (GLint c = 0; c < attribute.components; c++)
+					v[c] = unpackHalf1x16(reinterpret_cast<const uint16_t*>(p)[c]);
+				break;
+			case GL_INT_2_10_10_10_REV:
+				v = unpackSnorm3x10_1x2(*reinterpret_cast<const uint32_t*>(p));
+				break;
+			case GL_UNSIGNED_BYTE:
+				for (GLint c = 0; c < attribute.components; c++)
+					v[c] = attribute.normalized ? p[c] / 255.0f : p[c];
+				break;
+			default:
+				std::cerr << "ERROR - scene batch: unsupported vertex format " << attribute.type << std::endl;
+				throw std::runtime_error("Unsupported vertex format");
+			}
+			values.push_back(v);
+		}
+		return values;
+	}
+}
+
+// Shared vertex and index arenas holding every static geometry of a scene, so
+// a whole pass can be drawn with one glMultiDrawElementsIndirect.  Vertices are
+// stored as a position stream, float so large meshes keep their precision, and
+// an interleaved stream of 10:10:10:2 normal, tangent with the binormal
+// direction in w, and float texture coordinates.  Geometry is read back from
+// its own buffers once as it is added.  Copies of a geometry share its buffers,
+// and share one place in the arenas
+class scene_batch
+{
+public:
+	// Where a geometry's vertices and indices landed in the arenas
+	struct geometry_range
+	{
+		GLint base_vertex;
+		GLuint first_index;
+		// Every index of the geometry, including levels of detail after the first
+		GLuint index_count;
+	};
+
+	scene_batch() = default;
+	scene_batch(const scene_batch&) = delete;
+	scene_batch &operator=(const scene_batch&) = delete;
+
+	// Copies a geometry into the arenas, or finds where it already is
+	const geometry_range &add_geometry(const graphics_framework::geometry &geom)
+	{
+		using namespace glm;
+		using namespace graphics_framework;
+		auto found = _ranges.find(geom.get_array_object());
+		if (found != _ranges.end())
+			return found->second;
+
+		glBindVertexArray(geom.get_array_object());
+		auto positions = detail::read_attribute_values(BUFFER_INDEXES::POSITION_BUFFER);
+		auto normals = detail::read_attribute_values(BUFFER_INDEXES::NORMAL_BUFFER);
+		auto binormals = detail::read_attribute_values(BUFFER_INDEXES::BINORMAL_BUFFER);
+		auto tangents = detail::read_attribute_values(BUFFER_INDEXES::TANGENT_BUFFER);
+		auto tex_coords = detail::read_attribute_values(BUFFER_INDEXES::TEXTURE_COORDS_0);
+		// The whole element buffer, which holds every level of a loaded model
+		std::vector<GLuint> indices;
+		GLint index_buffer = 0;
+		glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &index_buffer);
+		if (index_buffer != 0)
+		{
+			GLint bytes = 0;
+			glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+			indices.resize(bytes / sizeof(GLuint));
+			glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, bytes, indices.data());
+		}
+		else
+		{
+			for (GLuint i = 0; i < positions.size(); i++)
+				indices.push_back(i);
+		}
+		glBindVertexArray(0);
+		indices = triangle_list(geom.get_type(), indices);
+
+		geometry_range range;
+		range.base_vertex = static_cast<GLint>(_positions.size());
+		range.first_index = static_cast<GLuint>(_indices.size());
+		range.index_count = static_cast<GLuint>(indices.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			_positions.push_back(vec3(positions[i]));
+			vertex v;
+			auto n = i < normals.size() ? vec3(normals[i]) : vec3(0.0f);
+			auto t = i < tangents.size() ? tangents[i] : vec4(0.0f);
+			// The binormal's direction, unless it was already packed into the tangent's w
+			auto sign = t.w < 0.0f ? -1.0f : 1.0f;
+			if (i < binormals.size())
+				sign = dot(cross(n, vec3(t)), vec3(binormals[i])) < 0.0f ? -1.0f : 1.0f;
+			v.normal = packSnorm3x10_1x2(vec4(n, 0.0f));
+			v.tangent = packSnorm3x10_1x2(vec4(vec3(t), sign));
+			v.tex_coord = i < tex_coords.size() ? vec2(tex_coords[i]) : vec2(0.0f);
+			_vertices.push_back(v);
+		}
+		_indices.insert(_indices.end(), indices.begin(), indices.end());
+		_dirty = true;
+		return _ranges[geom.get_array_object()] = range;
+	}
+
+	// Uploads the arenas if anything was added since the last time
+	void build()
+	{
+		using namespace graphics_framework;
+		if (!_dirty)
+			return;
+		_dirty = false;
+		if (_array_object == 0)
+		{
+			glGenVertexArrays(1, &_array_object);
+			glGenVertexArrays(1, &_position_array);
+			glGenBuffers(4, _buffers);
+			// Object i reads index i, so a command's base instance picks out its object
+			std::vector<GLuint> ids(MAX_BATCH_OBJECTS);
+			for (GLuint i = 0; i < MAX_BATCH_OBJECTS; i++)
+				ids[i] = i;
+			glBindBuffer(GL_ARRAY_BUFFER, _buffers[OBJECT_IDS]);
+			glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, _buffers[POSITIONS]);
+		glBufferData(GL_ARRAY_BUFFER, _positions.size() * sizeof(glm::vec3), _positions.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, _buffers[VERTICES]);
+		glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(vertex), _vertices.data(), GL_STATIC_DRAW);
+
+		for (auto vao : { _array_object, _position_array })
+		{
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, _buffers[POSITIONS]);
+			glVertexAttribPointer(BUFFER_INDEXES::POSITION_BUFFER, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+			glEnableVertexAttribArray(BUFFER_INDEXES::POSITION_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, _buffers[OBJECT_IDS]);
+			glVertexAttribIPointer(OBJECT_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, nullptr);
+			glVertexAttribDivisor(OBJECT_INDEX_ATTRIBUTE, 1);
+			glEnableVertexAttribArray(OBJECT_INDEX_ATTRIBUTE);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers[INDICES]);
+		}
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(GLuint), _indices.data(), GL_STATIC_DRAW);
+
+		// Everything else only in the full array, the binormal left disabled so shaders rebuild it
+		glBindVertexArray(_array_object);
+		glBindBuffer(GL_ARRAY_BUFFER, _buffers[VERTICES]);
+		glVertexAttribPointer(BUFFER_INDEXES::NORMAL_BUFFER, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, normal)));
+		glEnableVertexAttribArray(BUFFER_INDEXES::NORMAL_BUFFER);
+		glVertexAttribPointer(BUFFER_INDEXES::TANGENT_BUFFER, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, tangent)));
+		glEnableVertexAttribArray(BUFFER_INDEXES::TANGENT_BUFFER);
+		glVertexAttribPointer(BUFFER_INDEXES::TEXTURE_COORDS_0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, tex_coord)));
+		glEnableVertexAttribArray(BUFFER_INDEXES::TEXTURE_COORDS_0);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		std::cout << "Scene batch: " << _ranges.size() << " geometries, " << _positions.size() << " vertices, " << _indices.size() / 3 << " triangles" << std::endl;
+	}
+
+	// Draws count commands from the indirect buffer bound to GL_DRAW_INDIRECT_BUFFER,
+	// starting offset bytes in.  Depth only passes can read just the position stream
+	void draw(GLintptr offset, GLsizei count, bool positions_only = false) const
+	{
+		if (count == 0)
+			return;
+		glBindVertexArray(positions_only ? _position_array : _array_object);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset), count, sizeof(draw_elements_command));
+		glBindVertexArray(0);
+	}
+
+private:
+	struct vertex
+	{
+		uint32_t normal;
+		uint32_t tangent;
+		glm::vec2 tex_coord;
+	};
+
+	enum buffer_index { POSITIONS, VERTICES, INDICES, OBJECT_IDS };
+
+	// Turns strips and fans into plain triangles, the only type one multi draw can mix
+	static std::vector<GLuint> triangle_list(GLenum type, const std::vector<GLuint> &indices)
+	{
+		std::vector<GLuint> result;
+		switch (type)
+		{
+		case GL_TRIANGLES:
+			return indices;
+		case GL_TRIANGLE_STRIP:
+			for (size_t i = 2; i < indices.size(); i++)
+			{
+				// Every other triangle is wound the other way
+				if (i % 2 == 0)
+					result.insert(result.end(), { indices[i - 2], indices[i - 1], indices[i] });
+				else
+					result.insert(result.end(), { indices[i - 1], indices[i - 2], indices[i] });
+			}
+			return result;
+		case GL_TRIANGLE_FAN:
+			for (size_t i = 2; i < indices.size(); i++)
+				result.insert(result.end(), { indices[0], indices[i - 1], indices[i] });
+			return result;
+		default:
+			std::cerr << "ERROR - scene batch: only triangles can be batched" << std::endl;
+			throw std::runtime_error("Geometry type can't be batched");
+		}
+	}
+
+	std::vector<glm::vec3> _positions;
+	std::vector<vertex> _vertices;
+	std::vector<GLuint> _indices;
+	// Keyed by each geometry's vertex array object, which its copies share
+	std::map<GLuint, geometry_range> _ranges;
+	bool _dirty = false;
+	GLuint _array_object = 0;
+	GLuint _position_array = 0;
+	GLuint _buffers[4];
+};
@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../22_Sierpinski_Gasket/task_scheduler.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -11,33 +12,41 @@ target_camera cam;
 
 const int num_points = 50000;
 
+// Points generated by each task.  Every chunk runs its own chain from the first point
+const int chunk_size = 4096;
+
 void create_sierpinski(geometry &geom) {
-  vector<vec3> points;
-  vector<vec4> colours;
+  vector<vec3> points(num_points);
+  // All points red
+  vector<vec4> colours(num_points, vec4(1.0f, 0.0f, 0.0f, 1.0f));
   // Three corners of the triangle
   array<vec3, 3> v = {vec3(-1.0f, -1.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(1.0f, -1.0f, 0.0f)};
-  // Create random engine - generates random numbers
-  default_random_engine e;
-  // Create a distribution.  3 points in array so want 0-2
-  uniform_int_distribution<int> dist(0, 2);
-  // Add first point to the geometry
-  points.push_back(vec3(0.25f, 0.5f, 0.0f));
-  // Add first colour to the geometry
-  colours.push_back(vec4(1.0f, 0.0f, 0.0f, 1.0f));
-  // Add random points using distribution
-  for (auto i = 1; i < num_points; ++i) {
-    // *********************************
-    // Add random point
-
-    // Add colour - all points red
-
-    // *********************************
+  // Add first point to the geometry.  It lies on the gasket, so every chain
+  // started from it stays on the gasket
+  points[0] = vec3(0.25f, 0.5f, 0.0f);
+  // Chunks write to their own range of points, so no locking is needed
+  task_scheduler scheduler;
+  task_group group(scheduler);
+  for (auto begin = 1; begin < num_points; begin += chunk_size) {
+    group.run([&, begin] {
+      // Create random engine - generates random numbers.  Seeded per chunk so chains differ
+      default_random_engine e(begin);
+      // Create a distribution.  3 points in array so want 0-2
+      uniform_int_distribution<int> dist(0, 2);
+      auto previous = points[0];
+      auto end = std::min(begin + chunk_size, num_points);
+      // Add random points using distribution
+      for (auto i = begin; i < end; ++i) {
+        // Add random point - halfway to a random corner
+        points[i] = (previous + v[dist(e)]) / 2.0f;
+        previous = points[i];
+      }
+    });
   }
-  // *********************************
+  group.wait();
   // Add buffers to geometry
-
-
-  // *********************************
+  geom.add_buffer(points, BUFFER_INDEXES::POSITION_BUFFER);
+  geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
 }
 
 bool load_content() {
@@ -1,49 +1,34 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "indexed_subdivision.h"
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
-geometry geom;
+indexed_geometry geom;
 effect eff;
 target_camera cam;
 
-// Helper method - adds a triangle to geometry
-void triangle(const vector<vec3> &points, vector<vec3> &positions, vector<vec4> &colours) {
-  positions.insert(positions.end(), points.begin(), points.end());
-  for (auto i = 0; i < 3; ++i){
-    colours.push_back(vec4(1.0f, 0.0f, 0.0f, 1.0f));
-  }
-
-}
-
-void divide_triangle(const vector<vec3> &points, unsigned int count, vector<vec3> &positions, vector<vec4> &colours) {
-  // *********************************
-  // IF we have more divisions to do?
-
-    // Calculate new vertices to work on
-
-    // Divide new triangles
-
-
-
-
-
-
-
-  // *********************************
-}
+// Levels of subdivision
+const unsigned int depth = 4;
 
 bool load_content() {
-  // Required buffers
-  vector<vec3> positions;
-  vector<vec4> colours;
-  divide_triangle({vec3(1.0f, -1.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(-1.0f, -1.0f, 0.0f)}, 4, positions, colours);
+  // Build the gasket with every shared corner stored once, deep levels split across threads
+  task_scheduler scheduler;
+  auto start = chrono::high_resolution_clock::now();
+  auto gasket = create_gasket({vec3(1.0f, -1.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(-1.0f, -1.0f, 0.0f)}, depth,
+                              &scheduler);
+  auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+  cout << "Gasket depth " << depth << ": " << gasket.positions.size() << " vertices, " << gasket.index_count() / 3
+       << " triangles, " << (gasket.is_16_bit() ? 16 : 32) << " bit indices, " << gasket.memory_size() / 1024
+       << " KB in " << elapsed << " us on " << scheduler.get_thread_count() << " threads" << endl;
+
+  // All red
+  vector<vec4> colours(gasket.positions.size(), vec4(1.0f, 0.0f, 0.0f, 1.0f));
 
   // Add to the geometry
-  geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-  geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
+  geom = upload_triangles(gasket, colours);
 
   // Load in shaders
   eff.add_shader("shaders/basic.vert", GL_VERTEX_SHADER);
@@ -76,7 +61,7 @@ bool render() {
   // Set MVP matrix uniform
   glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
   // Render geometry
-  renderer::render(geom);
+  render_triangles(geom);
   return true;
 }
 
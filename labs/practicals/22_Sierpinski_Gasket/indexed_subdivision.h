@@ -0,0 +1,333 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <graphics_framework.h>
+#include <limits>
+#include "task_scheduler.h"
+#include <unordered_map>
+#include <vector>
+
+// Indexed triangles built by the subdivision generators.  Every vertex is
+// stored once, and the indices are 16 bit whenever the vertex count allows it.
+struct indexed_triangles {
+  std::vector<glm::vec3> positions;
+  // Only one of these is filled
+  std::vector<uint16_t> indices_16;
+  std::vector<uint32_t> indices_32;
+
+  bool is_16_bit() const { return !indices_16.empty(); }
+  size_t index_count() const { return is_16_bit() ? indices_16.size() : indices_32.size(); }
+  // Bytes used by the vertex positions and indices
+  size_t memory_size() const {
+    return positions.size() * sizeof(glm::vec3) + indices_16.size() * sizeof(uint16_t) +
+           indices_32.size() * sizeof(uint32_t);
+  }
+};
+
+// Vertices and triangles in a Sierpinski gasket of the given depth.  Every level
+// adds three midpoints per triangle and keeps three of the four new triangles
+inline size_t gasket_vertex_count(unsigned int depth) {
+  size_t triangles = 1, vertices = 3;
+  for (unsigned int i = 0; i < depth; ++i) {
+    vertices += 3 * triangles;
+    triangles *= 3;
+  }
+  return vertices;
+}
+
+inline size_t gasket_triangle_count(unsigned int depth) {
+  size_t triangles = 1;
+  for (unsigned int i = 0; i < depth; ++i) {
+    triangles *= 3;
+  }
+  return triangles;
+}
+
+// Vertices in a closed triangle mesh after depth levels of 4 way subdivision.
+// Every level adds a vertex per edge, doubles the edges and adds three per face
+inline size_t subdivided_vertex_count(size_t vertices, size_t faces, unsigned int depth) {
+  size_t edges = faces * 3 / 2;
+  for (unsigned int i = 0; i < depth; ++i) {
+    vertices += edges;
+    edges = edges * 2 + faces * 3;
+    faces *= 4;
+  }
+  return vertices;
+}
+
+inline size_t subdivided_triangle_count(size_t faces, unsigned int depth) {
+  for (unsigned int i = 0; i < depth; ++i) {
+    faces *= 4;
+  }
+  return faces;
+}
+
+// Subtrees with more leaf triangles than this are split into tasks
+const size_t SUBDIVISION_GRAIN = 4096;
+
+namespace detail {
+// Sierpinski gasket subtree writing its new vertices from first_vertex and its
+// triangles from first_index.  Both ranges are known from the depth alone, so
+// subtrees can run in any order, or in parallel, and give the same output
+template <typename Index>
+void divide_gasket(uint32_t a, uint32_t b, uint32_t c, unsigned int depth, size_t first_vertex, size_t first_index,
+                   glm::vec3 *positions, Index *indices, task_scheduler *scheduler) {
+  if (depth == 0) {
+    indices[first_index] = static_cast<Index>(a);
+    indices[first_index + 1] = static_cast<Index>(b);
+    indices[first_index + 2] = static_cast<Index>(c);
+    return;
+  }
+  // Midpoints belong to this triangle only, neighbours share just the corners
+  auto ab = static_cast<uint32_t>(first_vertex), bc = ab + 1, ca = ab + 2;
+  positions[ab] = (positions[a] + positions[b]) * 0.5f;
+  positions[bc] = (positions[b] + positions[c]) * 0.5f;
+  positions[ca] = (positions[c] + positions[a]) * 0.5f;
+
+  const size_t child_vertices = gasket_vertex_count(depth - 1) - 3;
+  const size_t child_indices = gasket_triangle_count(depth - 1) * 3;
+  const std::array<uint32_t, 9> children{{a, ab, ca, ab, b, bc, ca, bc, c}};
+  auto divide_child = [=](size_t i) {
+    divide_gasket(children[i * 3], children[i * 3 + 1], children[i * 3 + 2], depth - 1,
+                  first_vertex + 3 + i * child_vertices, first_index + i * child_indices, positions, indices,
+                  scheduler);
+  };
+  if (scheduler != nullptr && gasket_triangle_count(depth) > SUBDIVISION_GRAIN) {
+    task_group group(*scheduler);
+    for (size_t i = 0; i < 3; ++i) {
+      group.run([=] { divide_child(i); });
+    }
+    group.wait();
+  } else {
+    for (size_t i = 0; i < 3; ++i) {
+      divide_child(i);
+    }
+  }
+}
+
+// Numbers every vertex of a subdivided closed mesh from where it lies on the
+// base mesh, so the two triangles sharing an edge agree on its midpoint without
+// looking anything up.  A vertex of base face f is given by integer weights
+// (i, j, k) on the face's corners, summing to 2^depth.  Vertices are ordered:
+// base vertices, then vertices inside each base edge, then inside each base face
+struct lattice_numbering {
+  size_t base_vertices;
+  // Base edges, keyed by their lower then higher vertex index
+  std::unordered_map<uint64_t, uint32_t> edges;
+  const std::vector<std::array<uint32_t, 3>> *faces;
+  uint32_t n;
+
+  static uint64_t edge_key(uint32_t a, uint32_t b) {
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+  }
+
+  lattice_numbering(size_t vertex_count, const std::vector<std::array<uint32_t, 3>> &base_faces, unsigned int depth)
+      : base_vertices(vertex_count), faces(&base_faces), n(1u << depth) {
+    for (auto &f : base_faces) {
+      for (size_t e = 0; e < 3; ++e) {
+        edges.emplace(edge_key(f[e], f[(e + 1) % 3]), static_cast<uint32_t>(edges.size()));
+      }
+    }
+  }
+
+  size_t vertex_count() const {
+    return base_vertices + edges.size() * (n - 1) + faces->size() * (n - 1) * (n - 2) / 2;
+  }
+
+  uint32_t on_edge(uint32_t p, uint32_t q, uint32_t wp, uint32_t wq) const {
+    // Count along the edge from its lower vertex
+    auto e = edges.find(edge_key(p, q))->second;
+    auto step = p > q ? wp : wq;
+    return static_cast<uint32_t>(base_vertices + e * (n - 1) + step - 1);
+  }
+
+  uint32_t operator()(size_t face, uint32_t i, uint32_t j, uint32_t k) const {
+    const auto &f = (*faces)[face];
+    if (j == 0 && k == 0) {
+      return f[0];
+    }
+    if (i == 0 && k == 0) {
+      return f[1];
+    }
+    if (i == 0 && j == 0) {
+      return f[2];
+    }
+    if (k == 0) {
+      return on_edge(f[0], f[1], i, j);
+    }
+    if (i == 0) {
+      return on_edge(f[1], f[2], j, k);
+    }
+    if (j == 0) {
+      return on_edge(f[2], f[0], k, i);
+    }
+    // Rows of constant j, each one shorter than the last
+    const size_t row_start = (j - 1) * (n - 1) - (j - 1) * j / 2;
+    return static_cast<uint32_t>(base_vertices + edges.size() * (n - 1) + face * (n - 1) * (n - 2) / 2 + row_start +
+                                 k - 1);
+  }
+};
+
+// A subdivided triangle corner - lattice weights, index and position
+struct lattice_corner {
+  std::array<uint32_t, 3> weights;
+  uint32_t index;
+  glm::vec3 position;
+};
+
+inline lattice_corner sphere_midpoint(const lattice_corner &a, const lattice_corner &b, size_t face,
+                                      const lattice_numbering &numbering, glm::vec3 *positions) {
+  lattice_corner m;
+  for (size_t i = 0; i < 3; ++i) {
+    m.weights[i] = (a.weights[i] + b.weights[i]) / 2;
+  }
+  m.index = numbering(face, m.weights[0], m.weights[1], m.weights[2]);
+  m.position = glm::normalize(a.position + b.position);
+  // Both triangles on an edge compute the midpoint, but with consistent winding
+  // only one of them walks it from its lower index, and that one stores it
+  if (a.index < b.index) {
+    positions[m.index] = m.position;
+  }
+  return m;
+}
+
+template <typename Index>
+void divide_sphere(const lattice_corner &a, const lattice_corner &b, const lattice_corner &c, size_t face,
+                   unsigned int depth, size_t first_index, const lattice_numbering &numbering, glm::vec3 *positions,
+                   Index *indices, task_scheduler *scheduler) {
+  if (depth == 0) {
+    indices[first_index] = static_cast<Index>(a.index);
+    indices[first_index + 1] = static_cast<Index>(b.index);
+    indices[first_index + 2] = static_cast<Index>(c.index);
+    return;
+  }
+  auto ab = sphere_midpoint(a, b, face, numbering, positions);
+  auto bc = sphere_midpoint(b, c, face, numbering, positions);
+  auto ca = sphere_midpoint(c, a, face, numbering, positions);
+
+  const size_t child_indices = subdivided_triangle_count(1, depth - 1) * 3;
+  const std::array<lattice_corner, 12> children{{a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca}};
+  auto divide_child = [&](size_t i) {
+    divide_sphere(children[i * 3], children[i * 3 + 1], children[i * 3 + 2], face, depth - 1,
+                  first_index + i * child_indices, numbering, positions, indices, scheduler);
+  };
+  if (scheduler != nullptr && subdivided_triangle_count(1, depth) > SUBDIVISION_GRAIN) {
+    task_group group(*scheduler);
+    for (size_t i = 0; i < 4; ++i) {
+      group.run([&divide_child, i] { divide_child(i); });
+    }
+    group.wait();
+  } else {
+    for (size_t i = 0; i < 4; ++i) {
+      divide_child(i);
+    }
+  }
+}
+
+template <typename Index>
+void build_sphere(const std::vector<std::array<uint32_t, 3>> &faces, unsigned int depth,
+                  const lattice_numbering &numbering, glm::vec3 *positions, std::vector<Index> &indices,
+                  task_scheduler *scheduler) {
+  const uint32_t n = numbering.n;
+  const size_t face_indices = subdivided_triangle_count(1, depth) * 3;
+  auto divide_face = [&](size_t f) {
+    lattice_corner a{{{n, 0, 0}}, faces[f][0], positions[faces[f][0]]};
+    lattice_corner b{{{0, n, 0}}, faces[f][1], positions[faces[f][1]]};
+    lattice_corner c{{{0, 0, n}}, faces[f][2], positions[faces[f][2]]};
+    divide_sphere(a, b, c, f, depth, f * face_indices, numbering, positions, indices.data(), scheduler);
+  };
+  if (scheduler != nullptr) {
+    task_group group(*scheduler);
+    for (size_t f = 0; f < faces.size(); ++f) {
+      group.run([&divide_face, f] { divide_face(f); });
+    }
+    group.wait();
+  } else {
+    for (size_t f = 0; f < faces.size(); ++f) {
+      divide_face(f);
+    }
+  }
+}
+}
+
+// Builds a Sierpinski gasket from a triangle.  Deep gaskets are split into
+// tasks when a scheduler is given
+inline indexed_triangles create_gasket(const std::array<glm::vec3, 3> &corners, unsigned int depth,
+                                       task_scheduler *scheduler = nullptr) {
+  indexed_triangles result;
+  const size_t vertex_count = gasket_vertex_count(depth);
+  const size_t index_count = gasket_triangle_count(depth) * 3;
+  result.positions.resize(vertex_count);
+  std::copy(corners.begin(), corners.end(), result.positions.begin());
+  if (vertex_count <= std::numeric_limits<uint16_t>::max()) {
+    result.indices_16.resize(index_count);
+    detail::divide_gasket(0, 1, 2, depth, 3, 0, result.positions.data(), result.indices_16.data(), scheduler);
+  } else {
+    result.indices_32.resize(index_count);
+    detail::divide_gasket(0, 1, 2, depth, 3, 0, result.positions.data(), result.indices_32.data(), scheduler);
+  }
+  return result;
+}
+
+// Builds a sphere by subdividing a closed, consistently wound triangle mesh
+// around the origin and pushing every new vertex onto the unit sphere.  Shared
+// edges get one midpoint.  Deep spheres are split into tasks when a scheduler is given
+inline indexed_triangles create_subdivided_sphere(const std::vector<glm::vec3> &vertices,
+                                                  const std::vector<std::array<uint32_t, 3>> &faces,
+                                                  unsigned int depth, task_scheduler *scheduler = nullptr) {
+  indexed_triangles result;
+  detail::lattice_numbering numbering(vertices.size(), faces, depth);
+  const size_t index_count = subdivided_triangle_count(faces.size(), depth) * 3;
+  result.positions.resize(numbering.vertex_count());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    result.positions[i] = glm::normalize(vertices[i]);
+  }
+  if (result.positions.size() <= std::numeric_limits<uint16_t>::max()) {
+    result.indices_16.resize(index_count);
+    detail::build_sphere(faces, depth, numbering, result.positions.data(), result.indices_16, scheduler);
+  } else {
+    result.indices_32.resize(index_count);
+    detail::build_sphere(faces, depth, numbering, result.positions.data(), result.indices_32, scheduler);
+  }
+  return result;
+}
+
+// Indexed triangles uploaded to the GPU.  The framework's index buffers are
+// always 32 bit, so the element buffer is attached to the geometry's vertex array here
+struct indexed_geometry {
+  graphics_framework::geometry geom;
+  GLuint index_buffer = 0;
+  GLenum index_type = GL_UNSIGNED_INT;
+  GLsizei index_count = 0;
+};
+
+// Uploads the triangles with one colour per vertex, or positions only if colours is empty
+inline indexed_geometry upload_triangles(const indexed_triangles &triangles, const std::vector<glm::vec4> &colours) {
+  using namespace graphics_framework;
+  indexed_geometry result;
+  result.geom.add_buffer(triangles.positions, BUFFER_INDEXES::POSITION_BUFFER);
+  if (!colours.empty()) {
+    result.geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
+  }
+  result.index_type = triangles.is_16_bit() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  result.index_count = static_cast<GLsizei>(triangles.index_count());
+  glBindVertexArray(result.geom.get_array_object());
+  glGenBuffers(1, &result.index_buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.index_buffer);
+  if (triangles.is_16_bit()) {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.indices_16.size() * sizeof(uint16_t), triangles.indices_16.data(),
+                 GL_STATIC_DRAW);
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.indices_32.size() * sizeof(uint32_t), triangles.indices_32.data(),
+                 GL_STATIC_DRAW);
+  }
+  glBindVertexArray(0);
+  return result;
+}
+
+inline void render_triangles(const indexed_geometry &indexed) {
+  glBindVertexArray(indexed.geom.get_array_object());
+  glDrawElements(GL_TRIANGLES, indexed.index_count, indexed.index_type, nullptr);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class task_scheduler;
+
+// A set of tasks that can be waited on together.  Tasks may create their own
+// groups, so work can be split recursively.  Waiting runs other tasks rather
+// than blocking, so nested waits never starve the pool.
+class task_group {
+public:
+  explicit task_group(task_scheduler &scheduler) : _scheduler(scheduler), _pending(0) {}
+  ~task_group() { wait(); }
+  task_group(const task_group &) = delete;
+  task_group &operator=(const task_group &) = delete;
+
+  // Queues func on the calling thread's deque, where any idle thread can steal it
+  void run(std::function<void()> func);
+  // Returns once every task in the group has finished
+  void wait();
+
+private:
+  friend class task_scheduler;
+  task_scheduler &_scheduler;
+  std::atomic<int> _pending;
+};
+
+// Work-stealing thread pool.  Every thread owns a deque: it pushes and pops its
+// own tasks at the back, depth first, while idle threads steal the oldest, and
+// so largest, tasks from the front of someone else's.  The thread that creates
+// the scheduler takes part whenever it waits on a group.
+class task_scheduler {
+public:
+  // Creates a pool - zero threads means one per hardware thread, including the caller
+  explicit task_scheduler(unsigned int threads = 0) : _queued(0), _quit(false) {
+    if (threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned int i = 0; i < threads; ++i) {
+      _queues.push_back(std::unique_ptr<task_queue>(new task_queue));
+    }
+    // Deque 0 belongs to the creating thread
+    for (unsigned int i = 1; i < threads; ++i) {
+      _threads.push_back(std::thread(&task_scheduler::worker_loop, this, i));
+    }
+  }
+
+  ~task_scheduler() {
+    {
+      std::lock_guard<std::mutex> lock(_sleep_mutex);
+      _quit = true;
+    }
+    _wake.notify_all();
+    for (auto &t : _threads) {
+      t.join();
+    }
+  }
+
+  task_scheduler(const task_scheduler &) = delete;
+  task_scheduler &operator=(const task_scheduler &) = delete;
+
+  // Number of threads running tasks, including the creating thread
+  unsigned int get_thread_count() const { return static_cast<unsigned int>(_queues.size()); }
+
+private:
+  friend class task_group;
+
+  struct task {
+    std::function<void()> func;
+    task_group *group;
+  };
+
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  // Deque of the calling thread - worker threads record theirs when they start
+  static unsigned int &current_queue() {
+    static thread_local unsigned int index = 0;
+    return index;
+  }
+
+  void push(task t) {
+    auto &queue = *_queues[current_queue()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(t));
+    }
+    ++_queued;
+    // Taking the lock orders the count against a worker about to sleep
+    { std::lock_guard<std::mutex> lock(_sleep_mutex); }
+    _wake.notify_one();
+  }
+
+  // Runs one task from the calling thread's deque, or stolen from another.
+  // Returns false if every deque was empty
+  bool run_one() {
+    const unsigned int self = current_queue();
+    task t;
+    bool found = false;
+    {
+      auto &queue = *_queues[self];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        t = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        found = true;
+      }
+    }
+    for (size_t i = 1; !found && i < _queues.size(); ++i) {
+      auto &queue = *_queues[(self + i) % _queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        t = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    --_queued;
+    t.func();
+    --t.group->_pending;
+    return true;
+  }
+
+  void worker_loop(unsigned int index) {
+    current_queue() = index;
+    while (true) {
+      if (run_one()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(_sleep_mutex);
+      _wake.wait(lock, [this] { return _quit || _queued > 0; });
+      if (_quit) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<task_queue>> _queues;
+  std::vector<std::thread> _threads;
+  // Tasks sitting in any deque, so idle workers know whether to sleep
+  std::atomic<int> _queued;
+  std::mutex _sleep_mutex;
+  std::condition_variable _wake;
+  bool _quit;
+};
+
+inline void task_group::run(std::function<void()> func) {
+  ++_pending;
+  _scheduler.push(task_scheduler::task{std::move(func), this});
+}
+
+inline void task_group::wait() {
+  while (_pending > 0) {
+    if (!_scheduler.run_one()) {
+      std::this_thread::yield();
+    }
+  }
+}
@@ -1,11 +1,13 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../22_Sierpinski_Gasket/indexed_subdivision.h"
+#include "sphere_patches.h"
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
-geometry geom;
+indexed_geometry geom;
 effect eff;
 target_camera cam;
 float theta = 0.0f;
@@ -13,46 +15,43 @@ float rho = 0.0f;
 
 const int subdivisions = 5;
 
-void divide_triangle(const vector<vec3> &points, int divisions, vector<vec3> &positions, vector<vec4> &colours) {
-  // IF we have more divisions to do?
-  if (divisions > 0) {
-    // *********************************
-    // Calculate new vertices to work on (Normalize each element!)
-
-
-    // Divide new triangles
-
-
-
-
-    // *********************************
-  } else {
-    positions.insert(positions.end(), points.begin(), points.end());
-    for (auto i = 0; i < 3; ++i) {
-      colours.push_back(vec4(0.6f, i % 2, i % 3, 1.0f));
-    }
-  }
-}
+// The same sphere refined on the GPU by its size on screen
+sphere_patches patches;
+effect patch_eff;
+// Toggles between the two spheres
+bool show_patches = true;
+bool toggle_held = false;
+// Camera distance from the sphere
+float distance_to_camera = 5.2f;
+// Counts the triangles the tessellator generates, reported once a second
+GLuint primitives_query;
+float report_time = 0.0f;
 
 bool load_content() {
-  // Required buffers
-  vector<vec3> positions;
-  vector<vec4> colours;
-  // Define the initial tetrahedron - 4 points
+  // Define the initial tetrahedron - 4 points and 4 faces
   vector<vec3> v{vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 0.942809f, -0.333333f), vec3(-0.816497f, -0.471405f, -0.333333f),
                  vec3(0.816497f, -0.471405f, 0.333333f)};
-  // Divide the triangles
-  divide_triangle({v[0], v[1], v[2]}, subdivisions, positions, colours);
-  divide_triangle({v[3], v[2], v[1]}, subdivisions, positions, colours);
-  divide_triangle({v[0], v[3], v[1]}, subdivisions, positions, colours);
-  divide_triangle({v[0], v[2], v[3]}, subdivisions, positions, colours);
-
-  // Use Line mode to see what this looks like in wireframe, Hint: It's Wack.
-  // geom.set_type(GL_LINES);
+  vector<array<uint32_t, 3>> faces{{{0, 1, 2}}, {{3, 2, 1}}, {{0, 3, 1}}, {{0, 2, 3}}};
+
+  // Divide the triangles, sharing the midpoint of every edge between its two triangles.
+  // Deep levels are split across threads
+  task_scheduler scheduler;
+  auto start = chrono::high_resolution_clock::now();
+  auto sphere = create_subdivided_sphere(v, faces, subdivisions, &scheduler);
+  auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+  cout << "Sphere depth " << subdivisions << ": " << sphere.positions.size() << " vertices, "
+       << sphere.index_count() / 3 << " triangles, " << (sphere.is_16_bit() ? 16 : 32) << " bit indices, "
+       << sphere.memory_size() / 1024 << " KB in " << elapsed << " us on " << scheduler.get_thread_count()
+       << " threads" << endl;
+
+  // Vertices are shared now, so colour them by index rather than by triangle corner
+  vector<vec4> colours(sphere.positions.size());
+  for (size_t i = 0; i < colours.size(); ++i) {
+    colours[i] = vec4(0.6f, static_cast<float>(i % 2), static_cast<float>(i % 3), 1.0f);
+  }
 
   // Add to the geometry
-  geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-  geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
+  geom = upload_triangles(sphere, colours);
 
   // Load in shaders
   eff.add_shader("shaders/basic.vert", GL_VERTEX_SHADER);
@@ -60,11 +59,19 @@ bool load_content() {
   // Build effect
   eff.build();
 
+  // Twenty patches, split further the closer the camera gets
+  patches = create_sphere_patches();
+  add_sphere_patch_shaders(patch_eff);
+  patch_eff.add_shader("23_Sphere_Subdivision/sphere_patch.frag", GL_FRAGMENT_SHADER);
+  patch_eff.build();
+  glGenQueries(1, &primitives_query);
+  cout << "Press T to switch between the subdivided and tessellated spheres, W and S to move the camera" << endl;
+
   // Set camera properties
-  cam.set_position(vec3(3.0f, 3.0f, 3.0f));
+  cam.set_position(normalize(vec3(1.0f)) * distance_to_camera);
   cam.set_target(vec3(0.0f, 0.0f, 0.0f));
   auto aspect = static_cast<float>(renderer::get_screen_width()) / static_cast<float>(renderer::get_screen_height());
-  cam.set_projection(quarter_pi<float>(), aspect, 2.414f, 1000.0f);
+  cam.set_projection(quarter_pi<float>(), aspect, 0.1f, 1000.0f);
   return true;
 }
 
@@ -81,23 +88,56 @@ bool update(float delta_time) {
   if (glfwGetKey(renderer::get_window(), GLFW_KEY_LEFT)) {
     rho += pi<float>() * delta_time;
   }
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_W)) {
+    distance_to_camera = std::max(distance_to_camera - 5.0f * delta_time, 1.1f);
+  }
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_S)) {
+    distance_to_camera = std::min(distance_to_camera + 5.0f * delta_time, 200.0f);
+  }
+  bool toggle = glfwGetKey(renderer::get_window(), GLFW_KEY_T) != 0;
+  if (toggle && !toggle_held) {
+    show_patches = !show_patches;
+  }
+  toggle_held = toggle;
+  cam.set_position(normalize(vec3(1.0f)) * distance_to_camera);
+
+  // Report how many triangles the tessellated sphere cost
+  report_time += delta_time;
+  if (show_patches && report_time > 1.0f) {
+    GLuint available = 0, triangles = 0;
+    glGetQueryObjectuiv(primitives_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      glGetQueryObjectuiv(primitives_query, GL_QUERY_RESULT, &triangles);
+      cout << "Tessellated sphere at distance " << distance_to_camera << ": " << triangles << " triangles" << endl;
+      report_time = 0.0f;
+    }
+  }
   // Update the camera
   cam.update(delta_time);
   return true;
 }
 
 bool render() {
-  // Bind effect
-  renderer::bind(eff);
-  // Create MVP matrix
   mat4 M = eulerAngleXZ(theta, rho);
   auto V = cam.get_view();
   auto P = cam.get_projection();
+
+  if (show_patches) {
+    renderer::bind(patch_eff);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, primitives_query);
+    render_sphere_patches(patch_eff, patches, M, V, P);
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    return true;
+  }
+
+  // Bind effect
+  renderer::bind(eff);
+  // Create MVP matrix
   auto MVP = P * V * M;
   // Set MVP matrix uniform
   glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
   // Render geometry
-  renderer::render(geom);
+  render_triangles(geom);
   return true;
 }
 
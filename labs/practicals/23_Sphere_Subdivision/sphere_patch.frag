@@ -0,0 +1,19 @@
+#version 440
+
+// Incoming world position and normal
+layout(location = 0) in vec3 vertex_position;
+layout(location = 1) in vec3 transformed_normal;
+// Position inside the icosahedron patch
+layout(location = 3) in vec3 patch_coord;
+
+layout(location = 0) out vec4 colour;
+
+void main() {
+  // Simple light from above and behind the camera
+  vec3 light_dir = normalize(vec3(1.0, 2.0, 1.5));
+  float diffuse = max(dot(normalize(transformed_normal), light_dir), 0.0);
+  colour = vec4(vec3(0.6, 0.3, 0.2) * (0.2 + 0.8 * diffuse), 1.0);
+  // Darken the edges of the original icosahedron faces
+  float edge = min(patch_coord.x, min(patch_coord.y, patch_coord.z));
+  colour.rgb *= mix(0.2, 1.0, smoothstep(0.0, 2.0 * fwidth(edge), edge));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <graphics_framework.h>
+#include "../22_Sierpinski_Gasket/indexed_subdivision.h"
+
+// Unit icosahedron - 12 vertices and 20 faces wound counter clockwise from
+// outside.  Closed and consistently wound, so it can also seed create_subdivided_sphere
+inline indexed_triangles create_icosahedron() {
+  // Corners of three golden rectangles, normalised onto the unit sphere
+  const float a = 0.525731112f;
+  const float b = 0.850650808f;
+  indexed_triangles result;
+  result.positions = {glm::vec3(-a, b, 0.0f),  glm::vec3(a, b, 0.0f),  glm::vec3(-a, -b, 0.0f), glm::vec3(a, -b, 0.0f),
+                      glm::vec3(0.0f, -a, b),  glm::vec3(0.0f, a, b),  glm::vec3(0.0f, -a, -b), glm::vec3(0.0f, a, -b),
+                      glm::vec3(b, 0.0f, -a),  glm::vec3(b, 0.0f, a),  glm::vec3(-b, 0.0f, -a), glm::vec3(-b, 0.0f, a)};
+  // Five faces around vertex 0 and the five next to them, then the same around vertex 3
+  result.indices_16 = {0, 11, 5,  0, 5, 1,  0, 1, 7,   0, 7, 10, 0, 10, 11,
+                       1, 5, 9,   5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                       3, 9, 4,   3, 4, 2,  3, 2, 6,   3, 6, 8,  3, 8, 9,
+                       4, 9, 5,   2, 4, 11, 6, 2, 10,  8, 6, 7,  9, 8, 1};
+  return result;
+}
+
+// A sphere drawn as 20 icosahedron patches and refined on the GPU.  The
+// tessellation control shader splits every edge by its projected size on
+// screen, so a distant sphere stays at 20 triangles and a close one gains
+// detail up to the hardware limit.  Edge factors only depend on the edge's two
+// end points, so neighbouring patches always agree and the surface never cracks.
+struct sphere_patches {
+  indexed_geometry geom;
+  // Target edge length on screen in pixels
+  float pixels_per_edge = 16.0f;
+  // Cap on the tessellation level of any edge, at most GL_MAX_TESS_GEN_LEVEL
+  float max_level = 64.0f;
+};
+
+inline sphere_patches create_sphere_patches() {
+  sphere_patches result;
+  result.geom = upload_triangles(create_icosahedron(), std::vector<glm::vec4>());
+  return result;
+}
+
+// Adds the vertex and tessellation stages to an effect.  The fragment shader
+// is left to the caller and receives the same outputs as the lit vertex
+// shaders: world position at location 0, world normal at 1, texture coordinate
+// at 2, plus the position inside the patch at 3 for showing the refinement
+inline void add_sphere_patch_shaders(graphics_framework::effect &eff) {
+  eff.add_shader("shaders/sphere_patch.vert", GL_VERTEX_SHADER);
+  eff.add_shader("shaders/sphere_patch.tesc", GL_TESS_CONTROL_SHADER);
+  eff.add_shader("shaders/sphere_patch.tese", GL_TESS_EVALUATION_SHADER);
+}
+
+// Sets the transform and tessellation uniforms and draws the patches.  The
+// effect must be bound.  M may scale the sphere to any radius
+inline void render_sphere_patches(graphics_framework::effect &eff, const sphere_patches &sphere, const glm::mat4 &M,
+                                  const glm::mat4 &V, const glm::mat4 &P) {
+  using namespace glm;
+  using namespace graphics_framework;
+  auto MV = V * M;
+  auto MVP = P * MV;
+  auto N = mat3(transpose(inverse(M)));
+  glUniformMatrix4fv(eff.get_uniform_location("M"), 1, GL_FALSE, value_ptr(M));
+  glUniformMatrix4fv(eff.get_uniform_location("MV"), 1, GL_FALSE, value_ptr(MV));
+  glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+  glUniformMatrix3fv(eff.get_uniform_location("N"), 1, GL_FALSE, value_ptr(N));
+  // Pixels covered by one unit at a distance of one unit
+  auto projection_scale = P[1][1] * 0.5f * static_cast<float>(renderer::get_screen_height());
+  glUniform1f(eff.get_uniform_location("projection_scale"), projection_scale);
+  glUniform1f(eff.get_uniform_location("pixels_per_edge"), sphere.pixels_per_edge);
+  glUniform1f(eff.get_uniform_location("max_level"), sphere.max_level);
+
+  glPatchParameteri(GL_PATCH_VERTICES, 3);
+  glBindVertexArray(sphere.geom.geom.get_array_object());
+  glDrawElements(GL_PATCHES, sphere.geom.index_count, sphere.geom.index_type, nullptr);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
+#include <graphics_framework.h>
+#include <vector>
+
+// Largest position error allowed for half floats, as a fraction of the bounding box diagonal
+const float POSITION_HALF_TOLERANCE = 1.0f / 2048.0f;
+// Largest texture coordinate error allowed for half floats - half a texel of a 1024 texture
+const float TEX_COORD_HALF_TOLERANCE = 1.0f / 2048.0f;
+// How far from unit length a normal or tangent may be and still be packed
+const float UNIT_VECTOR_TOLERANCE = 0.01f;
+
+// Memory used by the vertex buffers before and after packing
+struct vertex_compression_stats {
+  size_t bytes_before = 0;
+  size_t bytes_after = 0;
+};
+
+namespace detail {
+// Tightly packed float attribute read back from its buffer
+struct float_attribute {
+  GLuint buffer = 0;
+  GLint components = 0;
+  std::vector<float> data;
+
+  size_t count() const { return components > 0 ? data.size() / components : 0; }
+  glm::vec4 get(size_t i) const {
+    glm::vec4 v(0.0f, 0.0f, 0.0f, 1.0f);
+    for (GLint c = 0; c < components; ++c) {
+      v[c] = data[i * components + c];
+    }
+    return v;
+  }
+};
+
+// Reads an enabled attribute of the bound vertex array object.  Returns false
+// if it isn't a tightly packed float array from the start of its own buffer,
+// which includes attributes that were already packed
+inline bool read_float_attribute(GLuint index, float_attribute &attribute) {
+  GLint enabled = 0, type = 0, stride = 0, buffer = 0;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+  if (!enabled) {
+    return false;
+  }
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attribute.components);
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+  GLvoid *offset = nullptr;
+  glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &offset);
+  if (type != GL_FLOAT || buffer == 0 || offset != nullptr ||
+      (stride != 0 && stride != attribute.components * static_cast<GLint>(sizeof(float)))) {
+    return false;
+  }
+  attribute.buffer = buffer;
+  GLint bytes = 0;
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+  attribute.data.resize(bytes / sizeof(float));
+  glGetBufferSubData(GL_ARRAY_BUFFER, 0, bytes, attribute.data.data());
+  return true;
+}
+
+// Replaces an attribute's buffer contents with packed data and points the
+// attribute at it.  The buffer still belongs to the geometry that created it
+template <typename T>
+inline void write_packed_attribute(GLuint index, GLuint buffer, const std::vector<T> &packed, GLint components,
+                                   GLenum type, GLboolean normalized) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(T), packed.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(index, components, type, normalized, 0, nullptr);
+}
+
+// Largest error from storing the attribute as half floats
+inline float half_error(const float_attribute &attribute) {
+  float error = 0.0f;
+  for (auto f : attribute.data) {
+    error = std::max(error, std::abs(glm::unpackHalf1x16(glm::packHalf1x16(f)) - f));
+  }
+  return error;
+}
+
+// Four half floats per vertex, padding three component data with w = 1 so each vertex stays 4 byte aligned
+inline std::vector<uint16_t> pack_half(const float_attribute &attribute) {
+  auto padded = attribute.components == 3 ? 4 : attribute.components;
+  std::vector<uint16_t> packed;
+  packed.reserve(attribute.count() * padded);
+  for (size_t i = 0; i < attribute.count(); ++i) {
+    auto v = attribute.get(i);
+    for (GLint c = 0; c < padded; ++c) {
+      packed.push_back(glm::packHalf1x16(v[c]));
+    }
+  }
+  return packed;
+}
+
+inline bool all_unit_length(const float_attribute &attribute) {
+  for (size_t i = 0; i < attribute.count(); ++i) {
+    if (std::abs(glm::length(glm::vec3(attribute.get(i))) - 1.0f) > UNIT_VECTOR_TOLERANCE) {
+      return false;
+    }
+  }
+  return true;
+}
+}
+
+// Packs a geometry's float vertex attributes in place, keeping the buffers the
+// geometry already owns so it still draws and frees them as before.  The
+// hardware unpacks every format, so shaders keep their float inputs:
+//  - positions become half floats if the error stays under POSITION_HALF_TOLERANCE
+//  - normals and tangents become 10:10:10:2 snorm
+//  - the binormal is dropped where it's the cross of normal and tangent, its
+//    direction kept in the tangent's w.  Shaders rebuild it when the binormal
+//    input reads zero
+//  - texture coordinates become half floats if the error stays under TEX_COORD_HALF_TOLERANCE
+//  - colours in [0, 1] become unorm8
+// Attributes that don't fit a packed format are left as floats.  Calling it
+// again, or on a copy sharing the same buffers, does nothing more
+inline vertex_compression_stats compress_vertices(graphics_framework::geometry &geom) {
+  using namespace glm;
+  using namespace graphics_framework;
+  using detail::float_attribute;
+  vertex_compression_stats stats;
+  glBindVertexArray(geom.get_array_object());
+
+  float_attribute positions, colours, normals, binormals, tangents, tex_coords;
+  bool has_positions = detail::read_float_attribute(BUFFER_INDEXES::POSITION_BUFFER, positions);
+  bool has_colours = detail::read_float_attribute(BUFFER_INDEXES::COLOUR_BUFFER, colours);
+  bool has_normals = detail::read_float_attribute(BUFFER_INDEXES::NORMAL_BUFFER, normals);
+  bool has_binormals = detail::read_float_attribute(BUFFER_INDEXES::BINORMAL_BUFFER, binormals);
+  bool has_tangents = detail::read_float_attribute(BUFFER_INDEXES::TANGENT_BUFFER, tangents);
+  bool has_tex_coords = detail::read_float_attribute(BUFFER_INDEXES::TEXTURE_COORDS_0, tex_coords);
+  for (auto a : {&positions, &colours, &normals, &binormals, &tangents, &tex_coords}) {
+    stats.bytes_before += a->data.size() * sizeof(float);
+  }
+  stats.bytes_after = stats.bytes_before;
+  // Counts a float attribute as replaced by packed data
+  auto replace = [&stats](const float_attribute &attribute, size_t packed_bytes) {
+    stats.bytes_after = stats.bytes_after - attribute.data.size() * sizeof(float) + packed_bytes;
+  };
+
+  if (has_positions && positions.components >= 3) {
+    vec3 low(INFINITY), high(-INFINITY);
+    for (size_t i = 0; i < positions.count(); ++i) {
+      low = min(low, vec3(positions.get(i)));
+      high = max(high, vec3(positions.get(i)));
+    }
+    if (detail::half_error(positions) <= distance(low, high) * POSITION_HALF_TOLERANCE) {
+      auto packed = detail::pack_half(positions);
+      detail::write_packed_attribute(BUFFER_INDEXES::POSITION_BUFFER, positions.buffer, packed, 4, GL_HALF_FLOAT,
+                                     GL_FALSE);
+      replace(positions, packed.size() * sizeof(uint16_t));
+    }
+  }
+
+  if (has_colours && colours.components >= 3 &&
+      std::all_of(colours.data.begin(), colours.data.end(), [](float f) { return f >= 0.0f && f <= 1.0f; })) {
+    std::vector<uint32_t> packed;
+    for (size_t i = 0; i < colours.count(); ++i) {
+      packed.push_back(packUnorm4x8(colours.get(i)));
+    }
+    detail::write_packed_attribute(BUFFER_INDEXES::COLOUR_BUFFER, colours.buffer, packed, 4, GL_UNSIGNED_BYTE, GL_TRUE);
+    replace(colours, packed.size() * sizeof(uint32_t));
+  }
+
+  bool pack_normals = has_normals && normals.components == 3 && detail::all_unit_length(normals);
+  if (pack_normals) {
+    std::vector<uint32_t> packed;
+    for (size_t i = 0; i < normals.count(); ++i) {
+      packed.push_back(packSnorm3x10_1x2(vec4(vec3(normals.get(i)), 0.0f)));
+    }
+    detail::write_packed_attribute(BUFFER_INDEXES::NORMAL_BUFFER, normals.buffer, packed, 4, GL_INT_2_10_10_10_REV,
+                                   GL_TRUE);
+    replace(normals, packed.size() * sizeof(uint32_t));
+  }
+
+  if (has_tangents && tangents.components == 3 && detail::all_unit_length(tangents)) {
+    // The binormal can only go if every one lies along normal x tangent
+    bool drop_binormals = pack_normals && has_binormals && binormals.count() == tangents.count() &&
+                          normals.count() == tangents.count();
+    std::vector<float> signs(tangents.count(), 1.0f);
+    for (size_t i = 0; drop_binormals && i < tangents.count(); ++i) {
+      auto b = vec3(binormals.get(i));
+      auto nxt = cross(vec3(normals.get(i)), vec3(tangents.get(i)));
+      auto along = dot(nxt, b);
+      if (std::abs(along) < (1.0f - UNIT_VECTOR_TOLERANCE) * length(nxt) * length(b)) {
+        drop_binormals = false;
+      }
+      signs[i] = along < 0.0f ? -1.0f : 1.0f;
+    }
+    std::vector<uint32_t> packed;
+    for (size_t i = 0; i < tangents.count(); ++i) {
+      packed.push_back(packSnorm3x10_1x2(vec4(vec3(tangents.get(i)), drop_binormals ? signs[i] : 1.0f)));
+    }
+    detail::write_packed_attribute(BUFFER_INDEXES::TANGENT_BUFFER, tangents.buffer, packed, 4, GL_INT_2_10_10_10_REV,
+                                   GL_TRUE);
+    replace(tangents, packed.size() * sizeof(uint32_t));
+    if (drop_binormals) {
+      // Disabled, the binormal input reads as zero.  The empty buffer is still deleted with the geometry
+      glDisableVertexAttribArray(BUFFER_INDEXES::BINORMAL_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, binormals.buffer);
+      glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+      replace(binormals, 0);
+    }
+  }
+
+  if (has_tex_coords && detail::half_error(tex_coords) <= TEX_COORD_HALF_TOLERANCE) {
+    auto packed = detail::pack_half(tex_coords);
+    detail::write_packed_attribute(BUFFER_INDEXES::TEXTURE_COORDS_0, tex_coords.buffer, packed,
+                                   tex_coords.components == 3 ? 4 : tex_coords.components, GL_HALF_FLOAT, GL_FALSE);
+    replace(tex_coords, packed.size() * sizeof(uint16_t));
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+  return stats;
+}
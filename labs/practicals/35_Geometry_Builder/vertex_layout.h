@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <graphics_framework.h>
+#include <unordered_map>
+#include <vector>
+
+// Attribute slots a geometry can use
+const GLuint MAX_VERTEX_ATTRIBUTES = 16;
+
+// How a geometry's vertex data is laid out in its buffers
+enum vertex_layout {
+  // Every attribute in one buffer, one vertex after another
+  interleaved_layout,
+  // Positions on their own so depth only passes fetch nothing else, the rest
+  // interleaved in a second buffer
+  split_positions_layout
+};
+
+namespace detail {
+// One enabled attribute of a vertex array object, read back with its format
+struct vertex_attribute {
+  GLuint index = 0;
+  GLuint buffer = 0;
+  GLint components = 0;
+  GLenum type = GL_FLOAT;
+  GLboolean normalized = GL_FALSE;
+  GLboolean integer = GL_FALSE;
+  GLsizei stride = 0;
+  size_t offset = 0;
+  // Bytes of one vertex's value
+  GLsizei size = 0;
+  std::vector<uint8_t> data;
+};
+
+inline GLsizei attribute_size(GLenum type, GLint components) {
+  switch (type) {
+  case GL_INT_2_10_10_10_REV:
+  case GL_UNSIGNED_INT_2_10_10_10_REV:
+    return 4;
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return components;
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+  case GL_HALF_FLOAT:
+    return components * 2;
+  default:
+    return components * 4;
+  }
+}
+
+// Reads the format of an attribute of the bound vertex array object.  Returns
+// false if the attribute is disabled
+inline bool read_attribute_format(GLuint index, vertex_attribute &attribute) {
+  GLint enabled = 0, value = 0;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+  if (!enabled) {
+    return false;
+  }
+  attribute.index = index;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+  attribute.buffer = value;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attribute.components);
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &value);
+  attribute.type = value;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &value);
+  attribute.normalized = value != 0;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &value);
+  attribute.integer = value != 0;
+  glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attribute.stride);
+  GLvoid *offset = nullptr;
+  glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &offset);
+  attribute.offset = reinterpret_cast<size_t>(offset);
+  attribute.size = attribute_size(attribute.type, attribute.components);
+  return attribute.buffer != 0;
+}
+
+inline void set_attribute_pointer(const vertex_attribute &attribute, GLsizei stride, size_t offset) {
+  if (attribute.integer) {
+    glVertexAttribIPointer(attribute.index, attribute.components, attribute.type, stride,
+                           reinterpret_cast<void *>(offset));
+  } else {
+    glVertexAttribPointer(attribute.index, attribute.components, attribute.type, attribute.normalized, stride,
+                          reinterpret_cast<void *>(offset));
+  }
+}
+
+// Vertex array objects reading only positions, keyed by the geometry's own
+inline std::unordered_map<GLuint, GLuint> &position_arrays() {
+  static std::unordered_map<GLuint, GLuint> arrays;
+  return arrays;
+}
+}
+
+// Rebuilds a geometry's vertex data from one buffer per attribute into the
+// given layout, keeping whatever formats compress_vertices left it in.  The
+// interleaved data goes back into buffers the geometry already owns and the
+// rest are emptied, so it still draws and frees them as before.  Also makes a
+// vertex array object reading only positions, fetched by get_position_array.
+// Geometry that has already been through it, including copies sharing the
+// same buffers, is left alone.  Returns the bytes per vertex of the interleaved buffer
+inline GLsizei interleave_vertices(graphics_framework::geometry &geom, vertex_layout layout = split_positions_layout) {
+  using namespace graphics_framework;
+  if (detail::position_arrays().count(geom.get_array_object()) != 0) {
+    return 0;
+  }
+  glBindVertexArray(geom.get_array_object());
+  std::vector<detail::vertex_attribute> attributes;
+  for (GLuint i = 0; i < MAX_VERTEX_ATTRIBUTES; ++i) {
+    detail::vertex_attribute attribute;
+    if (detail::read_attribute_format(i, attribute)) {
+      attributes.push_back(attribute);
+    }
+  }
+  // Each attribute must have a tightly packed buffer of its own
+  for (size_t a = 0; a < attributes.size(); ++a) {
+    bool own_buffer = attributes[a].offset == 0 && (attributes[a].stride == 0 || attributes[a].stride == attributes[a].size);
+    for (size_t b = 0; b < a; ++b) {
+      own_buffer &= attributes[a].buffer != attributes[b].buffer;
+    }
+    if (!own_buffer || attributes[a].size % 4 != 0) {
+      glBindVertexArray(0);
+      return 0;
+    }
+  }
+  if (attributes.empty() || attributes[0].index != BUFFER_INDEXES::POSITION_BUFFER) {
+    glBindVertexArray(0);
+    return 0;
+  }
+
+  // Read back every attribute
+  size_t vertices = SIZE_MAX;
+  for (auto &attribute : attributes) {
+    GLint bytes = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+    attribute.data.resize(bytes);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, bytes, attribute.data.data());
+    vertices = std::min(vertices, attribute.data.size() / attribute.size);
+  }
+
+  // A split layout leaves the position stream as it is and interleaves the rest
+  size_t first = layout == split_positions_layout ? 1 : 0;
+  GLsizei stride = 0;
+  for (size_t a = first; a < attributes.size(); ++a) {
+    stride += attributes[a].size;
+  }
+  if (stride > 0) {
+    std::vector<uint8_t> interleaved(vertices * stride);
+    size_t offset = 0;
+    for (size_t a = first; a < attributes.size(); ++a) {
+      for (size_t v = 0; v < vertices; ++v) {
+        std::memcpy(&interleaved[v * stride + offset], &attributes[a].data[v * attributes[a].size], attributes[a].size);
+      }
+      offset += attributes[a].size;
+    }
+    auto buffer = attributes[first].buffer;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, interleaved.size(), interleaved.data(), GL_STATIC_DRAW);
+    offset = 0;
+    for (size_t a = first; a < attributes.size(); ++a) {
+      detail::set_attribute_pointer(attributes[a], stride, offset);
+      offset += attributes[a].size;
+      if (a != first) {
+        glBindBuffer(GL_ARRAY_BUFFER, attributes[a].buffer);
+        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      }
+    }
+  }
+
+  // Positions only, reading the position stream or the interleaved buffer
+  GLint index_buffer = 0;
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &index_buffer);
+  GLuint position_array = 0;
+  glGenVertexArrays(1, &position_array);
+  glBindVertexArray(position_array);
+  glBindBuffer(GL_ARRAY_BUFFER, attributes[0].buffer);
+  detail::set_attribute_pointer(attributes[0], layout == split_positions_layout ? 0 : stride, 0);
+  glEnableVertexAttribArray(attributes[0].index);
+  if (index_buffer != 0) {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+  }
+  detail::position_arrays()[geom.get_array_object()] = position_array;
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return stride;
+}
+
+// Vertex array object reading only the geometry's positions, for depth only
+// passes.  The geometry's own one if interleave_vertices hasn't split it
+inline GLuint get_position_array(const graphics_framework::geometry &geom) {
+  auto found = detail::position_arrays().find(geom.get_array_object());
+  return found != detail::position_arrays().end() ? found->second : geom.get_array_object();
+}
+
+// Draws a geometry reading only its positions.  The effect and its uniforms
+// must already be set, and the shaders may only take the position input
+inline void render_positions(const graphics_framework::geometry &geom) {
+  glBindVertexArray(get_position_array(geom));
+  if (geom.get_index_buffer() != 0) {
+    glDrawElements(geom.get_type(), geom.get_index_count(), GL_UNSIGNED_INT, nullptr);
+  } else {
+    glDrawArrays(geom.get_type(), 0, geom.get_vertex_count());
+  }
+  glBindVertexArray(0);
+}
@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "mesh_optimizer.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -13,7 +14,8 @@ target_camera cam;
 bool load_content() {
   // *********************************
   // Load in model, models/teapot.obj
-	m = mesh(geometry("models/teapot.obj"));
+	// Welded and reordered for the vertex cache, then cached as models/teapot.obj.mesh
+	m = mesh(load_optimized_model("models/teapot.obj"));
   // Load in texture, textures/checker.png
 	tex = texture("textures/checker.png");
   // *********************************
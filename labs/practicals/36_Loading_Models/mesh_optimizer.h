@@ -0,0 +1,653 @@
+#pragma once
+
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <graphics_framework.h>
+#include <iostream>
+#include <iterator>
+#include "mesh_simplifier.h"
+#include "../35_Geometry_Builder/vertex_compression.h"
+#include "../35_Geometry_Builder/vertex_layout.h"
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Post-transform cache size triangle orders are tuned for and measured against
+const unsigned int VERTEX_CACHE_SIZE = 16;
+// Clusters are split wherever their running cache miss ratio drops below this,
+// giving the overdraw sort more pieces to work with for little cache cost
+const float OVERDRAW_SPLIT_ACMR = 0.75f;
+// Levels of detail built for each model, including the full mesh
+const unsigned int MESH_LOD_LEVELS = 4;
+// Fraction of the previous level's triangles each level aims for
+const float MESH_LOD_REDUCTION = 0.25f;
+// No level is built with fewer triangles than this
+const size_t MESH_LOD_MIN_TRIANGLES = 32;
+// Bumped whenever the optimizer changes, so stale cached meshes are rebuilt
+const uint32_t MESH_CACHE_VERSION = 2;
+
+// Range of the index list drawn for one level of detail
+struct mesh_lod {
+  uint32_t first_index;
+  uint32_t index_count;
+  // Object space distance the surface moved by while simplifying down to this level
+  float error;
+};
+
+// Vertex data and triangle list of an imported model
+struct mesh_data {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec3> tangents;
+  std::vector<glm::vec3> binormals;
+  std::vector<glm::vec2> tex_coords;
+  std::vector<uint32_t> indices;
+  // Levels of detail, the full mesh first, all indexing the same vertices.
+  // Empty until the mesh is optimized
+  std::vector<mesh_lod> lods;
+
+  size_t vertex_count() const { return positions.size(); }
+  size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// Post-transform cache efficiency of an index order, simulated with a FIFO cache
+struct cache_stats {
+  // Average cache miss ratio - vertices shaded per triangle, 3 at worst and around 0.5 at best
+  float acmr;
+  // Average transformed vertex ratio - vertices shaded per vertex in the mesh, 1 at best
+  float atvr;
+};
+
+inline cache_stats measure_cache(const std::vector<uint32_t> &indices, size_t vertex_count,
+                                 unsigned int cache_size = VERTEX_CACHE_SIZE) {
+  // A vertex is still cached if fewer than cache_size misses have happened since it went in
+  std::vector<int64_t> cached_at(vertex_count, -static_cast<int64_t>(cache_size) - 1);
+  int64_t misses = 0;
+  for (auto i : indices) {
+    if (misses - cached_at[i] > cache_size) {
+      cached_at[i] = misses++;
+    }
+  }
+  cache_stats stats;
+  stats.acmr = indices.empty() ? 0.0f : static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+  stats.atvr = vertex_count == 0 ? 0.0f : static_cast<float>(misses) / static_cast<float>(vertex_count);
+  return stats;
+}
+
+namespace detail {
+// All attributes of a vertex as raw bytes, so identical vertices compare equal
+inline std::string vertex_key(const mesh_data &mesh, size_t v) {
+  std::string key(sizeof(float) * 14, '\0');
+  auto out = &key[0];
+  std::memcpy(out, &mesh.positions[v], sizeof(glm::vec3));
+  std::memcpy(out + 12, &mesh.normals[v], sizeof(glm::vec3));
+  std::memcpy(out + 24, &mesh.tangents[v], sizeof(glm::vec3));
+  std::memcpy(out + 36, &mesh.binormals[v], sizeof(glm::vec3));
+  std::memcpy(out + 48, &mesh.tex_coords[v], sizeof(glm::vec2));
+  return key;
+}
+
+// Moves every vertex to new_index[v].  Vertices sharing a slot must be identical,
+// and those mapped to UINT32_MAX are dropped
+inline void remap_vertices(mesh_data &mesh, const std::vector<uint32_t> &new_index, size_t new_count) {
+  mesh_data result;
+  result.positions.resize(new_count);
+  result.normals.resize(new_count);
+  result.tangents.resize(new_count);
+  result.binormals.resize(new_count);
+  result.tex_coords.resize(new_count);
+  for (size_t v = 0; v < mesh.vertex_count(); ++v) {
+    auto n = new_index[v];
+    if (n == UINT32_MAX) {
+      continue;
+    }
+    result.positions[n] = mesh.positions[v];
+    result.normals[n] = mesh.normals[v];
+    result.tangents[n] = mesh.tangents[v];
+    result.binormals[n] = mesh.binormals[v];
+    result.tex_coords[n] = mesh.tex_coords[v];
+  }
+  result.indices.reserve(mesh.indices.size());
+  for (auto i : mesh.indices) {
+    result.indices.push_back(new_index[i]);
+  }
+  result.lods = mesh.lods;
+  mesh = std::move(result);
+}
+
+// Next vertex to fan around once the current one has no triangles left.
+// Recently emitted vertices are tried first, then the input order
+inline int skip_dead_end(const std::vector<int> &live, std::vector<uint32_t> &dead_ends, size_t &cursor) {
+  while (!dead_ends.empty()) {
+    auto v = dead_ends.back();
+    dead_ends.pop_back();
+    if (live[v] > 0) {
+      return static_cast<int>(v);
+    }
+  }
+  for (; cursor < live.size(); ++cursor) {
+    if (live[cursor] > 0) {
+      return static_cast<int>(cursor);
+    }
+  }
+  return -1;
+}
+
+// FNV-1a hash of a file's contents, zero if it can't be read
+inline uint64_t hash_file(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    return 0;
+  }
+  uint64_t hash = 14695981039346656037ull;
+  char buffer[4096];
+  while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+    for (std::streamsize i = 0; i < file.gcount(); ++i) {
+      hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+template <typename T> void write_array(std::ofstream &file, const std::vector<T> &data) {
+  uint64_t count = data.size();
+  file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  file.write(reinterpret_cast<const char *>(data.data()), sizeof(T) * data.size());
+}
+
+template <typename T> bool read_array(std::ifstream &file, std::vector<T> &data) {
+  uint64_t count = 0;
+  if (!file.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+    return false;
+  }
+  data.resize(static_cast<size_t>(count));
+  return static_cast<bool>(file.read(reinterpret_cast<char *>(data.data()), sizeof(T) * data.size()));
+}
+}
+
+// Merges vertices whose attributes are all identical
+inline void weld_vertices(mesh_data &mesh) {
+  std::unordered_map<std::string, uint32_t> unique;
+  std::vector<uint32_t> new_index(mesh.vertex_count());
+  uint32_t count = 0;
+  for (size_t v = 0; v < mesh.vertex_count(); ++v) {
+    // Duplicates share the slot of the first copy
+    auto inserted = unique.insert(std::make_pair(detail::vertex_key(mesh, v), count));
+    new_index[v] = inserted.first->second;
+    if (inserted.second) {
+      ++count;
+    }
+  }
+  detail::remap_vertices(mesh, new_index, count);
+}
+
+// Reorders triangles for the post-transform vertex cache with Tipsify (Sander,
+// Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw").  Triangles are emitted as fans around one vertex at a time, moving
+// to whichever neighbour is still cached and will stay cached while its own fan
+// is drawn.  Positions in the new order where the cache had to start again are
+// added to hard_boundaries, as triangle indices
+inline void optimize_vertex_cache(mesh_data &mesh, std::vector<size_t> &hard_boundaries,
+                                  unsigned int cache_size = VERTEX_CACHE_SIZE) {
+  auto vertex_count = mesh.vertex_count();
+  auto triangle_count = mesh.triangle_count();
+  // Triangles using each vertex
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (auto i : mesh.indices) {
+    ++offsets[i + 1];
+  }
+  for (size_t v = 0; v < vertex_count; ++v) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<uint32_t> adjacency(mesh.indices.size());
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < mesh.indices.size(); ++i) {
+    adjacency[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<int> live(vertex_count);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    live[v] = static_cast<int>(offsets[v + 1] - offsets[v]);
+  }
+  std::vector<int64_t> cached_at(vertex_count, 0);
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> dead_ends, candidates, result;
+  result.reserve(mesh.indices.size());
+  int64_t time = cache_size + 1;
+  size_t cursor = 0;
+
+  hard_boundaries.clear();
+  hard_boundaries.push_back(0);
+  int fan = vertex_count > 0 ? 0 : -1;
+  while (fan >= 0) {
+    candidates.clear();
+    for (auto t = offsets[fan]; t < offsets[fan + 1]; ++t) {
+      auto triangle = adjacency[t];
+      if (emitted[triangle]) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; ++corner) {
+        auto v = mesh.indices[triangle * 3 + corner];
+        result.push_back(v);
+        dead_ends.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - cached_at[v] > cache_size) {
+          cached_at[v] = time++;
+        }
+      }
+      emitted[triangle] = true;
+    }
+
+    // Prefer the candidate cached longest ago that will still be cached once its fan is drawn
+    int next = -1;
+    int64_t best = -1;
+    for (auto v : candidates) {
+      if (live[v] <= 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cached_at[v] + 2 * live[v] <= cache_size) {
+        priority = time - cached_at[v];
+      }
+      if (priority > best) {
+        best = priority;
+        next = static_cast<int>(v);
+      }
+    }
+    if (next < 0) {
+      next = detail::skip_dead_end(live, dead_ends, cursor);
+      if (next >= 0 && hard_boundaries.back() != result.size() / 3) {
+        hard_boundaries.push_back(result.size() / 3);
+      }
+    }
+    fan = next;
+  }
+  mesh.indices = std::move(result);
+}
+
+// Reorders clusters of triangles so those facing away from the middle of the
+// mesh are drawn first.  They are the ones most likely to hide the rest, from
+// any view, so fewer pixels are shaded twice.  Clusters come from the vertex
+// cache order, split further where the cache is doing well so little locality
+// is lost
+inline void optimize_overdraw(mesh_data &mesh, const std::vector<size_t> &hard_boundaries,
+                              float split_acmr = OVERDRAW_SPLIT_ACMR, unsigned int cache_size = VERTEX_CACHE_SIZE) {
+  using namespace glm;
+  auto triangle_count = mesh.triangle_count();
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Soft boundaries, where the miss ratio since the cluster started is already
+  // low.  Clusters are measured from an empty cache, as they could follow any
+  // other cluster once sorted
+  std::vector<size_t> starts;
+  std::vector<int64_t> cached_at(mesh.vertex_count(), -static_cast<int64_t>(cache_size) - 1);
+  int64_t misses = 0;
+  size_t hard = 0;
+  size_t cluster_start = 0, cluster_misses = 0;
+  for (size_t t = 0; t < triangle_count; ++t) {
+    if (hard < hard_boundaries.size() && hard_boundaries[hard] == t) {
+      ++hard;
+      cluster_start = t;
+      cluster_misses = 0;
+      misses += cache_size + 1;
+      starts.push_back(t);
+    }
+    for (int corner = 0; corner < 3; ++corner) {
+      auto v = mesh.indices[t * 3 + corner];
+      if (misses - cached_at[v] > cache_size) {
+        cached_at[v] = misses++;
+        ++cluster_misses;
+      }
+    }
+    auto cluster_triangles = t + 1 - cluster_start;
+    bool next_is_hard = hard < hard_boundaries.size() && hard_boundaries[hard] == t + 1;
+    if (!next_is_hard && t + 1 < triangle_count &&
+        static_cast<float>(cluster_misses) < split_acmr * static_cast<float>(cluster_triangles)) {
+      cluster_start = t + 1;
+      cluster_misses = 0;
+      misses += cache_size + 1;
+      starts.push_back(t + 1);
+    }
+  }
+  starts.push_back(triangle_count);
+
+  // Area weighted centre of the whole mesh
+  vec3 mesh_centre(0.0f);
+  float mesh_area = 0.0f;
+  struct cluster {
+    size_t first, last;
+    float sort_key;
+  };
+  std::vector<cluster> clusters;
+  std::vector<vec3> centres;
+  std::vector<vec3> normals;
+  for (size_t c = 0; c + 1 < starts.size(); ++c) {
+    vec3 centre(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (auto t = starts[c]; t < starts[c + 1]; ++t) {
+      auto &a = mesh.positions[mesh.indices[t * 3]];
+      auto &b = mesh.positions[mesh.indices[t * 3 + 1]];
+      auto &d = mesh.positions[mesh.indices[t * 3 + 2]];
+      // Cross product length is twice the area, which cancels out below
+      auto n = cross(b - a, d - a);
+      auto twice_area = length(n);
+      centre += (a + b + d) / 3.0f * twice_area;
+      normal += n;
+      area += twice_area;
+    }
+    mesh_centre += centre;
+    mesh_area += area;
+    centres.push_back(area > 0.0f ? centre / area : mesh.positions[mesh.indices[starts[c] * 3]]);
+    normals.push_back(length(normal) > 0.0f ? normalize(normal) : normal);
+    clusters.push_back(cluster{starts[c], starts[c + 1], 0.0f});
+  }
+  if (mesh_area > 0.0f) {
+    mesh_centre /= mesh_area;
+  }
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    clusters[c].sort_key = dot(centres[c] - mesh_centre, normals[c]);
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const cluster &a, const cluster &b) { return a.sort_key > b.sort_key; });
+
+  std::vector<uint32_t> result;
+  result.reserve(mesh.indices.size());
+  for (auto &c : clusters) {
+    result.insert(result.end(), mesh.indices.begin() + c.first * 3, mesh.indices.begin() + c.last * 3);
+  }
+  mesh.indices = std::move(result);
+}
+
+// Renumbers vertices in the order the triangles first use them, so vertex
+// fetches walk through memory.  Unused vertices are dropped
+inline void optimize_vertex_fetch(mesh_data &mesh) {
+  std::vector<uint32_t> new_index(mesh.vertex_count(), UINT32_MAX);
+  uint32_t count = 0;
+  for (auto i : mesh.indices) {
+    if (new_index[i] == UINT32_MAX) {
+      new_index[i] = count++;
+    }
+  }
+  detail::remap_vertices(mesh, new_index, count);
+}
+
+// Imports every mesh in a model file into one triangle list, one vertex per
+// triangle corner as the file describes them
+inline mesh_data import_mesh(const std::string &filename) {
+  Assimp::Importer importer;
+  auto scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                                               aiProcess_CalcTangentSpace | aiProcess_SortByPType);
+  if (!scene) {
+    std::cerr << "ERROR - loading geometry " << filename << std::endl;
+    std::cerr << importer.GetErrorString() << std::endl;
+    throw std::runtime_error("Error loading geometry");
+  }
+  mesh_data result;
+  for (unsigned int m = 0; m < scene->mNumMeshes; ++m) {
+    auto source = scene->mMeshes[m];
+    if (!(source->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
+      continue;
+    }
+    auto base = static_cast<uint32_t>(result.vertex_count());
+    for (unsigned int v = 0; v < source->mNumVertices; ++v) {
+      auto &p = source->mVertices[v];
+      result.positions.push_back(glm::vec3(p.x, p.y, p.z));
+      auto n = source->HasNormals() ? source->mNormals[v] : aiVector3D(0.0f, 1.0f, 0.0f);
+      result.normals.push_back(glm::vec3(n.x, n.y, n.z));
+      if (source->HasTangentsAndBitangents()) {
+        auto &t = source->mTangents[v];
+        auto &b = source->mBitangents[v];
+        result.tangents.push_back(glm::vec3(t.x, t.y, t.z));
+        result.binormals.push_back(glm::vec3(b.x, b.y, b.z));
+      } else {
+        result.tangents.push_back(glm::vec3(0.0f));
+        result.binormals.push_back(glm::vec3(0.0f));
+      }
+      auto uv = source->HasTextureCoords(0) ? source->mTextureCoords[0][v] : aiVector3D(0.0f);
+      result.tex_coords.push_back(glm::vec2(uv.x, uv.y));
+    }
+    for (unsigned int f = 0; f < source->mNumFaces; ++f) {
+      auto &face = source->mFaces[f];
+      if (face.mNumIndices != 3) {
+        continue;
+      }
+      for (int corner = 0; corner < 3; ++corner) {
+        result.indices.push_back(base + face.mIndices[corner]);
+      }
+    }
+  }
+  return result;
+}
+
+// Simplified triangle lists for each level of detail, the full mesh first,
+// paired with how far the surface moved to reach them.  Stops early once the
+// surface can't be reduced much further without folding
+inline std::vector<std::pair<std::vector<uint32_t>, float>> build_lod_chain(const mesh_data &mesh) {
+  std::vector<std::pair<std::vector<uint32_t>, float>> levels;
+  levels.push_back(std::make_pair(mesh.indices, 0.0f));
+  mesh_simplifier simplifier(mesh.positions, mesh.normals, mesh.tex_coords, mesh.indices);
+  while (levels.size() < MESH_LOD_LEVELS) {
+    auto previous = levels.back().first.size() / 3;
+    auto target = static_cast<size_t>(previous * MESH_LOD_REDUCTION);
+    if (target < MESH_LOD_MIN_TRIANGLES) {
+      break;
+    }
+    auto indices = simplifier.simplify(target);
+    if (indices.size() / 3 > previous * 3 / 4) {
+      break;
+    }
+    levels.push_back(std::make_pair(std::move(indices), simplifier.get_error()));
+  }
+  return levels;
+}
+
+// Welds, builds the levels of detail, reorders each for the vertex cache and
+// overdraw, then renumbers vertices for fetch.  Prints the cache miss ratios of
+// the full mesh before and after, and the size of each level
+inline void optimize_mesh(mesh_data &mesh, const std::string &name) {
+  auto imported = measure_cache(mesh.indices, mesh.vertex_count());
+  auto imported_vertices = mesh.vertex_count();
+  weld_vertices(mesh);
+  auto welded = measure_cache(mesh.indices, mesh.vertex_count());
+  auto levels = build_lod_chain(mesh);
+
+  // Each level is optimized on its own, then appended to one shared index list
+  std::vector<uint32_t> all_indices;
+  cache_stats tipsified;
+  mesh.lods.clear();
+  for (size_t l = 0; l < levels.size(); ++l) {
+    mesh.indices = std::move(levels[l].first);
+    std::vector<size_t> boundaries;
+    optimize_vertex_cache(mesh, boundaries);
+    if (l == 0) {
+      tipsified = measure_cache(mesh.indices, mesh.vertex_count());
+    }
+    optimize_overdraw(mesh, boundaries);
+    mesh.lods.push_back(mesh_lod{static_cast<uint32_t>(all_indices.size()), static_cast<uint32_t>(mesh.indices.size()),
+                                 levels[l].second});
+    all_indices.insert(all_indices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+  mesh.indices = std::move(all_indices);
+  optimize_vertex_fetch(mesh);
+
+  auto base = std::vector<uint32_t>(mesh.indices.begin(), mesh.indices.begin() + mesh.lods[0].index_count);
+  auto optimized = measure_cache(base, mesh.vertex_count());
+  std::cout << name << ": " << base.size() / 3 << " triangles, " << imported_vertices << " -> " << mesh.vertex_count()
+            << " vertices" << std::endl;
+  std::cout << "  ACMR/ATVR imported " << imported.acmr << "/" << imported.atvr << ", welded " << welded.acmr << "/"
+            << welded.atvr << ", cache order " << tipsified.acmr << "/" << tipsified.atvr << ", with overdraw order "
+            << optimized.acmr << "/" << optimized.atvr << std::endl;
+  std::cout << "  levels of detail:";
+  for (auto &lod : mesh.lods) {
+    std::cout << " " << lod.index_count / 3 << " (error " << lod.error << ")";
+  }
+  std::cout << std::endl;
+}
+
+// Reads an optimized mesh cached for a source file with the given contents hash
+inline bool read_mesh_cache(const std::string &cache_name, uint64_t source_hash, mesh_data &mesh) {
+  std::ifstream file(cache_name, std::ios::binary);
+  uint32_t version = 0;
+  uint64_t hash = 0;
+  if (!file.read(reinterpret_cast<char *>(&version), sizeof(version)) || version != MESH_CACHE_VERSION ||
+      !file.read(reinterpret_cast<char *>(&hash), sizeof(hash)) || hash != source_hash) {
+    return false;
+  }
+  return detail::read_array(file, mesh.positions) && detail::read_array(file, mesh.normals) &&
+         detail::read_array(file, mesh.tangents) && detail::read_array(file, mesh.binormals) &&
+         detail::read_array(file, mesh.tex_coords) && detail::read_array(file, mesh.indices) &&
+         detail::read_array(file, mesh.lods) && !mesh.lods.empty();
+}
+
+inline void write_mesh_cache(const std::string &cache_name, uint64_t source_hash, const mesh_data &mesh) {
+  std::ofstream file(cache_name, std::ios::binary);
+  if (!file) {
+    std::cerr << "Could not write mesh cache " << cache_name << std::endl;
+    return;
+  }
+  file.write(reinterpret_cast<const char *>(&MESH_CACHE_VERSION), sizeof(MESH_CACHE_VERSION));
+  file.write(reinterpret_cast<const char *>(&source_hash), sizeof(source_hash));
+  detail::write_array(file, mesh.positions);
+  detail::write_array(file, mesh.normals);
+  detail::write_array(file, mesh.tangents);
+  detail::write_array(file, mesh.binormals);
+  detail::write_array(file, mesh.tex_coords);
+  detail::write_array(file, mesh.indices);
+  detail::write_array(file, mesh.lods);
+}
+
+// Model with its levels of detail, all drawn from one vertex and index buffer
+struct lod_model {
+  graphics_framework::geometry geom;
+  std::vector<mesh_lod> levels;
+  // Object space bounding sphere
+  glm::vec3 centre;
+  float radius;
+};
+
+// Uploads every level into one index buffer, with the vertices packed by
+// compress_vertices and split into a position stream and an interleaved rest.
+// The geometry itself only knows about the full mesh at the front, so
+// renderer::render still draws it as before
+inline lod_model upload_mesh(const mesh_data &mesh) {
+  using namespace graphics_framework;
+  lod_model model;
+  model.geom.set_type(GL_TRIANGLES);
+  model.geom.add_buffer(mesh.positions, BUFFER_INDEXES::POSITION_BUFFER);
+  model.geom.add_buffer(mesh.normals, BUFFER_INDEXES::NORMAL_BUFFER);
+  model.geom.add_buffer(mesh.binormals, BUFFER_INDEXES::BINORMAL_BUFFER);
+  model.geom.add_buffer(mesh.tangents, BUFFER_INDEXES::TANGENT_BUFFER);
+  model.geom.add_buffer(mesh.tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
+  model.geom.add_index_buffer(
+      std::vector<GLuint>(mesh.indices.begin(), mesh.indices.begin() + mesh.lods[0].index_count));
+  // Replace the index data with all the levels
+  glBindVertexArray(model.geom.get_array_object());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.geom.get_index_buffer());
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  auto packed = compress_vertices(model.geom);
+  std::cout << "  vertex data packed from " << packed.bytes_before / 1024 << " KB to " << packed.bytes_after / 1024
+            << " KB" << std::endl;
+  interleave_vertices(model.geom, split_positions_layout);
+  model.levels = mesh.lods;
+
+  glm::vec3 low(INFINITY), high(-INFINITY);
+  for (auto &p : mesh.positions) {
+    low = glm::min(low, p);
+    high = glm::max(high, p);
+  }
+  model.centre = (low + high) * 0.5f;
+  model.radius = 0.0f;
+  for (auto &p : mesh.positions) {
+    model.radius = std::max(model.radius, glm::distance(p, model.centre));
+  }
+  return model;
+}
+
+// Loads a model with its levels of detail.  The optimized mesh is cached beside
+// the model as filename.mesh and reused until the model file changes
+inline lod_model load_lod_model(const std::string &filename) {
+  auto cache_name = filename + ".mesh";
+  auto source_hash = detail::hash_file(filename);
+  mesh_data mesh;
+  if (source_hash != 0 && read_mesh_cache(cache_name, source_hash, mesh)) {
+    auto stats = measure_cache(
+        std::vector<uint32_t>(mesh.indices.begin(), mesh.indices.begin() + mesh.lods[0].index_count),
+        mesh.vertex_count());
+    std::cout << filename << ": loaded optimized mesh from " << cache_name << ", ACMR/ATVR " << stats.acmr << "/"
+              << stats.atvr << ", " << mesh.lods.size() << " levels of detail" << std::endl;
+    return upload_mesh(mesh);
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  mesh = import_mesh(filename);
+  optimize_mesh(mesh, filename);
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start);
+  std::cout << "  imported and optimized in " << elapsed.count() << " ms" << std::endl;
+  if (source_hash != 0) {
+    write_mesh_cache(cache_name, source_hash, mesh);
+  }
+  return upload_mesh(mesh);
+}
+
+// Drop in for geometry(filename), drawing the optimized full mesh
+inline graphics_framework::geometry load_optimized_model(const std::string &filename) {
+  return load_lod_model(filename).geom;
+}
+
+// Pixels the surface may be off by before a finer level is needed
+const float LOD_PIXEL_ERROR = 1.0f;
+// How far either side of LOD_PIXEL_ERROR a level's error must go before the
+// level changes, so a model sitting on a threshold doesn't flicker between two
+const float LOD_HYSTERESIS = 0.3f;
+
+// Picks the level to draw a model with from the size of each level's error on
+// screen.  current is the level drawn last time.  projection_scale is the
+// pixels one unit covers at a distance of one, P[1][1] times half the screen height
+inline size_t select_lod(const lod_model &model, size_t current, const glm::mat4 &M, const glm::vec3 &eye,
+                         float projection_scale) {
+  using namespace glm;
+  if (model.levels.size() <= 1) {
+    return 0;
+  }
+  auto centre = vec3(M * vec4(model.centre, 1.0f));
+  auto scale = std::max(length(vec3(M[0])), std::max(length(vec3(M[1])), length(vec3(M[2]))));
+  auto d = distance(eye, centre) - model.radius * scale;
+  if (d <= 0.0f) {
+    return 0;
+  }
+  auto pixels_per_unit = scale * projection_scale / d;
+  // Coarsest level within the error, moving coarser only once well inside it and
+  // finer only once well outside it
+  size_t coarser = 0, finer = 0;
+  for (size_t l = 0; l < model.levels.size(); ++l) {
+    auto pixels = model.levels[l].error * pixels_per_unit;
+    if (pixels <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) {
+      coarser = l;
+    }
+    if (pixels <= LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS)) {
+      finer = l;
+    }
+  }
+  return std::min(std::max(current, coarser), finer);
+}
+
+// Draws one level of a model.  The effect and its uniforms must already be set.
+// Depth only passes can read just the position stream
+inline void render_lod(const lod_model &model, size_t level, bool positions_only = false) {
+  auto &lod = model.levels[std::min(level, model.levels.size() - 1)];
+  glBindVertexArray(positions_only ? get_position_array(model.geom) : model.geom.get_array_object());
+  glDrawElements(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT,
+                 reinterpret_cast<void *>(static_cast<size_t>(lod.first_index) * sizeof(uint32_t)));
+  glBindVertexArray(0);
+}
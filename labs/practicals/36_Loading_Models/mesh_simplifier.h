@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <graphics_framework.h>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Extra weight on the planes that hold open borders in place, so holes don't grow
+const double SIMPLIFY_BORDER_WEIGHT = 10.0;
+// Smallest cosine between a triangle's normal before and after a collapse
+const float SIMPLIFY_MIN_NORMAL_COS = 0.2f;
+
+// Symmetric 4x4 quadric - the sum of squared distances to a set of planes
+struct quadric {
+  double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+  // Total weight of the planes, to turn the sum into a mean
+  double w = 0;
+
+  // Plane n.p + d = 0, with n unit length
+  static quadric from_plane(const glm::vec3 &n, float d, double weight = 1.0) {
+    quadric q;
+    q.a2 = weight * n.x * n.x;
+    q.ab = weight * n.x * n.y;
+    q.ac = weight * n.x * n.z;
+    q.ad = weight * n.x * d;
+    q.b2 = weight * n.y * n.y;
+    q.bc = weight * n.y * n.z;
+    q.bd = weight * n.y * d;
+    q.c2 = weight * n.z * n.z;
+    q.cd = weight * n.z * d;
+    q.d2 = weight * d * d;
+    q.w = weight;
+    return q;
+  }
+
+  quadric &operator+=(const quadric &o) {
+    a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad, b2 += o.b2;
+    bc += o.bc, bd += o.bd, c2 += o.c2, cd += o.cd, d2 += o.d2;
+    w += o.w;
+    return *this;
+  }
+
+  // Sum of squared plane distances at p
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+           c2 * z * z + 2 * cd * z + d2;
+  }
+
+  // Mean squared plane distance at p
+  double mean_error(const glm::vec3 &p) const { return w > 0 ? std::max(error(p), 0.0) / w : 0.0; }
+};
+
+// Triangle list simplified to a target size by quadric error edge collapse
+// (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+// Each collapse moves one end of an edge onto the other, so every level reuses
+// the original vertices and only the index list changes.  Vertices sharing a
+// position collapse together; where a position has several vertices, such as
+// along a texture seam, each moves to the one at the far end with the closest
+// normal and texture coordinate
+class mesh_simplifier {
+public:
+  mesh_simplifier(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                  const std::vector<glm::vec2> &tex_coords, const std::vector<uint32_t> &indices)
+      : _normals(normals), _tex_coords(tex_coords), _indices(indices), _max_error(0.0) {
+    group_positions(positions);
+    _triangle_alive.assign(_indices.size() / 3, true);
+    _alive_triangles = _indices.size() / 3;
+    build_quadrics();
+    for (uint32_t p = 0; p < _points.size(); ++p) {
+      push_edges(p, true);
+    }
+  }
+
+  // Collapses edges until at most target triangles remain, or nothing can
+  // collapse without folding the surface.  Returns the remaining triangles
+  std::vector<uint32_t> simplify(size_t target) {
+    while (_alive_triangles > target && !_queue.empty()) {
+      auto c = _queue.top();
+      _queue.pop();
+      if (!_point_alive[c.from] || !_point_alive[c.to] || c.from_stamp != _stamps[c.from] ||
+          c.to_stamp != _stamps[c.to]) {
+        continue;
+      }
+      if (!collapse_keeps_shape(c.from, c.to)) {
+        continue;
+      }
+      auto q = _quadrics[c.from];
+      q += _quadrics[c.to];
+      _max_error = std::max(_max_error, q.mean_error(_points[c.to].position));
+      collapse(c.from, c.to);
+    }
+    std::vector<uint32_t> result;
+    result.reserve(_alive_triangles * 3);
+    for (size_t t = 0; t < _triangle_alive.size(); ++t) {
+      if (_triangle_alive[t]) {
+        result.insert(result.end(), _indices.begin() + t * 3, _indices.begin() + t * 3 + 3);
+      }
+    }
+    return result;
+  }
+
+  // Object space distance the surface has moved by so far, estimated from the
+  // largest root mean square plane distance of any collapse
+  float get_error() const { return static_cast<float>(std::sqrt(_max_error)); }
+
+private:
+  struct point {
+    glm::vec3 position;
+    // Vertices at this position
+    std::vector<uint32_t> vertices;
+    // Triangles touching this position, some of which may have been removed
+    std::vector<uint32_t> triangles;
+  };
+
+  struct candidate {
+    double cost;
+    uint32_t from, to;
+    uint32_t from_stamp, to_stamp;
+    bool operator<(const candidate &o) const { return cost > o.cost; }
+  };
+
+  void group_positions(const std::vector<glm::vec3> &positions) {
+    std::unordered_map<std::string, uint32_t> lookup;
+    _point_of.resize(positions.size());
+    for (uint32_t v = 0; v < positions.size(); ++v) {
+      std::string key(reinterpret_cast<const char *>(&positions[v]), sizeof(glm::vec3));
+      auto inserted = lookup.insert(std::make_pair(key, static_cast<uint32_t>(_points.size())));
+      if (inserted.second) {
+        _points.push_back(point());
+        _points.back().position = positions[v];
+      }
+      _point_of[v] = inserted.first->second;
+      _points[_point_of[v]].vertices.push_back(v);
+    }
+    for (uint32_t t = 0; t < _indices.size() / 3; ++t) {
+      for (int corner = 0; corner < 3; ++corner) {
+        auto &tris = _points[_point_of[_indices[t * 3 + corner]]].triangles;
+        if (tris.empty() || tris.back() != t) {
+          tris.push_back(t);
+        }
+      }
+    }
+    _point_alive.assign(_points.size(), true);
+    _stamps.assign(_points.size(), 0);
+  }
+
+  glm::vec3 corner(uint32_t t, int c) const { return _points[_point_of[_indices[t * 3 + c]]].position; }
+
+  void build_quadrics() {
+    using namespace glm;
+    _quadrics.assign(_points.size(), quadric());
+    // Triangles on each edge, to find the open borders
+    std::unordered_map<uint64_t, uint32_t> edge_count;
+    for (uint32_t t = 0; t < _indices.size() / 3; ++t) {
+      auto n = cross(corner(t, 1) - corner(t, 0), corner(t, 2) - corner(t, 0));
+      if (length(n) == 0.0f) {
+        continue;
+      }
+      n = normalize(n);
+      auto q = quadric::from_plane(n, -dot(n, corner(t, 0)));
+      for (int c = 0; c < 3; ++c) {
+        _quadrics[_point_of[_indices[t * 3 + c]]] += q;
+        uint64_t a = _point_of[_indices[t * 3 + c]], b = _point_of[_indices[t * 3 + (c + 1) % 3]];
+        ++edge_count[std::min(a, b) << 32 | std::max(a, b)];
+      }
+    }
+    // Planes at right angles to the surface along open borders
+    for (uint32_t t = 0; t < _indices.size() / 3; ++t) {
+      auto n = cross(corner(t, 1) - corner(t, 0), corner(t, 2) - corner(t, 0));
+      if (length(n) == 0.0f) {
+        continue;
+      }
+      n = normalize(n);
+      for (int c = 0; c < 3; ++c) {
+        uint64_t a = _point_of[_indices[t * 3 + c]], b = _point_of[_indices[t * 3 + (c + 1) % 3]];
+        if (edge_count[std::min(a, b) << 32 | std::max(a, b)] != 1) {
+          continue;
+        }
+        auto edge = _points[b].position - _points[a].position;
+        auto border = cross(edge, n);
+        if (length(border) == 0.0f) {
+          continue;
+        }
+        border = normalize(border);
+        auto q = quadric::from_plane(border, -dot(border, _points[a].position), SIMPLIFY_BORDER_WEIGHT);
+        _quadrics[a] += q;
+        _quadrics[b] += q;
+      }
+    }
+  }
+
+  // Points sharing a surviving triangle with p
+  std::vector<uint32_t> neighbours(uint32_t p) const {
+    std::vector<uint32_t> result;
+    for (auto t : _points[p].triangles) {
+      if (_triangle_alive[t]) {
+        for (int c = 0; c < 3; ++c) {
+          auto other = _point_of[_indices[t * 3 + c]];
+          if (other != p) {
+            result.push_back(other);
+          }
+        }
+      }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+  }
+
+  // Queues a collapse along every edge from p, in whichever direction is cheaper.
+  // With only_higher set, edges to lower points are left for those points to queue
+  void push_edges(uint32_t p, bool only_higher) {
+    for (auto other : neighbours(p)) {
+      if (only_higher && other < p) {
+        continue;
+      }
+      auto q = _quadrics[p];
+      q += _quadrics[other];
+      auto to_other = q.error(_points[other].position);
+      auto to_p = q.error(_points[p].position);
+      if (to_other <= to_p) {
+        _queue.push(candidate{to_other, p, other, _stamps[p], _stamps[other]});
+      } else {
+        _queue.push(candidate{to_p, other, p, _stamps[other], _stamps[p]});
+      }
+    }
+  }
+
+  // Moving from onto to must not flip or flatten any triangle that survives
+  bool collapse_keeps_shape(uint32_t from, uint32_t to) const {
+    using namespace glm;
+    for (auto t : _points[from].triangles) {
+      if (!_triangle_alive[t]) {
+        continue;
+      }
+      vec3 before[3], after[3];
+      bool shared = false;
+      for (int c = 0; c < 3; ++c) {
+        auto p = _point_of[_indices[t * 3 + c]];
+        shared |= p == to;
+        before[c] = _points[p].position;
+        after[c] = p == from ? _points[to].position : before[c];
+      }
+      // Triangles along the edge disappear
+      if (shared) {
+        continue;
+      }
+      auto n_before = cross(before[1] - before[0], before[2] - before[0]);
+      auto n_after = cross(after[1] - after[0], after[2] - after[0]);
+      auto len_before = length(n_before), len_after = length(n_after);
+      if (len_after == 0.0f || (len_before > 0.0f && dot(n_before, n_after) < SIMPLIFY_MIN_NORMAL_COS * len_before * len_after)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Vertex at point to that best matches vertex v's attributes
+  uint32_t closest_vertex(uint32_t v, uint32_t to) const {
+    auto &vertices = _points[to].vertices;
+    uint32_t best = vertices[0];
+    float best_score = INFINITY;
+    for (auto u : vertices) {
+      auto uv = _tex_coords[u] - _tex_coords[v];
+      auto score = 1.0f - glm::dot(_normals[u], _normals[v]) + glm::dot(uv, uv);
+      if (score < best_score) {
+        best_score = score;
+        best = u;
+      }
+    }
+    return best;
+  }
+
+  void collapse(uint32_t from, uint32_t to) {
+    for (auto t : _points[from].triangles) {
+      if (!_triangle_alive[t]) {
+        continue;
+      }
+      bool shared = false;
+      for (int c = 0; c < 3; ++c) {
+        shared |= _point_of[_indices[t * 3 + c]] == to;
+      }
+      if (shared) {
+        _triangle_alive[t] = false;
+        --_alive_triangles;
+        continue;
+      }
+      for (int c = 0; c < 3; ++c) {
+        auto &v = _indices[t * 3 + c];
+        if (_point_of[v] == from) {
+          v = closest_vertex(v, to);
+        }
+      }
+      _points[to].triangles.push_back(t);
+    }
+    _points[from].triangles.clear();
+    _point_alive[from] = false;
+    _quadrics[to] += _quadrics[from];
+    // Every edge around to has a new cost, and so do the other edges of its
+    // neighbours as their stamps change
+    auto around = neighbours(to);
+    ++_stamps[to];
+    for (auto p : around) {
+      ++_stamps[p];
+    }
+    push_edges(to, false);
+    for (auto p : around) {
+      push_edges(p, false);
+    }
+  }
+
+  const std::vector<glm::vec3> &_normals;
+  const std::vector<glm::vec2> &_tex_coords;
+  std::vector<uint32_t> _indices;
+  std::vector<point> _points;
+  std::vector<uint32_t> _point_of;
+  std::vector<bool> _point_alive;
+  std::vector<bool> _triangle_alive;
+  size_t _alive_triangles;
+  std::vector<quadric> _quadrics;
+  // Bumped whenever a point's edges change, so outdated queue entries are skipped
+  std::vector<uint32_t> _stamps;
+  std::priority_queue<candidate> _queue;
+  double _max_error;
+};
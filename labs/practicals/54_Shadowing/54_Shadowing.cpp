@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../36_Loading_Models/mesh_optimizer.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -20,7 +21,7 @@ bool load_content() {
 	// Create plane mesh
 	meshes["plane"] = mesh(geometry_builder::create_plane());
 	// Create "teapot" mesh by loading in models/teapot.obj
-	meshes["teapot"] = mesh(geometry("models/teapot.obj"));
+	meshes["teapot"] = mesh(load_optimized_model("models/teapot.obj"));
 	// Translate Teapot(0,4,0)
 	meshes["teapot"].get_transform().translate(vec3(0.0f, 4.0f, 0.0f));
 	// Scale the teapot - (0.1, 0.1, 0.1)
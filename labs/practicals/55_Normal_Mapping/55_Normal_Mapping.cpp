@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../35_Geometry_Builder/vertex_compression.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -14,6 +15,10 @@ directional_light light;
 bool load_content() {
   // Create a cylinder
   cylinder = mesh(geometry_builder::create_cylinder(100, 100));
+  // Pack the vertices - the binormal is rebuilt in the vertex shader
+  auto packed = compress_vertices(cylinder.get_geometry());
+  cout << "Cylinder vertex data packed from " << packed.bytes_before / 1024 << " KB to " << packed.bytes_after / 1024
+       << " KB" << endl;
   // Scale cylinder
   cylinder.get_transform().scale = vec3(5.0f, 5.0f, 5.0f);
 
@@ -11,10 +11,10 @@ uniform mat3 N;
 layout(location = 0) in vec3 position;
 // Incoming normal
 layout(location = 2) in vec3 normal;
-// Incoming binormal
+// Incoming binormal - zero when packed away into the tangent's w
 layout(location = 3) in vec3 binormal;
-// Incoming tangent
-layout(location = 4) in vec3 tangent;
+// Incoming tangent, w is the binormal's direction
+layout(location = 4) in vec4 tangent;
 // Incoming texture coordinate
 layout(location = 10) in vec2 tex_coord_in;
 
@@ -41,8 +41,9 @@ void main() {
 
   // *********************************
   // Transform tangent
-  tangent_out = N * tangent;
-  // Transform binormal
-  binormal_out = N * binormal;
+  tangent_out = N * tangent.xyz;
+  // Transform binormal, rebuilding it if the mesh was packed without one
+  vec3 b = dot(binormal, binormal) > 0.0 ? binormal : cross(normal, tangent.xyz) * tangent.w;
+  binormal_out = N * b;
   // *********************************
 }
\ No newline at end of file
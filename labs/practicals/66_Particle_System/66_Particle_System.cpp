@@ -1,4 +1,5 @@
 #include <graphics_framework.h>
+#include "tf_particle_system.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -8,30 +9,8 @@ using namespace graphics_framework;
 // Maximum number of particles
 const unsigned int MAX_PARTICLES = 3000;
 
-// A particle
-struct particle {
-  vec3 position = vec3(0, 0, 0);
-  vec3 velocity = vec3(0, 0, 0);
-};
-
-// Particles in the system
-particle particles[MAX_PARTICLES];
-
-// The transform feedback buffers
-GLuint transform_feedbacks[2];
-// The particle buffers
-GLuint particle_buffers_vbo[2];
-
-GLuint vao;
-
-// Effects
-effect eff;
-effect particle_eff;
-
-// Current buffer to perform the physics update to
-unsigned int front_buf = 0;
-// Buffer to render to
-unsigned int back_buf = 1;
+// Transform feedback particle system
+unique_ptr<tf_particle_system> particles;
 
 target_camera cam;
 
@@ -42,58 +21,25 @@ bool initialise() {
 }
 
 bool load_content() {
-  default_random_engine rand(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
-  uniform_real_distribution<float> dist;
-
-  // Initilise particles
-  for (unsigned int i = 0; i < MAX_PARTICLES; ++i) {
-    particles[i].position = vec3(((10.0f * dist(rand)) - 5.0f), 0.0f, 0.0f);
-    particles[i].velocity = vec3(0.0f, 0.1f + dist(rand), 0.0f);
-  }
-
-  // Build effects
-  eff.add_shader("shaders/basic_colour.vert", GL_VERTEX_SHADER);
-  eff.add_shader("shaders/basic_colour.frag", GL_FRAGMENT_SHADER);
-  eff.build();
-
-  particle_eff.add_shader("66_Particle_System/particle.vert", GL_VERTEX_SHADER);
-  particle_eff.add_shader("66_Particle_System/particle.geom", GL_GEOMETRY_SHADER);
-  particle_eff.add_shader("66_Particle_System/particle.frag", GL_FRAGMENT_SHADER);
-  particle_eff.build();
-
-  // Use the particle effect
-  renderer::bind(particle_eff);
-  // Tell OpenGL what the output looks like
-  const GLchar *attrib_names[2] = {"position_out", "velocity_out"};
-  glTransformFeedbackVaryings(particle_eff.get_program(), 2, attrib_names, GL_INTERLEAVED_ATTRIBS);
-
-  // Relink program
-  glLinkProgram(particle_eff.get_program());
-
-  // a useless vao, but we need it bound or we get errors.
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  // Gen our VBO data buffers
-  glGenBuffers(2, particle_buffers_vbo);
-  // *********************************
-  // Place initial particle data in buffer 1
-  glBindBuffer(GL_ARRAY_BUFFER, particle_buffers_vbo[0]);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(particle) * MAX_PARTICLES, particles, GL_DYNAMIC_DRAW);
-
-  // Fill space with blank data in buffer 2
-  glBindBuffer(GL_ARRAY_BUFFER, particle_buffers_vbo[1]);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(particle) * MAX_PARTICLES, 0, GL_DYNAMIC_DRAW);
-
-  // generate our feedback objects
-  glGenTransformFeedbacks(2, transform_feedbacks);
-  // link fb[0] to vbo[1]
-  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks[0]);
-  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particle_buffers_vbo[1]);
-  // *********************************
-  // link fb[1] to vbo[0]
-  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks[1]);
-  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particle_buffers_vbo[0]);
+  particles = unique_ptr<tf_particle_system>(new tf_particle_system(MAX_PARTICLES));
+
+  // Particles rise from a line along x and die near the top
+  particle_emitter emitter;
+  emitter.extents = vec3(5.0f, 0.0f, 0.0f);
+  emitter.velocity = vec3(0.0f, 0.6f, 0.0f);
+  emitter.velocity_jitter = vec3(0.0f, 0.5f, 0.0f);
+  emitter.lifetime = 5.0f;
+  emitter.lifetime_jitter = 3.0f;
+  // Replace particles as fast as they die on average
+  emitter.rate = MAX_PARTICLES / (emitter.lifetime + emitter.lifetime_jitter * 0.5f);
+  particles->set_emitter(emitter);
+
+  // A floor and a ball in the middle of the fountain
+  particle_colliders colliders;
+  colliders.planes.push_back(vec4(0.0f, 1.0f, 0.0f, 0.0f));
+  colliders.spheres.push_back(vec4(0.0f, 2.5f, 0.0f, 1.0f));
+  colliders.bounce = 0.5f;
+  particles->set_colliders(colliders);
 
   renderer::setClearColour(0, 0, 0);
 
@@ -105,85 +51,32 @@ bool load_content() {
 }
 
 bool update(float delta_time) {
-  static bool first_frame = true;
-  renderer::bind(particle_eff);
-  glUniform1f(particle_eff.get_uniform_location("delta_time"), delta_time);
+  particles->update(delta_time);
+
+  // Report the stream query counters every few seconds
+  static float report_time = 0.0f;
+  report_time += delta_time;
+  if (report_time > 2.0f) {
+    cout << "Live particles: " << particles->get_live_count() << ", dropped: " << particles->get_overflow_count()
+         << endl;
+    report_time = 0.0f;
+  }
 
   // Update the camera
   cam.update(delta_time);
   return true;
 }
 
-void render_feeback() {
-  static bool first_frame = true;
-  renderer::bind(particle_eff);
-
-  // Close down the output
-  glEnable(GL_RASTERIZER_DISCARD);
-
-  glBindBuffer(GL_ARRAY_BUFFER, particle_buffers_vbo[front_buf]);
-  {
-    // unfortunatly we can't save this stuff in the VAO. Because OGL.
-    GLint position_in_loc = glGetAttribLocation(particle_eff.get_program(), "position_in");
-    GLint velocity_in_loc = glGetAttribLocation(particle_eff.get_program(), "velocity_in");
-    glEnableVertexAttribArray(position_in_loc);
-    glEnableVertexAttribArray(velocity_in_loc);
-    glVertexAttribPointer(position_in_loc, 3, GL_FLOAT, GL_FALSE, sizeof(particle), (const GLvoid *)0);
-    glVertexAttribPointer(velocity_in_loc, 3, GL_FLOAT, GL_FALSE, sizeof(particle), (const GLvoid *)12);
-  }
-
-  // Tell openGL that we are rendering to feedback
-  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks[front_buf]);
-  glBeginTransformFeedback(GL_POINTS);
-
-  if (first_frame) {
-    // compute our points from teh VBO like normal
-    glDrawArrays(GL_POINTS, 0, MAX_PARTICLES);
-    first_frame = false;
-  } else {
-    // compute from feedback data
-    glDrawTransformFeedback(GL_POINTS, transform_feedbacks[back_buf]);
-  }
-  // Note: the above doesn't actually render, it saves data into either vbo 0/1.
-
-  // stop feedback recording.
-  glEndTransformFeedback();
-
-  // reenable output
-  glDisable(GL_RASTERIZER_DISCARD);
-}
-
 bool render() {
-  render_feeback();
-
-  // Bind the effect
-  renderer::bind(eff);
-  // Set the MVP matrix
+  // Create MVP matrix
   auto M = mat4(1.0f);
   auto V = cam.get_view();
   auto P = cam.get_projection();
   auto MVP = P * V * M;
-  glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-  // Set the colour uniform
-  glUniform4fv(eff.get_uniform_location("colour"), 1, value_ptr(vec4(1.0f)));
-
-  // Bind the back particle buffer for rendering
-  glBindBuffer(GL_ARRAY_BUFFER, particle_buffers_vbo[front_buf]);
-
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(particle), 0);
-
-  // Perform the render by drawing the transform feedback
-  glDrawTransformFeedback(GL_POINTS, transform_feedbacks[front_buf]);
-  // Disable vertex attribute array
-  glDisableVertexAttribArray(0);
-
-  // *********************************
-  // Swap front and back buffers
-  glBindBuffer(GL_ARRAY_BUFFER, particle_buffers_vbo[back_buf]);
-  front_buf = back_buf;
-  back_buf = (back_buf + 1) % 2;
-  // *********************************
+
+  // Draws however many particles the last update captured
+  particles->render(MVP, vec4(1.0f));
+  glUseProgram(0);
   return true;
 }
 
@@ -200,4 +93,4 @@ void main() {
   application.set_render(render);
   // Run application
   application.run();
-}
\ No newline at end of file
+}
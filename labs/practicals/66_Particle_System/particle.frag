@@ -1,6 +0,0 @@
-#version 410
-
-void main()
-{
-    // Does nothing
-}
\ No newline at end of file
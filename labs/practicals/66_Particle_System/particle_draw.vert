@@ -0,0 +1,25 @@
+#version 410
+
+// Transformation matrix
+uniform mat4 MVP;
+
+// Incoming position (xyz) and age (w)
+layout (location = 0) in vec4 position_in;
+// Incoming velocity (xyz) and lifetime (w)
+layout (location = 1) in vec4 velocity_in;
+
+// Outgoing fraction of lifetime remaining
+layout (location = 0) out float life_left;
+
+void main()
+{
+    if (velocity_in.w < 0.0)
+    {
+        // Launchers aren't drawn, put them outside the clip volume
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        life_left = 0.0;
+        return;
+    }
+    gl_Position = MVP * vec4(position_in.xyz, 1.0);
+    life_left = 1.0 - position_in.w / velocity_in.w;
+}
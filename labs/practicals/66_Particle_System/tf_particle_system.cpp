@@ -0,0 +1,178 @@
+#include "tf_particle_system.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+using namespace graphics_framework;
+
+// New particles each launcher can emit per update, must match particle.geom
+static const unsigned int EMIT_PER_LAUNCHER = 32;
+
+// A particle as stored in the buffers and captured by transform feedback
+struct tf_particle {
+  // Position (xyz) and age (w)
+  vec4 position;
+  // Velocity (xyz) and lifetime (w).  Launchers have a negative lifetime and their index in x
+  vec4 velocity;
+};
+
+tf_particle_system::tf_particle_system(unsigned int capacity)
+    : _capacity(capacity), _launchers(std::max((capacity / 8 + EMIT_PER_LAUNCHER - 1) / EMIT_PER_LAUNCHER, 1u)) {
+  _simulate_eff.add_shader("66_Particle_System/particle.vert", GL_VERTEX_SHADER);
+  _simulate_eff.add_shader(vector<string>{"66_Particle_System/particle.geom", "shaders/part_collision.glsl"},
+                           GL_GEOMETRY_SHADER);
+  _simulate_eff.build();
+  // Captured outputs have to be declared before linking, so link again.  This
+  // only happens once
+  const GLchar *varyings[2] = {"position_out", "velocity_out"};
+  glTransformFeedbackVaryings(_simulate_eff.get_program(), 2, varyings, GL_INTERLEAVED_ATTRIBS);
+  glLinkProgram(_simulate_eff.get_program());
+  _draw_eff.add_shader("66_Particle_System/particle_draw.vert", GL_VERTEX_SHADER);
+  _draw_eff.add_shader("66_Particle_System/particle_draw.frag", GL_FRAGMENT_SHADER);
+  _draw_eff.build();
+
+  // Launchers are drawn from their own buffer every update and never captured
+  vector<tf_particle> launchers(_launchers);
+  for (unsigned int i = 0; i < _launchers; ++i) {
+    launchers[i].position = vec4(0.0f);
+    launchers[i].velocity = vec4(static_cast<float>(i), 0.0f, 0.0f, -1.0f);
+  }
+  const GLsizeiptr size = sizeof(tf_particle) * _capacity;
+
+  glGenBuffers(2, _buffers);
+  glGenVertexArrays(2, _vaos);
+  glGenTransformFeedbacks(2, _feedbacks);
+  for (unsigned int i = 0; i < 2; ++i) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buffers[i]);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    // The vertex format never changes, so each buffer gets a vertex array once
+    glBindVertexArray(_vaos[i]);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(tf_particle), (const GLvoid *)0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(tf_particle), (const GLvoid *)sizeof(vec4));
+    // Updates reading the other buffer write to this one
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, _feedbacks[i]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _buffers[i]);
+  }
+  glGenBuffers(1, &_launcher_buffer);
+  glGenVertexArrays(1, &_launcher_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, _launcher_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(tf_particle) * _launchers, launchers.data(), GL_STATIC_DRAW);
+  glBindVertexArray(_launcher_vao);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(tf_particle), (const GLvoid *)0);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(tf_particle), (const GLvoid *)sizeof(vec4));
+  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glGenQueries(QUERY_FRAMES, _written_queries);
+  glGenQueries(QUERY_FRAMES, _generated_queries);
+}
+
+void tf_particle_system::set_emitter(const particle_emitter &emitter) {
+  _emitter = emitter;
+  _emitter_dirty = true;
+}
+
+void tf_particle_system::set_acceleration(const vec3 &acceleration) {
+  _acceleration = acceleration;
+  _emitter_dirty = true;
+}
+
+void tf_particle_system::set_colliders(const particle_colliders &colliders) {
+  _colliders = colliders;
+  _colliders_dirty = true;
+}
+
+void tf_particle_system::read_queries() {
+  // Nothing to read until the ring has gone round once
+  if (_frame < QUERY_FRAMES) {
+    return;
+  }
+  const unsigned int slot = _frame % QUERY_FRAMES;
+  GLuint available = 0;
+  glGetQueryObjectuiv(_generated_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == 0) {
+    return;
+  }
+  GLuint written = 0, generated = 0;
+  glGetQueryObjectuiv(_written_queries[slot], GL_QUERY_RESULT, &written);
+  glGetQueryObjectuiv(_generated_queries[slot], GL_QUERY_RESULT, &generated);
+  _live_count = written;
+  _overflow_count = generated - written;
+}
+
+void tf_particle_system::update(float delta_time) {
+  renderer::bind(_simulate_eff);
+
+  // Launchers emit up to EMIT_PER_LAUNCHER each.  Anything over the capacity,
+  // the oldest survivors at the end of the capture, is dropped by transform
+  // feedback and shows up in the overflow count
+  const float wanted = _emitter.rate * delta_time + _emit_remainder;
+  const GLuint emit_count = std::min(static_cast<GLuint>(wanted), _launchers * EMIT_PER_LAUNCHER);
+  _emit_remainder = std::min(wanted - static_cast<float>(emit_count), 1.0f);
+  glUniform1f(_simulate_eff.get_uniform_location("delta_time"), delta_time);
+  glUniform1ui(_simulate_eff.get_uniform_location("emit_count"), emit_count);
+  glUniform1ui(_simulate_eff.get_uniform_location("seed"), _frame);
+
+  // Uniforms keep their values in the program, so only send what has changed
+  if (_emitter_dirty) {
+    glUniform3fv(_simulate_eff.get_uniform_location("emitter_position"), 1, value_ptr(_emitter.position));
+    glUniform3fv(_simulate_eff.get_uniform_location("emitter_extents"), 1, value_ptr(_emitter.extents));
+    glUniform3fv(_simulate_eff.get_uniform_location("emitter_velocity"), 1, value_ptr(_emitter.velocity));
+    glUniform3fv(_simulate_eff.get_uniform_location("velocity_jitter"), 1, value_ptr(_emitter.velocity_jitter));
+    glUniform1f(_simulate_eff.get_uniform_location("lifetime"), _emitter.lifetime);
+    glUniform1f(_simulate_eff.get_uniform_location("lifetime_jitter"), _emitter.lifetime_jitter);
+    glUniform3fv(_simulate_eff.get_uniform_location("acceleration"), 1, value_ptr(_acceleration));
+    _emitter_dirty = false;
+  }
+  // Textures aren't part of the program, so texture colliders are bound every update
+  if (_colliders_dirty || _colliders.heightmap != 0 || _colliders.depth != 0) {
+    bind_colliders(_simulate_eff, _colliders, 0);
+    _colliders_dirty = false;
+  }
+
+  read_queries();
+  const unsigned int slot = _frame % QUERY_FRAMES;
+
+  // Capture the launchers' new particles, then the current buffer's survivors, into the other buffer
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, _feedbacks[1 - _current]);
+  glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, _written_queries[slot]);
+  glBeginQuery(GL_PRIMITIVES_GENERATED, _generated_queries[slot]);
+  glBeginTransformFeedback(GL_POINTS);
+  glBindVertexArray(_launcher_vao);
+  glDrawArrays(GL_POINTS, 0, _launchers);
+  if (_first_update) {
+    _first_update = false;
+  } else {
+    glBindVertexArray(_vaos[_current]);
+    glDrawTransformFeedback(GL_POINTS, _feedbacks[_current]);
+  }
+  glEndTransformFeedback();
+  glEndQuery(GL_PRIMITIVES_GENERATED);
+  glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+  glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+  glBindVertexArray(0);
+  glDisable(GL_RASTERIZER_DISCARD);
+
+  _current = 1 - _current;
+  ++_frame;
+}
+
+void tf_particle_system::render(const mat4 &MVP, const vec4 &colour) {
+  // Nothing has been captured yet
+  if (_first_update) {
+    return;
+  }
+  renderer::bind(_draw_eff);
+  glUniformMatrix4fv(_draw_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+  glUniform4fv(_draw_eff.get_uniform_location("colour"), 1, value_ptr(colour));
+  // The count comes straight from the last update's transform feedback
+  glBindVertexArray(_vaos[_current]);
+  glDrawTransformFeedback(GL_POINTS, _feedbacks[_current]);
+  glBindVertexArray(0);
+}
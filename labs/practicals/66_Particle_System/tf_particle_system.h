@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../67_Compute_Shader/cpu_particle_system.h"
+#include "../67_Compute_Shader/particle_collision.h"
+#include <graphics_framework.h>
+
+// Transform feedback particle system.  Particles live in two vertex buffers that
+// are ping-ponged through a geometry shader every update.  The shader kills
+// particles that reach the end of their life by not emitting them, and a few
+// launcher points, drawn from a buffer of their own at the start of every
+// update, emit new ones.  Launchers are never captured, so a full pool can't
+// drop them.  Every draw takes its count from the transform feedback object,
+// so the CPU never reads it back.
+class tf_particle_system {
+public:
+  // Creates the buffers, vertex arrays and shaders.  Requires a GL 4.0 context
+  explicit tf_particle_system(unsigned int capacity);
+  tf_particle_system(const tf_particle_system &) = delete;
+  tf_particle_system &operator=(const tf_particle_system &) = delete;
+
+  // Gets the maximum number of live particles
+  unsigned int capacity() const { return _capacity; }
+
+  // Gets / sets the emitter used to spawn particles
+  const particle_emitter &get_emitter() const { return _emitter; }
+  void set_emitter(const particle_emitter &emitter);
+  // Gets / sets the constant acceleration applied to all particles
+  const glm::vec3 &get_acceleration() const { return _acceleration; }
+  void set_acceleration(const glm::vec3 &acceleration);
+  // Gets / sets the colliders particles bounce off while simulating
+  const particle_colliders &get_colliders() const { return _colliders; }
+  void set_colliders(const particle_colliders &colliders);
+
+  // Spawns, simulates and kills particles
+  void update(float delta_time);
+  // Draws the live particles as points using the given transform and colour
+  void render(const glm::mat4 &MVP, const glm::vec4 &colour);
+
+  // Profiling counters from the stream queries of a recent update.  They lag a
+  // few frames behind so reading them never stalls
+  unsigned int get_live_count() const { return _live_count; }
+  // Particles generated that didn't fit in the buffer, non-zero when the pool is exhausted
+  unsigned int get_overflow_count() const { return _overflow_count; }
+
+private:
+  // Updates in flight before their queries are read
+  static const unsigned int QUERY_FRAMES = 3;
+
+  void read_queries();
+
+  unsigned int _capacity;
+  // Launcher points, in their own buffer and vertex array
+  unsigned int _launchers;
+  GLuint _launcher_buffer;
+  GLuint _launcher_vao;
+  // Ping-pong particle buffers, each with its own vertex array and feedback object
+  GLuint _buffers[2];
+  GLuint _vaos[2];
+  GLuint _feedbacks[2];
+  // Buffer holding the current particles
+  unsigned int _current = 0;
+  // Set until the first update, before which neither buffer holds particles
+  bool _first_update = true;
+
+  graphics_framework::effect _simulate_eff;
+  graphics_framework::effect _draw_eff;
+
+  particle_emitter _emitter;
+  glm::vec3 _acceleration = glm::vec3(0.0f);
+  particle_colliders _colliders;
+  // Uniforms that only change when set are only sent when dirty
+  bool _emitter_dirty = true;
+  bool _colliders_dirty = true;
+  // Fractional particles carried between frames when rate * delta_time is not whole
+  float _emit_remainder = 0.0f;
+  unsigned int _frame = 0;
+
+  // Primitives written and generated per update, read QUERY_FRAMES later
+  GLuint _written_queries[QUERY_FRAMES];
+  GLuint _generated_queries[QUERY_FRAMES];
+  unsigned int _live_count = 0;
+  unsigned int _overflow_count = 0;
+};
@@ -1,5 +1,7 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "gpu_particle_system.h"
+#include "ring_buffer.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -9,55 +11,89 @@ using namespace glm;
 // Maximum number of particles
 const unsigned int MAX_PARTICLES = 2 << 11;
 
-vec4 positions[MAX_PARTICLES];
-vec4 velocitys[MAX_PARTICLES];
+// Compute shader particle pool
+unique_ptr<gpu_particle_system> gpu_particles;
+// Positions are streamed through this when simulating on the CPU
+unique_ptr<ring_buffer> position_ring;
 
-GLuint G_Position_buffer, G_Velocity_buffer;
+// Particle count used when compute shaders aren't available and the simulation runs on the CPU
+const unsigned int CPU_MAX_PARTICLES = 1 << 20;
+// Set when the CPU fallback is in use
+bool use_cpu = false;
+unique_ptr<cpu_particle_system> cpu_particles;
 
 effect eff;
-effect compute_eff;
 target_camera cam;
 GLuint vao;
 
-bool load_content() {
-	cout << "Generating " << MAX_PARTICLES << " Particles" << endl;
+// Sets up the CPU simulation and the buffer its positions are streamed into
+void load_cpu_particles() {
 	default_random_engine rand(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
 	uniform_real_distribution<float> dist;
 
-	// Initilise particles
-	for (unsigned int i = 0; i < MAX_PARTICLES; ++i) {
-		positions[i] = vec4(((14.0f * dist(rand)) - 7.0f), 8.0f * dist(rand), 0.0f, 0.0f);
-		velocitys[i] = vec4(0.0f, 0.1f + (2.0f * dist(rand)), 0.0f, 0.0f);
+	cpu_particles = unique_ptr<cpu_particle_system>(new cpu_particle_system(CPU_MAX_PARTICLES, CPU_MAX_PARTICLES));
+	cout << "Compute shaders not supported, simulating " << CPU_MAX_PARTICLES << " particles on the CPU ("
+		<< cpu_particle_system::get_kernel_name() << ", " << cpu_particles->get_thread_count() << " threads)" << endl;
+
+	// Particles rise from a line along x, like the GPU version
+	particle_emitter emitter;
+	emitter.extents = vec3(7.0f, 0.0f, 0.0f);
+	emitter.velocity = vec3(0.0f, 1.1f, 0.0f);
+	emitter.velocity_jitter = vec3(0.0f, 1.0f, 0.0f);
+	emitter.lifetime = 4.0f;
+	emitter.lifetime_jitter = 3.0f;
+	// Replace particles as fast as they die on average
+	emitter.rate = CPU_MAX_PARTICLES / (emitter.lifetime + emitter.lifetime_jitter * 0.5f);
+	cpu_particles->set_emitter(emitter);
+
+	// Start with the whole column filled, each particle dying when it reaches the top
+	for (unsigned int i = 0; i < CPU_MAX_PARTICLES; ++i) {
+		particle_spawn spawn;
+		spawn.position = vec3((14.0f * dist(rand)) - 7.0f, 8.0f * dist(rand), 0.0f);
+		spawn.velocity = vec3(0.0f, 0.1f + (2.0f * dist(rand)), 0.0f);
+		spawn.lifetime = (8.0f - spawn.position.y) / spawn.velocity.y;
+		cpu_particles->emit(spawn);
 	}
 
+	// Room for every particle's position in each frame in flight
+	position_ring = unique_ptr<ring_buffer>(new ring_buffer(sizeof(vec4) * CPU_MAX_PARTICLES));
+}
+
+bool load_content() {
 	// Load in shaders
 	eff.add_shader("shaders/basic_colour.vert", GL_VERTEX_SHADER);
 	eff.add_shader("shaders/basic_colour.frag", GL_FRAGMENT_SHADER);
 	eff.build();
-	// Load in shaders
-	compute_eff.add_shader("67_Compute_Shader/particle.comp", GL_COMPUTE_SHADER);
-	compute_eff.build();
 
 	// a useless vao, but we need it bound or we get errors.
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
-	// *********************************
-	 //Generate Position Data buffer
-	glGenBuffers(1, &G_Position_buffer);
-	// Bind as GL_SHADER_STORAGE_BUFFER
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, G_Position_buffer);
-	// Send Data to GPU, use GL_DYNAMIC_DRAW
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec4) * MAX_PARTICLES, positions, GL_DYNAMIC_DRAW);
-
-	// Generate Velocity Data buffer
-	glGenBuffers(1, &G_Velocity_buffer);
-	// Bind as GL_SHADER_STORAGE_BUFFER
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, G_Velocity_buffer);
-	// Send Data to GPU, use GL_DYNAMIC_DRAW
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec4) * MAX_PARTICLES, velocitys, GL_DYNAMIC_DRAW);
-	// *********************************
-	 //Unbind
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Fall back to simulating on the CPU if compute shaders aren't supported
+	use_cpu = !(GLEW_VERSION_4_3 || GLEW_ARB_compute_shader);
+	if (use_cpu) {
+		load_cpu_particles();
+	} else {
+		cout << "Generating a pool of " << MAX_PARTICLES << " Particles" << endl;
+		gpu_particles = unique_ptr<gpu_particle_system>(new gpu_particle_system(MAX_PARTICLES));
+		// Particles rise from a line along x and die at the top of the box
+		particle_emitter emitter;
+		emitter.extents = vec3(7.0f, 0.0f, 0.0f);
+		emitter.velocity = vec3(0.0f, 1.1f, 0.0f);
+		emitter.velocity_jitter = vec3(0.0f, 1.0f, 0.0f);
+		emitter.lifetime = 4.0f;
+		emitter.lifetime_jitter = 3.0f;
+		// Slightly faster than particles die on average, so the pool stays close to full
+		emitter.rate = 1.2f * MAX_PARTICLES / (emitter.lifetime + emitter.lifetime_jitter * 0.5f);
+		gpu_particles->set_emitter(emitter);
+		gpu_particles->set_bounds(vec3(7.0f, 8.0f, 5.0f));
+		// A ball and a shelf for the column to flow around
+		particle_colliders colliders;
+		colliders.spheres.push_back(vec4(-2.0f, 4.0f, 0.0f, 1.5f));
+		colliders.boxes.push_back(make_pair(vec3(2.0f, 2.5f, -1.0f), vec3(5.0f, 3.0f, 1.0f)));
+		colliders.bounce = 0.2f;
+		gpu_particles->set_colliders(colliders);
+	}
 
 	renderer::setClearColour(0, 0, 0);
 
@@ -69,9 +105,11 @@ bool load_content() {
 }
 
 bool update(float delta_time) {
-	renderer::bind(compute_eff);
-	glUniform1f(compute_eff.get_uniform_location("delta_time"), delta_time);
-	glUniform3fv(compute_eff.get_uniform_location("max_dims"), 1, value_ptr(vec3(7.0f, 8.0f, 5.0f)));
+	if (use_cpu) {
+		cpu_particles->update(delta_time);
+	} else {
+		gpu_particles->update(delta_time);
+	}
 
 	// Update the camera
 	cam.update(delta_time);
@@ -79,36 +117,40 @@ bool update(float delta_time) {
 }
 
 bool render() {
-	// Bind Compute Shader
-	renderer::bind(compute_eff);
-	// Bind data as SSBO
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, G_Position_buffer);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, G_Velocity_buffer);
-	// Dispatch
-	glDispatchCompute(MAX_PARTICLES / 128, 1, 1);
-	// Sync, wait for completion
-	glMemoryBarrier(GL_ALL_BARRIER_BITS);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-	// Bind render effect
-	renderer::bind(eff);
 	// Create MVP matrix
 	mat4 M(1.0f);
 	auto V = cam.get_view();
 	auto P = cam.get_projection();
 	auto MVP = P * V * M;
+
+	// The pool draws only its live particles, with a count written on the GPU
+	if (!use_cpu) {
+		gpu_particles->render(MVP, vec4(1.0f));
+		glUseProgram(0);
+		return true;
+	}
+
+	// Write the new positions straight into this frame's part of the ring
+	position_ring->begin_frame();
+	auto count = static_cast<GLsizei>(cpu_particles->size());
+	auto positions = position_ring->allocate(sizeof(vec4) * count, sizeof(vec4));
+	cpu_particles->copy_positions(static_cast<vec4 *>(positions.data));
+	position_ring->submit(positions);
+
+	// Bind render effect
+	renderer::bind(eff);
 	// Set the colour uniform
 	glUniform4fv(eff.get_uniform_location("colour"), 1, value_ptr(vec4(1.0f)));
 	// Set MVP matrix uniform
 	glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
 
-	// Bind position buffer as GL_ARRAY_BUFFER
-	glBindBuffer(GL_ARRAY_BUFFER, G_Position_buffer);
 	// Setup vertex format
+	glBindBuffer(GL_ARRAY_BUFFER, positions.buffer);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void *)0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void *>(positions.offset));
 	// Render
-	glDrawArrays(GL_POINTS, 0, MAX_PARTICLES);
+	glDrawArrays(GL_POINTS, 0, count);
+	position_ring->end_frame();
 	// Tidy up
 	glDisableVertexAttribArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -0,0 +1,289 @@
+#include "cpu_particle_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PARTICLE_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLE_SIMD_WIDTH 4
+#else
+#define PARTICLE_SIMD_WIDTH 1
+#endif
+
+using namespace std;
+using namespace glm;
+
+// Number of particles handed to a thread at a time.  Must be a multiple of the SIMD width
+static const size_t CHUNK_SIZE = 16384;
+// Arrays are padded and aligned to a cache line
+static const size_t ALIGNMENT = 64 / sizeof(float);
+
+static size_t round_up(size_t value, size_t multiple) { return ((value + multiple - 1) / multiple) * multiple; }
+
+worker_pool::worker_pool(unsigned int threads) : _next_chunk(0) {
+  if (threads == 0) {
+    threads = std::max(thread::hardware_concurrency(), 1u);
+  }
+  // The calling thread is one of the threads
+  for (unsigned int i = 1; i < threads; ++i) {
+    _workers.push_back(thread(&worker_pool::worker_loop, this));
+  }
+}
+
+worker_pool::~worker_pool() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _quit = true;
+  }
+  _start.notify_all();
+  for (auto &t : _workers) {
+    t.join();
+  }
+}
+
+void worker_pool::parallel_for(size_t count, size_t grain, const range_function &func) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  // Not worth waking the workers for a single chunk
+  if (_workers.empty() || count <= grain) {
+    for (size_t begin = 0; begin < count; begin += grain) {
+      func(begin, std::min(begin + grain, count));
+    }
+    return;
+  }
+
+  // Publish the job and wake the workers
+  {
+    lock_guard<mutex> lock(_mutex);
+    _func = &func;
+    _count = count;
+    _grain = grain;
+    _next_chunk = 0;
+    _busy = static_cast<unsigned int>(_workers.size());
+    ++_generation;
+  }
+  _start.notify_all();
+
+  // Help out, then wait for the workers to finish their last chunks
+  run_chunks();
+  unique_lock<mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _busy == 0; });
+  _func = nullptr;
+}
+
+void worker_pool::worker_loop() {
+  unsigned long long seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(_mutex);
+      _start.wait(lock, [this, seen] { return _quit || _generation != seen; });
+      if (_quit) {
+        return;
+      }
+      seen = _generation;
+    }
+    run_chunks();
+    {
+      lock_guard<mutex> lock(_mutex);
+      if (--_busy == 0) {
+        _done.notify_one();
+      }
+    }
+  }
+}
+
+void worker_pool::run_chunks() {
+  const size_t chunks = (_count + _grain - 1) / _grain;
+  for (size_t chunk = _next_chunk++; chunk < chunks; chunk = _next_chunk++) {
+    const size_t begin = chunk * _grain;
+    (*_func)(begin, std::min(begin + _grain, _count));
+  }
+}
+
+// Semi-implicit Euler step for particles [begin, end).  begin and end are multiples
+// of the SIMD width and every array is aligned, so no scalar tail is needed.
+static void integrate(float *px, float *py, float *pz, float *vx, float *vy, float *vz, float *age,
+                      const vec3 &acceleration, float delta_time, size_t begin, size_t end) {
+#if PARTICLE_SIMD_WIDTH == 8
+  const __m256 dt = _mm256_set1_ps(delta_time);
+  const __m256 ax = _mm256_set1_ps(acceleration.x * delta_time);
+  const __m256 ay = _mm256_set1_ps(acceleration.y * delta_time);
+  const __m256 az = _mm256_set1_ps(acceleration.z * delta_time);
+  for (size_t i = begin; i < end; i += 8) {
+    __m256 x = _mm256_add_ps(_mm256_load_ps(vx + i), ax);
+    __m256 y = _mm256_add_ps(_mm256_load_ps(vy + i), ay);
+    __m256 z = _mm256_add_ps(_mm256_load_ps(vz + i), az);
+    _mm256_store_ps(vx + i, x);
+    _mm256_store_ps(vy + i, y);
+    _mm256_store_ps(vz + i, z);
+    _mm256_store_ps(px + i, _mm256_add_ps(_mm256_load_ps(px + i), _mm256_mul_ps(x, dt)));
+    _mm256_store_ps(py + i, _mm256_add_ps(_mm256_load_ps(py + i), _mm256_mul_ps(y, dt)));
+    _mm256_store_ps(pz + i, _mm256_add_ps(_mm256_load_ps(pz + i), _mm256_mul_ps(z, dt)));
+    _mm256_store_ps(age + i, _mm256_add_ps(_mm256_load_ps(age + i), dt));
+  }
+#elif PARTICLE_SIMD_WIDTH == 4
+  const __m128 dt = _mm_set1_ps(delta_time);
+  const __m128 ax = _mm_set1_ps(acceleration.x * delta_time);
+  const __m128 ay = _mm_set1_ps(acceleration.y * delta_time);
+  const __m128 az = _mm_set1_ps(acceleration.z * delta_time);
+  for (size_t i = begin; i < end; i += 4) {
+    __m128 x = _mm_add_ps(_mm_load_ps(vx + i), ax);
+    __m128 y = _mm_add_ps(_mm_load_ps(vy + i), ay);
+    __m128 z = _mm_add_ps(_mm_load_ps(vz + i), az);
+    _mm_store_ps(vx + i, x);
+    _mm_store_ps(vy + i, y);
+    _mm_store_ps(vz + i, z);
+    _mm_store_ps(px + i, _mm_add_ps(_mm_load_ps(px + i), _mm_mul_ps(x, dt)));
+    _mm_store_ps(py + i, _mm_add_ps(_mm_load_ps(py + i), _mm_mul_ps(y, dt)));
+    _mm_store_ps(pz + i, _mm_add_ps(_mm_load_ps(pz + i), _mm_mul_ps(z, dt)));
+    _mm_store_ps(age + i, _mm_add_ps(_mm_load_ps(age + i), dt));
+  }
+#else
+  const vec3 dv = acceleration * delta_time;
+  for (size_t i = begin; i < end; ++i) {
+    vx[i] += dv.x;
+    vy[i] += dv.y;
+    vz[i] += dv.z;
+    px[i] += vx[i] * delta_time;
+    py[i] += vy[i] * delta_time;
+    pz[i] += vz[i] * delta_time;
+    age[i] += delta_time;
+  }
+#endif
+}
+
+const char *cpu_particle_system::get_kernel_name() {
+#if PARTICLE_SIMD_WIDTH == 8
+  return "AVX";
+#elif PARTICLE_SIMD_WIDTH == 4
+  return "SSE";
+#else
+  return "scalar";
+#endif
+}
+
+cpu_particle_system::cpu_particle_system(size_t capacity, size_t spawn_queue, unsigned int threads)
+    : _capacity(capacity), _queue(std::max<size_t>(spawn_queue, 1)),
+      _rand(static_cast<unsigned int>(chrono::system_clock::now().time_since_epoch().count())), _pool(threads) {
+  // Pad every array so the SIMD kernel can run past the last live particle
+  const size_t stride = round_up(std::max<size_t>(capacity, 1), std::max<size_t>(ALIGNMENT, PARTICLE_SIMD_WIDTH));
+  _storage.assign(stride * 8 + ALIGNMENT, 0.0f);
+  auto base = reinterpret_cast<uintptr_t>(_storage.data());
+  auto aligned = reinterpret_cast<float *>(round_up(base, ALIGNMENT * sizeof(float)));
+  float **arrays[] = {&_px, &_py, &_pz, &_vx, &_vy, &_vz, &_age, &_life};
+  for (size_t i = 0; i < 8; ++i) {
+    *arrays[i] = aligned + i * stride;
+  }
+  _survivors.resize((stride + CHUNK_SIZE - 1) / CHUNK_SIZE);
+}
+
+bool cpu_particle_system::emit(const particle_spawn &spawn) {
+  if (_queue_size == _queue.size()) {
+    return false;
+  }
+  _queue[(_queue_head + _queue_size) % _queue.size()] = spawn;
+  ++_queue_size;
+  return true;
+}
+
+void cpu_particle_system::emit(size_t count) {
+  uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  uniform_real_distribution<float> life(0.0f, 1.0f);
+  for (size_t i = 0; i < count; ++i) {
+    particle_spawn spawn;
+    spawn.position = _emitter.position + _emitter.extents * vec3(dist(_rand), dist(_rand), dist(_rand));
+    spawn.velocity = _emitter.velocity + _emitter.velocity_jitter * vec3(dist(_rand), dist(_rand), dist(_rand));
+    spawn.lifetime = _emitter.lifetime + _emitter.lifetime_jitter * life(_rand);
+    if (!emit(spawn)) {
+      return;
+    }
+  }
+}
+
+void cpu_particle_system::spawn_queued() {
+  // Anything that doesn't fit stays queued for the next update
+  while (_queue_size > 0 && _count < _capacity) {
+    const particle_spawn &spawn = _queue[_queue_head];
+    _px[_count] = spawn.position.x;
+    _py[_count] = spawn.position.y;
+    _pz[_count] = spawn.position.z;
+    _vx[_count] = spawn.velocity.x;
+    _vy[_count] = spawn.velocity.y;
+    _vz[_count] = spawn.velocity.z;
+    _age[_count] = 0.0f;
+    _life[_count] = spawn.lifetime;
+    ++_count;
+    _queue_head = (_queue_head + 1) % _queue.size();
+    --_queue_size;
+  }
+}
+
+void cpu_particle_system::move_particle(size_t from, size_t to) {
+  _px[to] = _px[from];
+  _py[to] = _py[from];
+  _pz[to] = _pz[from];
+  _vx[to] = _vx[from];
+  _vy[to] = _vy[from];
+  _vz[to] = _vz[from];
+  _age[to] = _age[from];
+  _life[to] = _life[from];
+}
+
+void cpu_particle_system::update(float delta_time) {
+  // Queue particles from the emitter, carrying over any fraction of a particle
+  const float wanted = _emitter.rate * delta_time + _emit_remainder;
+  const size_t spawn_count = static_cast<size_t>(wanted);
+  _emit_remainder = wanted - static_cast<float>(spawn_count);
+  emit(spawn_count);
+  spawn_queued();
+  if (_count == 0) {
+    return;
+  }
+
+  // Integrate and compact each chunk in place.  Compaction within a chunk is
+  // stable, so live particles keep their relative order
+  const size_t count = _count;
+  _pool.parallel_for(round_up(count, PARTICLE_SIMD_WIDTH), CHUNK_SIZE, [&](size_t begin, size_t end) {
+    integrate(_px, _py, _pz, _vx, _vy, _vz, _age, _acceleration, delta_time, begin, end);
+    const size_t last = std::min(end, count);
+    size_t write = begin;
+    for (size_t read = begin; read < last; ++read) {
+      if (_age[read] < _life[read]) {
+        if (write != read) {
+          move_particle(read, write);
+        }
+        ++write;
+      }
+    }
+    _survivors[begin / CHUNK_SIZE] = write - begin;
+  });
+
+  // Slide each chunk's survivors down to close the gaps.  Destinations never
+  // pass their source, so walking the chunks in order is safe
+  float *arrays[] = {_px, _py, _pz, _vx, _vy, _vz, _age, _life};
+  size_t offset = 0;
+  for (size_t begin = 0; begin < count; begin += CHUNK_SIZE) {
+    const size_t survivors = _survivors[begin / CHUNK_SIZE];
+    if (offset != begin && survivors > 0) {
+      for (auto a : arrays) {
+        memmove(a + offset, a + begin, survivors * sizeof(float));
+      }
+    }
+    offset += survivors;
+  }
+  _count = offset;
+}
+
+void cpu_particle_system::copy_positions(vec4 *out) {
+  _pool.parallel_for(_count, CHUNK_SIZE, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      out[i] = vec4(_px[i], _py[i], _pz[i], _age[i] / _life[i]);
+    }
+  });
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads used to split a range of work into chunks.  The calling
+// thread takes part in the work, so a pool with no workers runs everything inline.
+class worker_pool {
+public:
+  // Function called for each chunk [begin, end) of a range
+  typedef std::function<void(size_t, size_t)> range_function;
+
+  // Creates a pool - zero threads means one per hardware thread minus the caller
+  explicit worker_pool(unsigned int threads = 0);
+  ~worker_pool();
+  worker_pool(const worker_pool &) = delete;
+  worker_pool &operator=(const worker_pool &) = delete;
+
+  // Number of threads taking part in a parallel_for, including the caller
+  unsigned int get_thread_count() const { return static_cast<unsigned int>(_workers.size()) + 1; }
+
+  // Runs func over [0, count) in chunks of grain elements.  Blocks until complete
+  void parallel_for(size_t count, size_t grain, const range_function &func);
+
+private:
+  void worker_loop();
+  void run_chunks();
+
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  // Current job
+  const range_function *_func = nullptr;
+  size_t _count = 0;
+  size_t _grain = 0;
+  std::atomic<size_t> _next_chunk;
+  // Incremented for every job so sleeping workers know there is new work
+  unsigned long long _generation = 0;
+  unsigned int _busy = 0;
+  bool _quit = false;
+};
+
+// Describes how new particles are spawned
+struct particle_emitter {
+  // Centre of the spawn box
+  glm::vec3 position = glm::vec3(0.0f);
+  // Half size of the spawn box
+  glm::vec3 extents = glm::vec3(0.0f);
+  // Base velocity of new particles
+  glm::vec3 velocity = glm::vec3(0.0f, 1.0f, 0.0f);
+  // Random velocity added on each axis, in the range [-jitter, jitter]
+  glm::vec3 velocity_jitter = glm::vec3(0.0f);
+  // Lifetime of new particles in seconds, plus random extra up to lifetime_jitter
+  float lifetime = 1.0f;
+  float lifetime_jitter = 0.0f;
+  // Particles spawned per second
+  float rate = 0.0f;
+};
+
+// A single spawn request waiting in the emitter ring buffer
+struct particle_spawn {
+  glm::vec3 position;
+  glm::vec3 velocity;
+  float lifetime;
+};
+
+// CPU particle simulation.  Particle data is stored as a structure of arrays so
+// the integrate kernel can work on 4 (SSE) or 8 (AVX) particles per instruction.
+// Live particles are always packed into [0, size()) in the order they were spawned.
+class cpu_particle_system {
+public:
+  // Creates a system holding up to capacity particles, with spawn_queue pending spawns
+  cpu_particle_system(size_t capacity, size_t spawn_queue = 1 << 16, unsigned int threads = 0);
+  cpu_particle_system(const cpu_particle_system &) = delete;
+  cpu_particle_system &operator=(const cpu_particle_system &) = delete;
+
+  // Gets the number of live particles
+  size_t size() const { return _count; }
+  // Gets the maximum number of live particles
+  size_t capacity() const { return _capacity; }
+  // Gets the number of threads used by update
+  unsigned int get_thread_count() const { return _pool.get_thread_count(); }
+  // Gets the name of the integrate kernel in use (AVX, SSE or scalar)
+  static const char *get_kernel_name();
+
+  // Gets / sets the emitter used to spawn particles every update
+  const particle_emitter &get_emitter() const { return _emitter; }
+  void set_emitter(const particle_emitter &emitter) { _emitter = emitter; }
+  // Gets / sets the constant acceleration applied to all particles
+  const glm::vec3 &get_acceleration() const { return _acceleration; }
+  void set_acceleration(const glm::vec3 &acceleration) { _acceleration = acceleration; }
+
+  // Queues a particle to be spawned at the start of the next update.  Returns
+  // false if the spawn queue is full
+  bool emit(const particle_spawn &spawn);
+  // Queues count particles from the emitter
+  void emit(size_t count);
+
+  // Spawns queued particles, integrates all live particles and removes the dead ones
+  void update(float delta_time);
+
+  // Writes live particle positions as (x, y, z, normalised age) into out, which
+  // must have room for size() elements
+  void copy_positions(glm::vec4 *out);
+
+  // Raw access to the particle arrays
+  const float *get_positions_x() const { return _px; }
+  const float *get_positions_y() const { return _py; }
+  const float *get_positions_z() const { return _pz; }
+  const float *get_ages() const { return _age; }
+  const float *get_lifetimes() const { return _life; }
+
+private:
+  void spawn_queued();
+  void move_particle(size_t from, size_t to);
+
+  size_t _capacity;
+  size_t _count = 0;
+  // Backing store for every array below, each one aligned to a cache line
+  std::vector<float> _storage;
+  float *_px, *_py, *_pz;
+  float *_vx, *_vy, *_vz;
+  float *_age, *_life;
+
+  // Spawn ring buffer
+  std::vector<particle_spawn> _queue;
+  size_t _queue_head = 0;
+  size_t _queue_size = 0;
+
+  particle_emitter _emitter;
+  // Fractional particles carried between updates when rate * delta_time is not whole
+  float _emit_remainder = 0.0f;
+  glm::vec3 _acceleration = glm::vec3(0.0f);
+  std::default_random_engine _rand;
+
+  // Survivors counted per chunk during update
+  std::vector<size_t> _survivors;
+  worker_pool _pool;
+};
@@ -0,0 +1,119 @@
+#include "gpu_particle_system.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+using namespace graphics_framework;
+
+// Threads per group in the emit and simulate shaders
+static const unsigned int GROUP_SIZE = 128;
+// Byte offset of the draw command in the indirect buffer
+static const GLintptr DRAW_COMMAND_OFFSET = 4 * sizeof(GLuint);
+
+gpu_particle_system::gpu_particle_system(unsigned int capacity) : _capacity(capacity) {
+  // Every compute shader is compiled after the shared pool layout
+  _emit_eff.add_shader(vector<string>{"67_Compute_Shader/particle_pool.comp", "67_Compute_Shader/particle_emit.comp"},
+                       GL_COMPUTE_SHADER);
+  _emit_eff.build();
+  _simulate_eff.add_shader(vector<string>{"67_Compute_Shader/particle_pool.comp", "shaders/part_collision.glsl",
+                                          "67_Compute_Shader/particle_simulate.comp"},
+                           GL_COMPUTE_SHADER);
+  _simulate_eff.build();
+  _args_eff.add_shader(vector<string>{"67_Compute_Shader/particle_pool.comp", "67_Compute_Shader/particle_args.comp"},
+                       GL_COMPUTE_SHADER);
+  _args_eff.build();
+  _draw_eff.add_shader("67_Compute_Shader/particle_draw.vert", GL_VERTEX_SHADER);
+  _draw_eff.add_shader("67_Compute_Shader/particle_draw.frag", GL_FRAGMENT_SHADER);
+  _draw_eff.build();
+
+  glGenBuffers(BUFFER_COUNT, _buffers);
+  // Particle data and alive lists start out undefined
+  for (auto b : {POSITIONS, VELOCITIES}) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffers[b]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec4) * capacity, nullptr, GL_DYNAMIC_COPY);
+  }
+  for (auto b : {ALIVE, NEXT_ALIVE}) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffers[b]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, nullptr, GL_DYNAMIC_COPY);
+  }
+  // Every particle starts out free
+  vector<GLuint> dead(capacity);
+  for (unsigned int i = 0; i < capacity; ++i) {
+    dead[i] = i;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffers[DEAD]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * capacity, dead.data(), GL_DYNAMIC_COPY);
+  // alive_count, next_alive_count, dead_count
+  GLuint counters[3] = {0, 0, capacity};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffers[COUNTERS]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_COPY);
+  // Dispatch command then draw command
+  GLuint commands[8] = {0, 1, 1, 0, 0, 1, 0, 0};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffers[INDIRECT]);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(commands), commands, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void gpu_particle_system::bind_buffers() {
+  for (GLuint i = 0; i < BUFFER_COUNT; ++i) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, _buffers[i]);
+  }
+}
+
+void gpu_particle_system::update(float delta_time) {
+  bind_buffers();
+
+  // Spawn from the dead list.  The count is only an upper bound, threads give up
+  // when the pool is empty
+  const float wanted = _emitter.rate * delta_time + _emit_remainder;
+  const GLuint emit_count = std::min(static_cast<GLuint>(wanted), _capacity);
+  _emit_remainder = wanted - static_cast<float>(static_cast<GLuint>(wanted));
+  if (emit_count > 0) {
+    renderer::bind(_emit_eff);
+    glUniform1ui(_emit_eff.get_uniform_location("emit_count"), emit_count);
+    glUniform1ui(_emit_eff.get_uniform_location("seed"), ++_frame);
+    glUniform3fv(_emit_eff.get_uniform_location("emitter_position"), 1, value_ptr(_emitter.position));
+    glUniform3fv(_emit_eff.get_uniform_location("emitter_extents"), 1, value_ptr(_emitter.extents));
+    glUniform3fv(_emit_eff.get_uniform_location("emitter_velocity"), 1, value_ptr(_emitter.velocity));
+    glUniform3fv(_emit_eff.get_uniform_location("velocity_jitter"), 1, value_ptr(_emitter.velocity_jitter));
+    glUniform1f(_emit_eff.get_uniform_location("lifetime"), _emitter.lifetime);
+    glUniform1f(_emit_eff.get_uniform_location("lifetime_jitter"), _emitter.lifetime_jitter);
+    glDispatchCompute((emit_count + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+
+  // Size the simulate dispatch from the live count
+  renderer::bind(_args_eff);
+  glUniform1i(_args_eff.get_uniform_location("stage"), 0);
+  glDispatchCompute(1, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+  // Simulate live particles only
+  renderer::bind(_simulate_eff);
+  glUniform1f(_simulate_eff.get_uniform_location("delta_time"), delta_time);
+  glUniform3fv(_simulate_eff.get_uniform_location("acceleration"), 1, value_ptr(_acceleration));
+  glUniform3fv(_simulate_eff.get_uniform_location("max_dims"), 1, value_ptr(_bounds));
+  bind_colliders(_simulate_eff, _colliders, 0);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, _buffers[INDIRECT]);
+  glDispatchComputeIndirect(0);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  // Survivors become the live list and size the draw
+  renderer::bind(_args_eff);
+  glUniform1i(_args_eff.get_uniform_location("stage"), 1);
+  glDispatchCompute(1, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+  swap(_buffers[ALIVE], _buffers[NEXT_ALIVE]);
+}
+
+void gpu_particle_system::render(const mat4 &MVP, const vec4 &colour) {
+  bind_buffers();
+  renderer::bind(_draw_eff);
+  glUniformMatrix4fv(_draw_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+  glUniform4fv(_draw_eff.get_uniform_location("colour"), 1, value_ptr(colour));
+  // Vertices are pulled from the pool buffers, so no attributes are needed
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _buffers[INDIRECT]);
+  glDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void *>(DRAW_COMMAND_OFFSET));
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
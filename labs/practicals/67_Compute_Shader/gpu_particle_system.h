@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cpu_particle_system.h"
+#include "particle_collision.h"
+#include <graphics_framework.h>
+
+// Compute shader particle pool.  Particles are spawned from a dead list at the
+// emitter rate, age and die, and are returned to the dead list.  The simulate
+// dispatch and the draw are both sized on the GPU from the live count, so free
+// slots are never simulated or drawn.
+class gpu_particle_system {
+public:
+  // Creates the pool buffers and builds the shaders.  Requires a GL 4.3 context
+  explicit gpu_particle_system(unsigned int capacity);
+  gpu_particle_system(const gpu_particle_system &) = delete;
+  gpu_particle_system &operator=(const gpu_particle_system &) = delete;
+
+  // Gets the maximum number of live particles
+  unsigned int capacity() const { return _capacity; }
+
+  // Gets / sets the emitter used to spawn particles
+  const particle_emitter &get_emitter() const { return _emitter; }
+  void set_emitter(const particle_emitter &emitter) { _emitter = emitter; }
+  // Gets / sets the constant acceleration applied to all particles
+  const glm::vec3 &get_acceleration() const { return _acceleration; }
+  void set_acceleration(const glm::vec3 &acceleration) { _acceleration = acceleration; }
+  // Gets / sets the box outside of which particles die
+  const glm::vec3 &get_bounds() const { return _bounds; }
+  void set_bounds(const glm::vec3 &bounds) { _bounds = bounds; }
+  // Gets / sets the colliders particles bounce off while simulating
+  const particle_colliders &get_colliders() const { return _colliders; }
+  void set_colliders(const particle_colliders &colliders) { _colliders = colliders; }
+
+  // Spawns, simulates and recycles particles
+  void update(float delta_time);
+  // Draws the live particles as points using the given transform and colour
+  void render(const glm::mat4 &MVP, const glm::vec4 &colour);
+
+  // Gets the buffer holding particle positions (xyz) and ages (w)
+  GLuint get_position_buffer() const { return _buffers[POSITIONS]; }
+
+private:
+  // Pool buffers, matching the bindings in particle_pool.comp
+  enum buffer_index { POSITIONS, VELOCITIES, ALIVE, NEXT_ALIVE, DEAD, COUNTERS, INDIRECT, BUFFER_COUNT };
+
+  void bind_buffers();
+
+  unsigned int _capacity;
+  GLuint _buffers[BUFFER_COUNT];
+  graphics_framework::effect _emit_eff;
+  graphics_framework::effect _simulate_eff;
+  graphics_framework::effect _args_eff;
+  graphics_framework::effect _draw_eff;
+
+  particle_emitter _emitter;
+  glm::vec3 _acceleration = glm::vec3(0.0f);
+  glm::vec3 _bounds = glm::vec3(1.0f);
+  particle_colliders _colliders;
+  // Fractional particles carried between frames when rate * delta_time is not whole
+  float _emit_remainder = 0.0f;
+  unsigned int _frame = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <graphics_framework.h>
+#include <utility>
+#include <vector>
+
+// Colliders of each type, must match MAX_COLLIDERS in shaders/part_collision.glsl
+const unsigned int MAX_PARTICLE_COLLIDERS = 8;
+
+// Colliders tested by shaders/part_collision.glsl inside a particle simulation
+// shader.  Shared by 66_Particle_System, 67_Compute_Shader and 68_Smoke_Effect.
+struct particle_colliders {
+  // Planes as normal and offset - particles stay where dot(normal, p) >= offset
+  std::vector<glm::vec4> planes;
+  // Spheres as centre and radius
+  std::vector<glm::vec4> spheres;
+  // Axis aligned boxes as min and max corners
+  std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+  // Fraction of normal velocity kept on impact
+  float bounce = 0.3f;
+  // Fraction of tangential velocity lost on impact
+  float friction = 0.1f;
+
+  // Heightfield texture, such as the height map 60_Terrain builds from.  Zero disables it
+  GLuint heightmap = 0;
+  // Centre of the heightfield
+  glm::vec3 heightmap_origin = glm::vec3(0.0f);
+  // World width and depth covered by the heightfield
+  glm::vec2 heightmap_size = glm::vec2(1.0f);
+  // World height of a texel value of 1.0
+  float heightmap_scale = 1.0f;
+
+  // Previous frame depth texture.  Zero disables depth buffer collision
+  GLuint depth = 0;
+  // Previous frame world space normals packed to [0, 1].  Zero rebuilds normals from depth
+  GLuint normals = 0;
+  // View projection the depth texture was rendered with
+  glm::mat4 view_projection = glm::mat4(1.0f);
+  // How far behind a depth buffer surface a particle still collides with it
+  float thickness = 0.5f;
+};
+
+// Sets the collision uniforms on an effect that includes part_collision.glsl.
+// The effect must be bound.  Textures are bound from first_unit onwards
+inline void bind_colliders(graphics_framework::effect &eff, const particle_colliders &colliders,
+                           GLuint first_unit) {
+  using namespace glm;
+  auto planes = std::min<size_t>(colliders.planes.size(), MAX_PARTICLE_COLLIDERS);
+  auto spheres = std::min<size_t>(colliders.spheres.size(), MAX_PARTICLE_COLLIDERS);
+  auto boxes = std::min<size_t>(colliders.boxes.size(), MAX_PARTICLE_COLLIDERS);
+  glUniform1i(eff.get_uniform_location("collision_plane_count"), static_cast<GLint>(planes));
+  glUniform1i(eff.get_uniform_location("collision_sphere_count"), static_cast<GLint>(spheres));
+  glUniform1i(eff.get_uniform_location("collision_box_count"), static_cast<GLint>(boxes));
+  if (planes > 0) {
+    glUniform4fv(eff.get_uniform_location("collision_planes"), static_cast<GLsizei>(planes),
+                 value_ptr(colliders.planes[0]));
+  }
+  if (spheres > 0) {
+    glUniform4fv(eff.get_uniform_location("collision_spheres"), static_cast<GLsizei>(spheres),
+                 value_ptr(colliders.spheres[0]));
+  }
+  if (boxes > 0) {
+    std::vector<vec3> mins, maxs;
+    for (size_t i = 0; i < boxes; ++i) {
+      mins.push_back(colliders.boxes[i].first);
+      maxs.push_back(colliders.boxes[i].second);
+    }
+    glUniform3fv(eff.get_uniform_location("collision_box_min"), static_cast<GLsizei>(boxes), value_ptr(mins[0]));
+    glUniform3fv(eff.get_uniform_location("collision_box_max"), static_cast<GLsizei>(boxes), value_ptr(maxs[0]));
+  }
+  glUniform1f(eff.get_uniform_location("collision_bounce"), colliders.bounce);
+  glUniform1f(eff.get_uniform_location("collision_friction"), colliders.friction);
+
+  // Samplers always get their own units, even when unused
+  glUniform1i(eff.get_uniform_location("collision_heightmap"), first_unit);
+  glUniform1i(eff.get_uniform_location("collision_depth"), first_unit + 1);
+  glUniform1i(eff.get_uniform_location("collision_normals"), first_unit + 2);
+
+  glUniform1i(eff.get_uniform_location("collision_use_heightmap"), colliders.heightmap != 0);
+  if (colliders.heightmap != 0) {
+    glActiveTexture(GL_TEXTURE0 + first_unit);
+    glBindTexture(GL_TEXTURE_2D, colliders.heightmap);
+    glUniform3fv(eff.get_uniform_location("collision_heightmap_origin"), 1, value_ptr(colliders.heightmap_origin));
+    glUniform2fv(eff.get_uniform_location("collision_heightmap_size"), 1, value_ptr(colliders.heightmap_size));
+    glUniform1f(eff.get_uniform_location("collision_heightmap_scale"), colliders.heightmap_scale);
+  }
+
+  glUniform1i(eff.get_uniform_location("collision_use_depth"), colliders.depth != 0);
+  glUniform1i(eff.get_uniform_location("collision_use_normals"), colliders.normals != 0);
+  if (colliders.depth != 0) {
+    glActiveTexture(GL_TEXTURE0 + first_unit + 1);
+    glBindTexture(GL_TEXTURE_2D, colliders.depth);
+    if (colliders.normals != 0) {
+      glActiveTexture(GL_TEXTURE0 + first_unit + 2);
+      glBindTexture(GL_TEXTURE_2D, colliders.normals);
+    }
+    glUniformMatrix4fv(eff.get_uniform_location("collision_view_projection"), 1, GL_FALSE,
+                       value_ptr(colliders.view_projection));
+    glUniformMatrix4fv(eff.get_uniform_location("collision_inverse_view_projection"), 1, GL_FALSE,
+                       value_ptr(inverse(colliders.view_projection)));
+    glUniform1f(eff.get_uniform_location("collision_thickness"), colliders.thickness);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,15 @@
+#version 440 core
+
+// Particle colour
+uniform vec4 colour;
+
+// Incoming fraction of lifetime remaining
+layout(location = 0) in float life_left;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour_out;
+
+void main() {
+	// Fade out as the particle dies
+	colour_out = vec4(colour.rgb * life_left, colour.a);
+}
@@ -0,0 +1,20 @@
+#version 440 core
+
+// Transformation matrix
+uniform mat4 MVP;
+
+// Particle pool, see particle_pool.comp
+layout(std430, binding = 0) buffer PositionBuffer { vec4 positions[]; };
+layout(std430, binding = 1) buffer VelocityBuffer { vec4 velocities[]; };
+layout(std430, binding = 2) buffer AliveBuffer { uint alive[]; };
+
+// Outgoing fraction of lifetime remaining
+layout(location = 0) out float life_left;
+
+void main() {
+	// One vertex per live particle
+	uint index = alive[gl_VertexID];
+	vec4 pos = positions[index];
+	gl_Position = MVP * vec4(pos.xyz, 1.0);
+	life_left = 1.0 - pos.w / velocities[index].w;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstring>
+#include <graphics_framework.h>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// Frames the CPU may get ahead of the GPU before a region of the ring is reused
+const unsigned int RING_FRAMES_IN_FLIGHT = 3;
+
+// Per frame streaming memory for uniforms, instance data and vertices.  One
+// buffer is split into a region per frame in flight and mapped once for good,
+// so writing is a plain memory copy.  Each frame allocates from its own region,
+// and a fence placed at the end of the frame says when the GPU is done with it.
+// The CPU only waits if it gets RING_FRAMES_IN_FLIGHT frames ahead, and never
+// reads anything back.  Without buffer storage (GL 4.4) allocations go through
+// CPU memory and are uploaded with glBufferSubData when submitted
+class ring_buffer {
+public:
+  // A sub-allocation from the current frame's region, valid until the frame ends
+  struct allocation {
+    // Where to write the data
+    void *data;
+    GLuint buffer;
+    // Byte offset in buffer, for glBindBufferRange or attribute pointers
+    GLintptr offset;
+    GLsizeiptr size;
+  };
+
+  // Creates a ring with frame_size bytes available each frame
+  explicit ring_buffer(GLsizeiptr frame_size)
+      : _frame_size(frame_size), _frame(0), _head(0), _mapped(nullptr), _waits(0) {
+    for (auto &fence : _fences) {
+      fence = nullptr;
+    }
+    _persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    const GLsizeiptr total = frame_size * RING_FRAMES_IN_FLIGHT;
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+    if (_persistent) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+      _mapped = static_cast<char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+    } else {
+      glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+      _staging.resize(frame_size);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  ~ring_buffer() {
+    for (auto fence : _fences) {
+      if (fence != nullptr) {
+        glDeleteSync(fence);
+      }
+    }
+    if (_mapped != nullptr) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &_buffer);
+  }
+
+  ring_buffer(const ring_buffer &) = delete;
+  ring_buffer &operator=(const ring_buffer &) = delete;
+
+  // Moves on to the next region, waiting only if the GPU is still reading the
+  // frame that last used it.  Call once at the start of each frame
+  void begin_frame() {
+    _frame = (_frame + 1) % RING_FRAMES_IN_FLIGHT;
+    _head = 0;
+    auto &fence = _fences[_frame];
+    if (fence == nullptr) {
+      return;
+    }
+    auto status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      ++_waits;
+      // Flush so the fence is sure to signal, then block
+      do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  // Marks the end of the commands using this frame's allocations.  Call once
+  // after the frame's last draw
+  void end_frame() { _fences[_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+
+  // Takes size bytes from this frame's region, the offset a multiple of
+  // alignment.  Throws if the region is full
+  allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16) {
+    auto start = (_head + alignment - 1) / alignment * alignment;
+    if (start + size > _frame_size) {
+      std::cerr << "ERROR - ring buffer: " << start + size << " bytes wanted this frame, " << _frame_size
+                << " available" << std::endl;
+      throw std::runtime_error("Ring buffer frame region full");
+    }
+    _head = start + size;
+    allocation result;
+    result.buffer = _buffer;
+    result.offset = _frame * _frame_size + start;
+    result.size = size;
+    result.data = _persistent ? _mapped + result.offset : &_staging[start];
+    return result;
+  }
+
+  // Makes an allocation's data visible to the GPU.  Nothing to do when mapped,
+  // the mapping is coherent
+  void submit(const allocation &a) {
+    if (!_persistent) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, a.offset, a.size, a.data);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+  }
+
+  // Allocates, copies and submits in one go
+  allocation push(const void *data, GLsizeiptr size, GLsizeiptr alignment = 16) {
+    auto a = allocate(size, alignment);
+    std::memcpy(a.data, data, size);
+    submit(a);
+    return a;
+  }
+
+  GLuint get_buffer() const { return _buffer; }
+  // Bytes available each frame
+  GLsizeiptr get_frame_size() const { return _frame_size; }
+  // Bytes allocated so far this frame
+  GLsizeiptr get_used() const { return _head; }
+  // Frames that had to wait for the GPU
+  unsigned int get_wait_count() const { return _waits; }
+  bool is_persistent() const { return _persistent; }
+
+  // Offset alignment glBindBufferRange needs for uniform blocks
+  static GLsizeiptr get_uniform_alignment() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return alignment;
+  }
+
+  // Offset alignment glBindBufferRange needs for shader storage blocks
+  static GLsizeiptr get_storage_alignment() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return alignment;
+  }
+
+private:
+  GLuint _buffer;
+  GLsizeiptr _frame_size;
+  unsigned int _frame;
+  // Bytes allocated from the current region
+  GLsizeiptr _head;
+  bool _persistent;
+  char *_mapped;
+  std::vector<char> _staging;
+  GLsync _fences[RING_FRAMES_IN_FLIGHT];
+  unsigned int _waits;
+};
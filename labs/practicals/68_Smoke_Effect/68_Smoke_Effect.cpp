@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../67_Compute_Shader/particle_collision.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -12,18 +13,49 @@ const unsigned int MAX_PARTICLES = 4096;
 vec4 positions[MAX_PARTICLES];
 vec4 original_positions[MAX_PARTICLES];
 vec4 velocitys[MAX_PARTICLES];
-float distances[MAX_PARTICLES];
+
+// Sort key, laid out like sort_key in the sort shaders: view depth and particle index
+struct sort_key {
+  float z;
+  GLuint index;
+};
 
 GLuint G_Position_buffer, G_Velocity_buffer, G_Original_Pos_buffer, G_Distances_buffer;
 
+// The sort works on blocks of 512 keys and needs a power of two count
+static_assert(MAX_PARTICLES >= 512 && (MAX_PARTICLES & (MAX_PARTICLES - 1)) == 0,
+              "MAX_PARTICLES must be a power of two of at least 512");
+
 effect eff;
 effect compute_eff;
+effect depth_eff;
+effect sort_eff;
+effect tex_eff;
+effect composite_eff;
 arc_ball_camera cam;
 double cursor_x = 0.0;
 double cursor_y = 0.0;
 GLuint vao;
 texture tex;
 
+// Floor for the smoke to fade into
+mesh floor_mesh;
+texture floor_tex;
+// Scene colour and depth, read by the soft particle test
+frame_buffer scene;
+// Optional half resolution particle target
+frame_buffer particle_frame;
+bool half_res = true;
+geometry screen_quad;
+// View distance over which particles fade into the scene
+const float softness = 0.5f;
+
+// Ball in the smoke column.  Particles collide with it through last frame's scene depth
+mesh ball;
+particle_colliders colliders;
+// View projection the scene depth was last rendered with, zero until the first frame
+mat4 scene_view_projection(0.0f);
+
 bool load_content() {
   default_random_engine rand(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
   uniform_real_distribution<float> dist;
@@ -35,7 +67,6 @@ bool load_content() {
   {
     positions[i] = vec4(((2.0f * dist(rand)) - 1.0f) / 10.0f, 5.0 * dist(rand), 0.0f, 0.0f);
     velocitys[i] = vec4(0.0f, 0.1f + dist(rand), 0.0f, 0.0f);
-	distances[i] = 0.0f;
   }
   // Load in shaders
   eff.add_shader("68_Smoke_Effect/smoke.vert", GL_VERTEX_SHADER);
@@ -45,8 +76,44 @@ bool load_content() {
   eff.build();
 
   // Load in shaders
-  compute_eff.add_shader("67_Compute_Shader/particle.comp", GL_COMPUTE_SHADER);
+  compute_eff.add_shader(vector<string>{"68_Smoke_Effect/smoke_simulate.comp", "shaders/part_collision.glsl"},
+                         GL_COMPUTE_SHADER);
   compute_eff.build();
+  depth_eff.add_shader("68_Smoke_Effect/depth_keys.comp", GL_COMPUTE_SHADER);
+  depth_eff.build();
+  sort_eff.add_shader("68_Smoke_Effect/bitonic_sort.comp", GL_COMPUTE_SHADER);
+  sort_eff.build();
+  tex_eff.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
+  tex_eff.add_shader("27_Texturing_Shader/simple_texture.frag", GL_FRAGMENT_SHADER);
+  tex_eff.build();
+  composite_eff.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
+  composite_eff.add_shader("68_Smoke_Effect/composite.frag", GL_FRAGMENT_SHADER);
+  composite_eff.build();
+
+  // Scene and particle targets
+  scene = frame_buffer(renderer::get_screen_width(), renderer::get_screen_height());
+  particle_frame = frame_buffer(renderer::get_screen_width() / 2, renderer::get_screen_height() / 2);
+  vector<vec3> quad_positions{vec3(-1.0f, -1.0f, 0.0f), vec3(1.0f, -1.0f, 0.0f), vec3(-1.0f, 1.0f, 0.0f),
+                              vec3(1.0f, 1.0f, 0.0f)};
+  vector<vec2> quad_tex_coords{vec2(0.0, 0.0), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f)};
+  screen_quad.set_type(GL_TRIANGLE_STRIP);
+  screen_quad.add_buffer(quad_positions, BUFFER_INDEXES::POSITION_BUFFER);
+  screen_quad.add_buffer(quad_tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
+
+  // Floor under the smoke
+  floor_mesh = mesh(geometry_builder::create_plane(20, 20));
+  floor_tex = texture("textures/checked.gif");
+
+  // Ball just off the centre of the column, so smoke slides around one side
+  ball = mesh(geometry_builder::create_sphere(20, 20));
+  ball.get_transform().scale = vec3(0.5f);
+  ball.get_transform().position = vec3(0.3f, 2.5f, 0.0f);
+  // The floor is analytic, the ball is only seen through the depth buffer
+  colliders.planes.push_back(vec4(0.0f, 1.0f, 0.0f, 0.0f));
+  colliders.bounce = 0.0f;
+  colliders.friction = 0.0f;
+  // Particles up to the ball's depth behind its front face are pushed out
+  colliders.thickness = 1.0f;
 
   // a useless vao, but we need it bound or we get errors.
   glGenVertexArrays(1, &vao);
@@ -65,6 +132,11 @@ bool load_content() {
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, G_Velocity_buffer);
   // Send Data to GPU, use GL_DYNAMIC_DRAW
   glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vec4) * MAX_PARTICLES, velocitys, GL_DYNAMIC_DRAW);
+
+  // Generate sort key buffer - view depth and particle index, filled on the GPU
+  glGenBuffers(1, &G_Distances_buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, G_Distances_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(sort_key) * MAX_PARTICLES, nullptr, GL_DYNAMIC_COPY);
   // *********************************
    //Unbind
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
@@ -113,6 +185,15 @@ bool update(float delta_time) {
     cam.move(5.0f * delta_time);
   }
 
+  // H toggles the half resolution particle buffer
+  static bool h_down = false;
+  bool h_pressed = glfwGetKey(renderer::get_window(), GLFW_KEY_H) == GLFW_PRESS;
+  if (h_pressed && !h_down) {
+    half_res = !half_res;
+    cout << "Half resolution particles " << (half_res ? "on" : "off") << endl;
+  }
+  h_down = h_pressed;
+
   // Update the camera
   cam.update(delta_time);
 
@@ -122,24 +203,93 @@ bool update(float delta_time) {
   return true;
 }
 
+// Sorts the particle keys back to front with a bitonic sort
+void sort_particles(const mat4 &V) {
+  // Write a view depth key for every particle
+  renderer::bind(depth_eff);
+  glUniformMatrix4fv(depth_eff.get_uniform_location("MV"), 1, GL_FALSE, value_ptr(V));
+  glDispatchCompute(MAX_PARTICLES / 128, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  renderer::bind(sort_eff);
+  for (GLuint k = 2; k <= MAX_PARTICLES; k <<= 1) {
+    for (GLuint j = k >> 1; j > 0; j >>= 1) {
+      glUniform1ui(sort_eff.get_uniform_location("k"), k);
+      glUniform1ui(sort_eff.get_uniform_location("j"), j);
+      if (j <= 256) {
+        // The rest of this merge stays within blocks of 512, finish it in shared memory
+        glUniform1i(sort_eff.get_uniform_location("local_pass"), GL_TRUE);
+        glDispatchCompute(MAX_PARTICLES / 512, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        break;
+      }
+      glUniform1i(sort_eff.get_uniform_location("local_pass"), GL_FALSE);
+      glDispatchCompute(MAX_PARTICLES / 512, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+  }
+}
+
 bool render() {
+  auto V = cam.get_view();
+  auto P = cam.get_projection();
+
   // Bind Compute Shader
   renderer::bind(compute_eff);
+  // Collide against the previous frame's scene depth, once there is one
+  colliders.depth = scene_view_projection == mat4(0.0f) ? 0 : scene.get_depth().get_id();
+  colliders.view_projection = scene_view_projection;
+  bind_colliders(compute_eff, colliders, 0);
   // Bind data as SSBO
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, G_Position_buffer);
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, G_Velocity_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, G_Distances_buffer);
   // Dispatch
   glDispatchCompute(MAX_PARTICLES / 128, 1, 1);
   // Sync, wait for completion
-  glMemoryBarrier(GL_ALL_BARRIER_BITS);
-  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  // Order the particles for correct alpha blending
+  sort_particles(V);
+
+  // Render the scene so its depth can be sampled
+  renderer::set_render_target(scene);
+  renderer::clear();
+  renderer::bind(tex_eff);
+  auto MVP = P * V * floor_mesh.get_transform().get_transform_matrix();
+  glUniformMatrix4fv(tex_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+  renderer::bind(floor_tex, 0);
+  glUniform1i(tex_eff.get_uniform_location("tex"), 0);
+  renderer::render(floor_mesh);
+  MVP = P * V * ball.get_transform().get_transform_matrix();
+  glUniformMatrix4fv(tex_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+  renderer::render(ball);
+  scene_view_projection = P * V;
+
+  // Copy the scene to the screen
+  renderer::set_render_target();
+  renderer::bind(tex_eff);
+  glUniformMatrix4fv(tex_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(mat4(1.0f)));
+  renderer::bind(scene.get_frame(), 0);
+  glUniform1i(tex_eff.get_uniform_location("tex"), 0);
+  renderer::render(screen_quad);
+
+  // Particles either go straight to the screen or into the half size target
+  vec2 target_size(renderer::get_screen_width(), renderer::get_screen_height());
+  if (half_res) {
+    target_size *= 0.5f;
+    renderer::set_render_target(particle_frame);
+    glViewport(0, 0, static_cast<GLsizei>(target_size.x), static_cast<GLsizei>(target_size.y));
+    // Clear to transparent, keeping the renderer's clear colour
+    GLfloat clear_colour[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_colour);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(clear_colour[0], clear_colour[1], clear_colour[2], clear_colour[3]);
+  }
 
   // *********************************
   // Bind render effect
   renderer::bind(eff);
-  // Create MV matrix
-  auto V = cam.get_view();
-  auto P = cam.get_projection();
   // Set the colour uniform
   glUniform4fv(eff.get_uniform_location("colour"), 1, value_ptr(vec4(1.0)));
   // Set MV, and P matrix uniforms seperatly
@@ -151,26 +301,42 @@ bool render() {
   renderer::bind(tex, 0);
   glUniform1i(eff.get_uniform_location("tex"), 0);
   // *********************************
+  // Bind scene depth for the soft particle fade
+  renderer::bind(scene.get_depth(), 1);
+  glUniform1i(eff.get_uniform_location("depth"), 1);
+  glUniform1f(eff.get_uniform_location("camera_near"), 0.1f);
+  glUniform1f(eff.get_uniform_location("camera_far"), 1000.0f);
+  glUniform1f(eff.get_uniform_location("softness"), softness);
+  glUniform2fv(eff.get_uniform_location("target_size"), 1, value_ptr(target_size));
 
-  // Bind position buffer as GL_ARRAY_BUFFER
-  glBindBuffer(GL_ARRAY_BUFFER, G_Position_buffer);
-  // Setup vertex format
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void *)0);
-  // Enable Blending
+  // Enable Blending.  Alpha accumulates coverage so the half size target can be
+  // composited as premultiplied colour
   glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  // Disable Depth Mask
+  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  // Occlusion comes from the soft particle test, not the depth buffer
+  glDisable(GL_DEPTH_TEST);
   glDepthMask(GL_FALSE);
-  // Render
+  // Render, vertices are pulled from the sorted keys
   glDrawArrays(GL_POINTS, 0, MAX_PARTICLES);
+
+  if (half_res) {
+    // Composite the particles over the scene
+    renderer::set_render_target();
+    glViewport(0, 0, renderer::get_screen_width(), renderer::get_screen_height());
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    renderer::bind(composite_eff);
+    glUniformMatrix4fv(composite_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(mat4(1.0f)));
+    renderer::bind(particle_frame.get_frame(), 0);
+    glUniform1i(composite_eff.get_uniform_location("tex"), 0);
+    renderer::render(screen_quad);
+  }
+
   // Tidy up, enable depth mask
   glDepthMask(GL_TRUE);
+  glEnable(GL_DEPTH_TEST);
   // Disable Blend
   glDisable(GL_BLEND);
-  // Unbind all arrays
-  glDisableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
   glUseProgram(0);
   return true;
 }
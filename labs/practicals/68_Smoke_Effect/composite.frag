@@ -0,0 +1,15 @@
+#version 440 core
+
+// Particle buffer - premultiplied colour and coverage in alpha
+uniform sampler2D tex;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+void main() {
+	// Blended over the scene with (ONE, ONE_MINUS_SRC_ALPHA)
+	colour = texture(tex, tex_coord);
+}
@@ -1,12 +1,31 @@
 #version 440 core
 
 uniform sampler2D tex;
+// Scene depth buffer
+uniform sampler2D depth;
+// Camera near and far planes, used to linearise the depth buffer
+uniform float camera_near;
+uniform float camera_far;
+// View distance over which particles fade out in front of geometry
+uniform float softness;
+// Size of the render target, to find this fragment in the depth buffer
+uniform vec2 target_size;
 
 in VertexData {
 	vec4 colour;
 	vec2 tex_coord;
+	float view_depth;
 };
 
 layout(location = 0) out vec4 colour_out;
 
-void main() { colour_out = texture(tex, tex_coord) * colour; }
\ No newline at end of file
+void main() {
+	// Linear view distance of the scene behind this fragment
+	float ndc = texture(depth, gl_FragCoord.xy / target_size).r * 2.0 - 1.0;
+	float scene_depth = 2.0 * camera_near * camera_far / (camera_far + camera_near - ndc * (camera_far - camera_near));
+	// Fade out as the quad approaches the scene, and hide it when behind
+	float fade = clamp((scene_depth - view_depth) / softness, 0.0, 1.0);
+
+	colour_out = texture(tex, tex_coord) * colour;
+	colour_out.a *= fade;
+}
@@ -2,11 +2,19 @@
 
 uniform mat4 MV;
 
-layout(location = 0) in vec3 position;
+// Particle positions
+layout(std430, binding = 0) buffer PositionBuffer { vec4 positions[]; };
+// Back to front draw order, written by the sort
+struct sort_key {
+	float z;
+	uint index;
+};
+layout(std430, binding = 2) buffer KeyBuffer { sort_key keys[]; };
 
 layout(location = 0) out float height;
 
 void main() {
+	vec3 position = positions[keys[gl_VertexID].index].xyz;
 	gl_Position = MV * vec4(position, 1.0);
 	height = position.y;
-}
\ No newline at end of file
+}
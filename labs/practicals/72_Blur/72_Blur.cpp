@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "blur_library.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -7,24 +8,22 @@ using namespace glm;
 
 map<string, mesh> meshes;
 effect eff;
-effect tex_eff;
 texture tex;
 target_camera cam;
 directional_light light;
 frame_buffer frame;
-geometry screen_quad;
+unique_ptr<post_graph> post;
+unique_ptr<blur_library> blurs;
+// Blur radius in pixels, and the kernel used
+float blur_radius = 4.0f;
+blur_kernel kernel = automatic_blur;
 
 bool load_content() {
   // *********************************
   // Create frame buffer - use screen width and height
 	frame = frame_buffer(renderer::get_screen_width(), renderer::get_screen_height());
-  // Create screen quad
-	vector<vec3> positions{ vec3(-1.0f, -1.0f, 0.0f), vec3(1.0f, -1.0f, 0.0f), vec3(-1.0f, 1.0f, 0.0f),
-		vec3(1.0f, 1.0f, 0.0f) };
-	vector<vec2> tex_coords{ vec2(0.0, 0.0), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f) };
-	screen_quad.set_type(GL_TRIANGLE_STRIP);
-	screen_quad.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-	screen_quad.add_buffer(tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
+  // Create the post-processing graph, which owns the screen quad
+	post = unique_ptr<post_graph>(new post_graph());
   // *********************************
 
   // Create plane mesh
@@ -104,11 +103,9 @@ bool load_content() {
   // Load in shaders
   eff.add_shader("48_Phong_Shading/phong.vert", GL_VERTEX_SHADER);
   eff.add_shader("48_Phong_Shading/phong.frag", GL_FRAGMENT_SHADER);
-  tex_eff.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
-  tex_eff.add_shader("72_Blur/blur.frag", GL_FRAGMENT_SHADER);
   // Build effects
   eff.build();
-  tex_eff.build();
+  blurs = unique_ptr<blur_library>(new blur_library());
 
   // Set camera properties
   cam.set_position(vec3(50.0f, 10.0f, 50.0f));
@@ -133,6 +130,26 @@ bool update(float delta_time) {
     cam.set_position(vec3(50, 10, -50));
   }
 
+  // Up and down change the blur radius, G / K / B pick Gaussian, dual filter (Kawase) or box and A goes back to automatic
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_UP)) {
+    blur_radius = std::min(blur_radius + 16.0f * delta_time, 64.0f);
+  }
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_DOWN)) {
+    blur_radius = std::max(blur_radius - 16.0f * delta_time, 1.0f);
+  }
+  if (glfwGetKey(renderer::get_window(), 'G')) {
+    kernel = gaussian_blur;
+  }
+  if (glfwGetKey(renderer::get_window(), 'K')) {
+    kernel = dual_filter_blur;
+  }
+  if (glfwGetKey(renderer::get_window(), 'B')) {
+    kernel = box_blur;
+  }
+  if (glfwGetKey(renderer::get_window(), 'A')) {
+    kernel = automatic_blur;
+  }
+
   // Rotate the sphere
   meshes["sphere"].get_transform().rotate(vec3(0.0f, half_pi<float>(), 0.0f) * delta_time);
 
@@ -185,24 +202,12 @@ bool render() {
   }
 
   // *********************************
-  // Set render target back to the screen
-  renderer::set_render_target();
-  // Bind Tex effect
-  renderer::bind(tex_eff);
-  // MVP is now the identity matrix
-  mat4 MVP = mat4(1.0);
-  // Set MVP matrix uniform
-  glUniformMatrix4fv(tex_eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-  // Bind texture from frame buffer
-  renderer::bind(frame.get_frame(), 1);
-  // Set the tex uniform
-  glUniform1i(tex_eff.get_uniform_location("tex"), 1);
-  // Set inverse width Uniform
-  glUniform1f(tex_eff.get_uniform_location("inverse_width"), 1.0f / renderer::get_screen_width());
-  // Set inverse height Uniform
-  glUniform1f(tex_eff.get_uniform_location("inverse_height"), 1.0f / renderer::get_screen_height());
-  // Render the screen quad
-  renderer::render(screen_quad);
+  // Blur the frame and draw it to the screen
+  post->reset();
+  auto scene = post->import_texture(frame.get_frame().get_id(), frame.get_width(), frame.get_height());
+  auto blurred = blurs->blur(*post, scene, blur_radius, kernel);
+  post->present(blurred);
+  post->execute();
   // *********************************
 
   return true;
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+#include <string>
+#include <vector>
+
+// Luminance histogram bins, matching BINS in the auto-exposure compute shaders
+const GLuint LUMINANCE_HISTOGRAM_BINS = 256;
+// Storage buffer binding of the histogram
+const GLuint LUMINANCE_HISTOGRAM_BINDING = 2;
+// Histogram work group size along each axis, matching post_luminance_histogram.comp
+const GLuint LUMINANCE_GROUP_SIZE = 16;
+
+// How exposure follows the scene
+struct exposure_settings {
+  // Luminance the scene's average is exposed to.  The scene is lit without a
+  // gamma curve, so this is brighter than the usual 0.18
+  float key = 0.5f;
+  // log2 luminance range the histogram covers
+  float min_log_luminance = -8.0f;
+  float log_luminance_range = 12.0f;
+  // How fast the eye adapts to brighter and darker scenes, per second
+  float adapt_up = 3.0f;
+  float adapt_down = 1.0f;
+  float min_exposure = 0.1f;
+  float max_exposure = 10.0f;
+};
+
+// Exposure that adapts to the scene's average luminance over time, entirely on
+// the GPU.  The result is a 1x1 texture holding the exposure in r, which the
+// tonemap samples, so nothing is read back and nothing waits.  With compute
+// shaders (GL 4.3) the luminance is averaged from a histogram built by a
+// parallel reduction, ignoring black texels; without them it is the log
+// average taken from the mip chain of a log luminance copy.  That fallback
+// only needs GL 3.3: its shaders are GLSL 3.30 and its textures use mutable
+// storage
+class auto_exposure {
+public:
+  explicit auto_exposure(const std::string &shader_dir = "shaders/") : _current(0) {
+    _compute = GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
+    // Exposure textures start at zero, which the shaders take as nothing adapted yet
+    const float zero[2] = {0.0f, 0.0f};
+    glGenTextures(2, _exposure);
+    glGenFramebuffers(2, _exposure_fbos);
+    for (int i = 0; i < 2; ++i) {
+      glBindTexture(GL_TEXTURE_2D, _exposure[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1, 1, 0, GL_RG, GL_FLOAT, zero);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glBindFramebuffer(GL_FRAMEBUFFER, _exposure_fbos[i]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _exposure[i], 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (_compute) {
+      std::vector<GLuint> zeros(LUMINANCE_HISTOGRAM_BINS, 0);
+      glGenBuffers(1, &_histogram);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, _histogram);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size() * sizeof(GLuint), zeros.data(), GL_DYNAMIC_COPY);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      _histogram_eff.add_shader(shader_dir + "post_luminance_histogram.comp", GL_COMPUTE_SHADER);
+      _histogram_eff.build();
+      _adapt_eff.add_shader(shader_dir + "post_exposure_adapt.comp", GL_COMPUTE_SHADER);
+      _adapt_eff.build();
+    } else {
+      _log_luminance_eff.add_shader(shader_dir + "post_triangle.vert", GL_VERTEX_SHADER);
+      _log_luminance_eff.add_shader(shader_dir + "post_log_luminance.frag", GL_FRAGMENT_SHADER);
+      _log_luminance_eff.build();
+      _adapt_eff.add_shader(shader_dir + "post_triangle.vert", GL_VERTEX_SHADER);
+      _adapt_eff.add_shader(shader_dir + "post_exposure_adapt.frag", GL_FRAGMENT_SHADER);
+      _adapt_eff.build();
+      // The fragment path draws without vertex buffers
+      glGenVertexArrays(1, &_empty_array);
+    }
+  }
+
+  ~auto_exposure() {
+    glDeleteFramebuffers(2, _exposure_fbos);
+    glDeleteTextures(2, _exposure);
+    glDeleteBuffers(1, &_histogram);
+    glDeleteFramebuffers(1, &_log_luminance_fbo);
+    glDeleteTextures(1, &_log_luminance);
+    glDeleteVertexArrays(1, &_empty_array);
+  }
+  auto_exposure(const auto_exposure &) = delete;
+  auto_exposure &operator=(const auto_exposure &) = delete;
+
+  exposure_settings &get_settings() { return _settings; }
+  // Whether the histogram path is in use rather than the mip chain
+  bool uses_compute() const { return _compute; }
+  // 1x1 texture with this frame's exposure in r and the adapted luminance in g
+  GLuint get_texture() const { return _exposure[_current]; }
+
+  // Measures the bottom left width x height of an HDR texture, all of it
+  // unless the scene was drawn smaller, and moves the exposure towards it.
+  // Call once a frame after the scene is drawn and before the tonemap samples
+  // get_texture
+  void update(GLuint hdr_texture, GLuint width, GLuint height, float delta_time) {
+    if (_compute) {
+      update_histogram(hdr_texture, width, height, delta_time);
+    } else {
+      update_mip_chain(hdr_texture, width, height, delta_time);
+    }
+  }
+
+private:
+  void update_histogram(GLuint hdr_texture, GLuint width, GLuint height, float delta_time) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LUMINANCE_HISTOGRAM_BINDING, _histogram);
+
+    graphics_framework::renderer::bind(_histogram_eff);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hdr_texture);
+    glUniform1i(_histogram_eff.get_uniform_location("tex"), 0);
+    glUniform1f(_histogram_eff.get_uniform_location("min_log_luminance"), _settings.min_log_luminance);
+    glUniform1f(_histogram_eff.get_uniform_location("inverse_log_luminance_range"),
+                1.0f / _settings.log_luminance_range);
+    glUniform2i(_histogram_eff.get_uniform_location("region"), width, height);
+    glDispatchCompute((width + LUMINANCE_GROUP_SIZE - 1) / LUMINANCE_GROUP_SIZE,
+                      (height + LUMINANCE_GROUP_SIZE - 1) / LUMINANCE_GROUP_SIZE, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // One work group reduces the histogram and adapts the exposure in place
+    graphics_framework::renderer::bind(_adapt_eff);
+    set_adapt_uniforms(_adapt_eff, delta_time);
+    glUniform1f(_adapt_eff.get_uniform_location("min_log_luminance"), _settings.min_log_luminance);
+    glUniform1f(_adapt_eff.get_uniform_location("log_luminance_range"), _settings.log_luminance_range);
+    glUniform1f(_adapt_eff.get_uniform_location("texel_count"), float(width) * float(height));
+    glBindImageTexture(0, _exposure[_current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+    glUniform1i(_adapt_eff.get_uniform_location("exposure_image"), 0);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+
+  void update_mip_chain(GLuint hdr_texture, GLuint width, GLuint height, float delta_time) {
+    // A quarter size copy is plenty for an average
+    GLuint w = std::max(width / 4, 1u), h = std::max(height / 4, 1u);
+    if (w != _log_luminance_width || h != _log_luminance_height) {
+      create_log_luminance(w, h);
+    }
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindVertexArray(_empty_array);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _log_luminance_fbo);
+    glViewport(0, 0, w, h);
+    graphics_framework::renderer::bind(_log_luminance_eff);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hdr_texture);
+    glUniform1i(_log_luminance_eff.get_uniform_location("tex"), 0);
+    GLint texture_width = width, texture_height = height;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texture_width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texture_height);
+    glUniform2f(_log_luminance_eff.get_uniform_location("uv_scale"), float(width) / texture_width,
+                float(height) / texture_height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindTexture(GL_TEXTURE_2D, _log_luminance);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Read last frame's exposure and write this frame's to the other texture
+    auto previous = _current;
+    _current = 1 - _current;
+    glBindFramebuffer(GL_FRAMEBUFFER, _exposure_fbos[_current]);
+    glViewport(0, 0, 1, 1);
+    graphics_framework::renderer::bind(_adapt_eff);
+    set_adapt_uniforms(_adapt_eff, delta_time);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _log_luminance);
+    glUniform1i(_adapt_eff.get_uniform_location("log_luminance"), 0);
+    glUniform1f(_adapt_eff.get_uniform_location("top_level"), float(_log_luminance_levels - 1));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _exposure[previous]);
+    glUniform1i(_adapt_eff.get_uniform_location("previous_exposure"), 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+
+  void set_adapt_uniforms(const graphics_framework::effect &eff, float delta_time) {
+    glUniform1f(eff.get_uniform_location("delta_time"), delta_time);
+    glUniform1f(eff.get_uniform_location("adapt_up"), _settings.adapt_up);
+    glUniform1f(eff.get_uniform_location("adapt_down"), _settings.adapt_down);
+    glUniform1f(eff.get_uniform_location("key"), _settings.key);
+    glUniform1f(eff.get_uniform_location("min_exposure"), _settings.min_exposure);
+    glUniform1f(eff.get_uniform_location("max_exposure"), _settings.max_exposure);
+  }
+
+  void create_log_luminance(GLuint width, GLuint height) {
+    glDeleteFramebuffers(1, &_log_luminance_fbo);
+    glDeleteTextures(1, &_log_luminance);
+    GLsizei levels = 1;
+    while ((std::max(width, height) >> levels) > 0) {
+      ++levels;
+    }
+    glGenTextures(1, &_log_luminance);
+    glBindTexture(GL_TEXTURE_2D, _log_luminance);
+    // The mip levels below are made by glGenerateMipmap
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &_log_luminance_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _log_luminance_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _log_luminance, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    _log_luminance_width = width;
+    _log_luminance_height = height;
+    _log_luminance_levels = levels;
+  }
+
+  bool _compute;
+  exposure_settings _settings;
+  // Exposure textures, ping-ponged by the fragment path
+  GLuint _exposure[2];
+  GLuint _exposure_fbos[2];
+  int _current;
+  // Compute path
+  GLuint _histogram = 0;
+  graphics_framework::effect _histogram_eff;
+  // Fragment path
+  GLuint _log_luminance = 0;
+  GLuint _log_luminance_fbo = 0;
+  GLuint _log_luminance_width = 0;
+  GLuint _log_luminance_height = 0;
+  GLsizei _log_luminance_levels = 1;
+  GLuint _empty_array = 0;
+  graphics_framework::effect _log_luminance_eff;
+  // Adapts the exposure, a compute or fragment shader by path
+  graphics_framework::effect _adapt_eff;
+};
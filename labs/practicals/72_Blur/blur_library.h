@@ -0,0 +1,184 @@
+#pragma once
+
+#include "post_graph.h"
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Taps the Gaussian shader takes, the centre included, matching MAX_TAPS in post_gaussian.frag
+const int GAUSSIAN_MAX_TAPS = 16;
+// Widest Gaussian the taps cover - two texels a tap after the centre
+const float GAUSSIAN_MAX_RADIUS = 2.0f * (GAUSSIAN_MAX_TAPS - 1);
+// Radius past which an automatic blur switches from a full size Gaussian to the dual filter
+const float AUTOMATIC_GAUSSIAN_RADIUS = 8.0f;
+// Most dual filter levels, each halving the size
+const int DUAL_FILTER_MAX_LEVELS = 6;
+// Box blur work group size and largest radius, matching post_box_blur.comp
+const GLuint BOX_BLUR_GROUP_SIZE = 128;
+const int BOX_BLUR_MAX_RADIUS = 32;
+
+// How a blur is done
+enum blur_kernel {
+  // Gaussian for small radii, dual filter for large ones
+  automatic_blur,
+  // Separable Gaussian at the source size: two passes of (radius / 2 + 1) fetches
+  gaussian_blur,
+  // Dual filter pyramid: downsampled and upsampled, so the cost barely grows with the radius
+  dual_filter_blur,
+  // Separable box average in compute shaders, a shared memory tile per work group
+  box_blur
+};
+
+// Blur kernels for post-processing graphs: bloom, depth of field and the like.
+// Each call adds the blur's passes to a graph and returns the blurred
+// resource, the same size and format as the source.  Shaders are read from
+// shader_dir, where the build copies the post_* shaders from labs/res/shaders
+class blur_library {
+public:
+  explicit blur_library(const std::string &shader_dir = "shaders/") {
+    _gaussian_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _gaussian_eff.add_shader(shader_dir + "post_gaussian.frag", GL_FRAGMENT_SHADER);
+    _gaussian_eff.build();
+    _down_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _down_eff.add_shader(shader_dir + "post_dual_down.frag", GL_FRAGMENT_SHADER);
+    _down_eff.build();
+    _up_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _up_eff.add_shader(shader_dir + "post_dual_up.frag", GL_FRAGMENT_SHADER);
+    _up_eff.build();
+    _box_eff.add_shader({shader_dir + "post_image_rgba8.comp", shader_dir + "post_box_blur.comp"}, GL_COMPUTE_SHADER);
+    _box_eff.build();
+    _box_hdr_eff.add_shader({shader_dir + "post_image_rgba16f.comp", shader_dir + "post_box_blur.comp"},
+                            GL_COMPUTE_SHADER);
+    _box_hdr_eff.build();
+  }
+
+  // Blurs by about radius texels of the source
+  post_resource blur(post_graph &graph, post_resource source, float radius, blur_kernel kernel = automatic_blur) {
+    if (kernel == automatic_blur) {
+      kernel = radius <= AUTOMATIC_GAUSSIAN_RADIUS ? gaussian_blur : dual_filter_blur;
+    }
+    switch (kernel) {
+    case gaussian_blur:
+      return gaussian(graph, source, radius);
+    case box_blur:
+      return box(graph, source, radius);
+    default:
+      return dual_filter(graph, source, dual_filter_levels(radius));
+    }
+  }
+
+  // Horizontal then vertical Gaussian, radius clamped to GAUSSIAN_MAX_RADIUS
+  post_resource gaussian(post_graph &graph, post_resource source, float radius) {
+    auto desc = graph.get_desc(source);
+    auto taps = gaussian_taps(radius);
+    auto horizontal = graph.add_pass("gaussian horizontal", _gaussian_eff, {{"tex", source}}, desc,
+                                     gaussian_uniforms(taps, glm::vec2(1.0f / desc.width, 0.0f)));
+    return graph.add_pass("gaussian vertical", _gaussian_eff, {{"tex", horizontal}}, desc,
+                          gaussian_uniforms(taps, glm::vec2(0.0f, 1.0f / desc.height)));
+  }
+
+  // Downsamples levels times and upsamples back to the source size
+  post_resource dual_filter(post_graph &graph, post_resource source, int levels) {
+    levels = std::max(1, std::min(levels, DUAL_FILTER_MAX_LEVELS));
+    std::vector<post_resource> pyramid{source};
+    for (int i = 0; i < levels; ++i) {
+      auto in = graph.get_desc(pyramid.back());
+      post_target_desc out(std::max(in.width / 2, 1u), std::max(in.height / 2, 1u), in.format);
+      // Half a target texel, one source texel, so each diagonal tap averages its own 2x2 block
+      pyramid.push_back(graph.add_pass("dual filter down", _down_eff, {{"tex", pyramid.back()}}, out,
+                                       half_texel_uniform(out)));
+    }
+    auto result = pyramid.back();
+    for (int i = levels - 1; i >= 0; --i) {
+      auto in = graph.get_desc(result);
+      result = graph.add_pass("dual filter up", _up_eff, {{"tex", result}}, graph.get_desc(pyramid[i]),
+                              half_texel_uniform(in));
+    }
+    return result;
+  }
+
+  // Horizontal then vertical box average, radius clamped to BOX_BLUR_MAX_RADIUS.
+  // The source must be RGBA8 or RGBA16F, the formats the compute shaders' images are declared with
+  post_resource box(post_graph &graph, post_resource source, float radius) {
+    auto desc = graph.get_desc(source);
+    if (desc.format != GL_RGBA8 && desc.format != GL_RGBA16F) {
+      std::cerr << "ERROR - blur library: box blur of format " << desc.format << ", only RGBA8 and RGBA16F are supported"
+                << std::endl;
+      throw std::runtime_error("Unsupported box blur format");
+    }
+    auto &eff = desc.format == GL_RGBA16F ? _box_hdr_eff : _box_eff;
+    int r = std::max(1, std::min(int(std::ceil(radius)), BOX_BLUR_MAX_RADIUS));
+    auto groups = [](GLuint length, GLuint lines) {
+      return glm::uvec2((length + BOX_BLUR_GROUP_SIZE - 1) / BOX_BLUR_GROUP_SIZE, lines);
+    };
+    auto uniforms = [r](int vertical) {
+      return [r, vertical](GLuint program) {
+        glUniform1i(glGetUniformLocation(program, "radius"), r);
+        glUniform1i(glGetUniformLocation(program, "vertical"), vertical);
+      };
+    };
+    auto horizontal = graph.add_compute_pass("box horizontal", eff, {{"tex", source}}, desc,
+                                             groups(desc.width, desc.height), uniforms(0));
+    return graph.add_compute_pass("box vertical", eff, {{"tex", horizontal}}, desc, groups(desc.height, desc.width),
+                                  uniforms(1));
+  }
+
+  // Dual filter levels giving about radius texels: each level about doubles it
+  static int dual_filter_levels(float radius) {
+    return std::max(1, std::min(int(std::ceil(std::log2(std::max(radius, 2.0f) / 2.0f))), DUAL_FILTER_MAX_LEVELS));
+  }
+
+  // Offsets (x) and weights (y) of one direction of a Gaussian reaching radius
+  // texels, with sigma a third of the radius.  After the centre, each pair of
+  // texels becomes one tap placed between them by their weights, so the
+  // linear filter fetches both at once
+  static std::vector<glm::vec2> gaussian_taps(float radius) {
+    int r = std::max(1, std::min(int(std::ceil(radius)), int(GAUSSIAN_MAX_RADIUS)));
+    float sigma = std::max(std::min(radius, GAUSSIAN_MAX_RADIUS), 1.0f) / 3.0f;
+    std::vector<float> weights(r + 1);
+    float total = 0.0f;
+    for (int i = 0; i <= r; ++i) {
+      weights[i] = std::exp(-float(i * i) / (2.0f * sigma * sigma));
+      total += i == 0 ? weights[i] : 2.0f * weights[i];
+    }
+    std::vector<glm::vec2> taps{glm::vec2(0.0f, weights[0] / total)};
+    for (int i = 1; i <= r; i += 2) {
+      float a = weights[i];
+      float b = i + 1 <= r ? weights[i + 1] : 0.0f;
+      taps.push_back(glm::vec2((i * a + (i + 1) * b) / (a + b), (a + b) / total));
+    }
+    return taps;
+  }
+
+private:
+  static post_uniforms gaussian_uniforms(const std::vector<glm::vec2> &taps, const glm::vec2 &direction) {
+    return [taps, direction](GLuint program) {
+      std::vector<float> offsets, weights;
+      for (auto &t : taps) {
+        offsets.push_back(t.x);
+        weights.push_back(t.y);
+      }
+      glUniform2fv(glGetUniformLocation(program, "direction"), 1, glm::value_ptr(direction));
+      glUniform1fv(glGetUniformLocation(program, "offsets"), GLsizei(taps.size()), offsets.data());
+      glUniform1fv(glGetUniformLocation(program, "weights"), GLsizei(taps.size()), weights.data());
+      glUniform1i(glGetUniformLocation(program, "tap_count"), GLint(taps.size()));
+    };
+  }
+
+  static post_uniforms half_texel_uniform(const post_target_desc &desc) {
+    glm::vec2 half_texel(0.5f / desc.width, 0.5f / desc.height);
+    return [half_texel](GLuint program) {
+      glUniform2fv(glGetUniformLocation(program, "half_texel"), 1, glm::value_ptr(half_texel));
+    };
+  }
+
+  graphics_framework::effect _gaussian_eff;
+  graphics_framework::effect _down_eff;
+  graphics_framework::effect _up_eff;
+  graphics_framework::effect _box_eff;
+  graphics_framework::effect _box_hdr_eff;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "post_graph.h"
+#include <algorithm>
+#include <graphics_framework.h>
+#include <string>
+
+// Half size targets hold colour and a signed circle of confusion
+const GLenum DOF_FORMAT = GL_RGBA16F;
+
+// Focus and aperture controls
+struct dof_settings {
+  // Distance in focus
+  float focus_distance = 10.0f;
+  // Distance either side of the focus over which blur grows to its largest
+  float focus_range = 10.0f;
+  // Largest circle of confusion radius in full size pixels - the aperture
+  float max_radius = 24.0f;
+  // Camera clip planes, to linearise depth
+  float near_plane = 0.1f;
+  float far_plane = 1000.0f;
+};
+
+// Depth of field for post-processing graphs.  The circle of confusion comes
+// from depth, and the scene is halved with it in alpha.  The fields behind and
+// in front of the focus are gathered separately at half size with a bokeh disc,
+// a fixed number of taps whatever the aperture, then a per pixel stage
+// upsamples them by depth and blends them over the sharp scene
+class depth_of_field {
+public:
+  explicit depth_of_field(const std::string &shader_dir = "shaders/") : _shader_dir(shader_dir) {
+    _prepare_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _prepare_eff.add_shader(shader_dir + "post_dof_prepare.frag", GL_FRAGMENT_SHADER);
+    _prepare_eff.build();
+    _gather_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _gather_eff.add_shader(shader_dir + "post_dof_gather.frag", GL_FRAGMENT_SHADER);
+    _gather_eff.build();
+  }
+
+  // Blurs colour by its distance from the focus.  depth is the scene's depth
+  // buffer, the same size as colour
+  post_resource apply(post_graph &graph, post_resource colour, post_resource depth, const dof_settings &settings) {
+    auto in = graph.get_desc(colour);
+    post_target_desc half(std::max(in.width / 2, 1u), std::max(in.height / 2, 1u), DOF_FORMAT);
+    auto prepared = graph.add_pass("dof prepare", _prepare_eff, {{"tex", colour}, {"depth_map", depth}}, half,
+                                   [settings](GLuint program) {
+                                     glUniform1f(glGetUniformLocation(program, "focus_distance"),
+                                                 settings.focus_distance);
+                                     glUniform1f(glGetUniformLocation(program, "focus_range"), settings.focus_range);
+                                     glUniform1f(glGetUniformLocation(program, "near_plane"), settings.near_plane);
+                                     glUniform1f(glGetUniformLocation(program, "far_plane"), settings.far_plane);
+                                   });
+    auto far = graph.add_pass("dof far field", _gather_eff, {{"tex", prepared}}, half, gather_uniforms(half, settings, 0));
+    auto near = graph.add_pass("dof near field", _gather_eff, {{"tex", prepared}}, half,
+                               gather_uniforms(half, settings, 1));
+    return graph.add_stage("dof composite", _shader_dir + "post_dof_composite.glsl", "depth_of_field", colour,
+                           {{"dof_far", far}, {"dof_near", near}, {"dof_depth", depth}},
+                           [settings](GLuint program) {
+                             glUniform1f(glGetUniformLocation(program, "dof_focus_distance"), settings.focus_distance);
+                             glUniform1f(glGetUniformLocation(program, "dof_focus_range"), settings.focus_range);
+                             glUniform1f(glGetUniformLocation(program, "dof_near_plane"), settings.near_plane);
+                             glUniform1f(glGetUniformLocation(program, "dof_far_plane"), settings.far_plane);
+                             glUniform1f(glGetUniformLocation(program, "dof_max_radius"), settings.max_radius);
+                           });
+  }
+
+private:
+  static post_uniforms gather_uniforms(const post_target_desc &half, const dof_settings &settings, int near_field) {
+    glm::vec2 texel_size(1.0f / half.width, 1.0f / half.height);
+    // The radius halves with the targets
+    float max_radius = settings.max_radius * 0.5f;
+    return [texel_size, max_radius, near_field](GLuint program) {
+      glUniform2fv(glGetUniformLocation(program, "texel_size"), 1, glm::value_ptr(texel_size));
+      glUniform1f(glGetUniformLocation(program, "max_radius"), max_radius);
+      glUniform1i(glGetUniformLocation(program, "near_field"), near_field);
+    };
+  }
+
+  std::string _shader_dir;
+  graphics_framework::effect _prepare_eff;
+  graphics_framework::effect _gather_eff;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "gpu_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+
+// How the render resolution follows the GPU frame time
+struct dynamic_resolution_settings {
+  // GPU time a frame should take, in milliseconds
+  float budget = 14.0f;
+  // Scale range, as a fraction of the full width and height
+  float min_scale = 0.5f;
+  float max_scale = 1.0f;
+  // Scales are rounded to steps of this, so targets sized from them repeat
+  float step = 0.05f;
+  // The scale only goes up while frames come in under this fraction of the budget
+  float headroom = 0.85f;
+  // Frames in a row under the headroom before each step up
+  unsigned int frames_to_raise = 10;
+  // Weight of each new time in the smoothed frame time
+  float smoothing = 0.25f;
+};
+
+// Picks a render resolution each frame to hold the GPU frame time to a budget.
+// Targets are allocated at the full size and the 3D passes draw into the
+// bottom left width x height of them; the final post-processing pass scales
+// that up to the screen.  GPU time is measured with timer queries read a few
+// frames late, so the controller never stalls.  Time roughly follows pixel
+// count, the square of the scale, so an overrun is cut in one go while the
+// scale only creeps back up a step at a time
+class dynamic_resolution {
+public:
+  dynamic_resolution(GLuint full_width, GLuint full_height)
+      : _full_width(full_width), _full_height(full_height), _scale(_settings.max_scale), _smoothed(0.0f), _under(0),
+        _last_result(0), _settle(0), _enabled(true) {}
+
+  // Times the frame's GPU work.  Call before the first pass
+  void begin_frame() { _timer.begin(); }
+
+  // Stops timing and moves the scale for the next frame.  Call after the last pass
+  void end_frame() {
+    _timer.end();
+    if (_timer.get_result_count() == _last_result) {
+      return;
+    }
+    _last_result = _timer.get_result_count();
+    // Results still in flight when the scale changed were drawn at the old one
+    if (_settle > 0) {
+      --_settle;
+      return;
+    }
+    auto time = _timer.get_milliseconds();
+    _smoothed = _smoothed <= 0.0f ? time : _smoothed + (time - _smoothed) * _settings.smoothing;
+    if (!_enabled) {
+      _scale = _settings.max_scale;
+      return;
+    }
+
+    if (_smoothed > _settings.budget) {
+      // Over budget: drop straight to the scale that fits, judging by the newest
+      // time as well so a sudden jump in load is caught the next frame
+      auto worst = std::max(_smoothed, time);
+      set_scale(quantise(_scale * std::sqrt(_settings.budget / worst), false));
+    } else if (_smoothed < _settings.budget * _settings.headroom && _scale < _settings.max_scale) {
+      if (++_under >= _settings.frames_to_raise) {
+        set_scale(_scale + _settings.step);
+      }
+    } else {
+      _under = 0;
+    }
+  }
+
+  // Sets the viewport to the render resolution
+  void set_viewport() const { glViewport(0, 0, get_width(), get_height()); }
+
+  // Render resolution this frame
+  GLuint get_width() const { return std::max(GLuint(std::round(_full_width * _scale)), 1u); }
+  GLuint get_height() const { return std::max(GLuint(std::round(_full_height * _scale)), 1u); }
+  float get_scale() const { return _scale; }
+  // Smoothed GPU frame time in milliseconds
+  float get_frame_time() const { return _smoothed; }
+
+  // Off holds the scale at max_scale, while still timing frames
+  void set_enabled(bool enabled) { _enabled = enabled; }
+  bool is_enabled() const { return _enabled; }
+  dynamic_resolution_settings &get_settings() { return _settings; }
+
+private:
+  // Rounds to a whole step, down unless asked to round to the nearest
+  float quantise(float scale, bool nearest) const {
+    float steps = scale / _settings.step;
+    return (nearest ? std::round(steps) : std::floor(steps)) * _settings.step;
+  }
+
+  // Changes the scale and starts the smoothed time afresh once results at it come in
+  void set_scale(float scale) {
+    scale = std::max(_settings.min_scale, std::min(quantise(scale, true), _settings.max_scale));
+    if (scale != _scale) {
+      _scale = scale;
+      _smoothed = 0.0f;
+      _settle = GPU_TIMER_QUERIES;
+    }
+    _under = 0;
+  }
+
+  GLuint _full_width;
+  GLuint _full_height;
+  dynamic_resolution_settings _settings;
+  gpu_timer _timer;
+  float _scale;
+  float _smoothed;
+  unsigned int _under;
+  unsigned int _last_result;
+  // Results left to skip after a scale change
+  unsigned int _settle;
+  bool _enabled;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <graphics_framework.h>
+
+// Queries in flight per timer.  A result is read a few frames after it was
+// asked for, when the GPU is sure to be done with it, so nothing stalls
+const unsigned int GPU_TIMER_QUERIES = 4;
+
+// Times GPU work between begin and end with a pair of timestamp queries,
+// without ever waiting on a result.  Results come back a few frames late.
+// Timestamps, unlike elapsed time queries, let timers nest, so a pass can be
+// timed inside the whole frame
+class gpu_timer {
+public:
+  gpu_timer() : _next(0), _active(false), _milliseconds(0.0f), _results(0) {
+    glGenQueries(GPU_TIMER_QUERIES, _starts);
+    glGenQueries(GPU_TIMER_QUERIES, _ends);
+    for (auto &p : _pending) {
+      p = false;
+    }
+  }
+  ~gpu_timer() {
+    glDeleteQueries(GPU_TIMER_QUERIES, _starts);
+    glDeleteQueries(GPU_TIMER_QUERIES, _ends);
+  }
+  gpu_timer(const gpu_timer &) = delete;
+  gpu_timer &operator=(const gpu_timer &) = delete;
+
+  // Starts timing.  If the GPU is so far behind that every query is still
+  // waiting, this frame isn't timed
+  void begin() {
+    poll();
+    _active = !_pending[_next];
+    if (_active) {
+      glQueryCounter(_starts[_next], GL_TIMESTAMP);
+    }
+  }
+
+  // Stops timing and picks up any results that have come in
+  void end() {
+    if (_active) {
+      glQueryCounter(_ends[_next], GL_TIMESTAMP);
+      _pending[_next] = true;
+      _next = (_next + 1) % GPU_TIMER_QUERIES;
+      _active = false;
+    }
+    poll();
+  }
+
+  // Latest finished time in milliseconds, 0 until the first comes in
+  float get_milliseconds() const { return _milliseconds; }
+  // Results read so far
+  unsigned int get_result_count() const { return _results; }
+
+private:
+  // Reads finished queries oldest first, stopping at the first still running
+  void poll() {
+    for (unsigned int i = 0; i < GPU_TIMER_QUERIES; ++i) {
+      auto index = (_next + i) % GPU_TIMER_QUERIES;
+      if (!_pending[index]) {
+        continue;
+      }
+      // The end timestamp is written after the start, so the start is ready too
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(_ends[index], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        return;
+      }
+      GLuint64 start = 0, end = 0;
+      glGetQueryObjectui64v(_starts[index], GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(_ends[index], GL_QUERY_RESULT, &end);
+      _milliseconds = float(double(end - start) / 1000000.0);
+      _pending[index] = false;
+      ++_results;
+    }
+  }
+
+  GLuint _starts[GPU_TIMER_QUERIES];
+  GLuint _ends[GPU_TIMER_QUERIES];
+  bool _pending[GPU_TIMER_QUERIES];
+  // Query the next begin uses
+  unsigned int _next;
+  bool _active;
+  float _milliseconds;
+  unsigned int _results;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "blur_library.h"
+#include "post_graph.h"
+#include <graphics_framework.h>
+#include <string>
+
+// Scene target format for HDR rendering: three floats in 32 bits, half the
+// bandwidth of RGBA16F, with no alpha
+const GLenum HDR_FORMAT = GL_R11F_G11F_B10F;
+
+// Exposure and bloom controls
+struct hdr_settings {
+  // Scale applied to the scene before tonemapping
+  float exposure = 1.0f;
+  // 1x1 texture whose r also scales the scene, such as auto_exposure's.  0 for none
+  GLuint exposure_texture = 0;
+  // Brightness where bloom starts, and the soft ramp around it as a fraction of it
+  float bloom_threshold = 1.0f;
+  float bloom_knee = 0.5f;
+  // How much bloom is added back
+  float bloom_intensity = 0.25f;
+  // Dual filter levels below the half size bright pass
+  int bloom_levels = 4;
+};
+
+// HDR resolve for post-processing graphs.  The bright parts of the scene are
+// picked out at half size and blurred down a dual filter pyramid, then added
+// back, exposed and tonemapped by a per pixel stage.  As a stage, the tonemap
+// fuses with the per pixel stages after it, so the only LDR write is the last one
+class hdr_post {
+public:
+  explicit hdr_post(blur_library &blurs, const std::string &shader_dir = "shaders/")
+      : _blurs(blurs), _shader_dir(shader_dir) {
+    _threshold_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _threshold_eff.add_shader(shader_dir + "post_bloom_threshold.frag", GL_FRAGMENT_SHADER);
+    _threshold_eff.build();
+    // Exposure of 1 for when there is no exposure texture
+    const float one[2] = {1.0f, 1.0f};
+    glGenTextures(1, &_unit_exposure);
+    glBindTexture(GL_TEXTURE_2D, _unit_exposure);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, 1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RG, GL_FLOAT, one);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  ~hdr_post() { glDeleteTextures(1, &_unit_exposure); }
+  hdr_post(const hdr_post &) = delete;
+  hdr_post &operator=(const hdr_post &) = delete;
+
+  // Half size blurred bright parts of an HDR scene
+  post_resource bloom(post_graph &graph, post_resource scene, const hdr_settings &settings) {
+    auto in = graph.get_desc(scene);
+    post_target_desc half(std::max(in.width / 2, 1u), std::max(in.height / 2, 1u), HDR_FORMAT);
+    glm::vec2 texel(1.0f / in.width, 1.0f / in.height);
+    auto bright = graph.add_pass("bloom threshold", _threshold_eff, {{"tex", scene}}, half,
+                                 [texel, settings](GLuint program) {
+                                   glUniform2fv(glGetUniformLocation(program, "texel"), 1, glm::value_ptr(texel));
+                                   glUniform1f(glGetUniformLocation(program, "threshold"), settings.bloom_threshold);
+                                   glUniform1f(glGetUniformLocation(program, "knee"), settings.bloom_knee);
+                                 });
+    return _blurs.dual_filter(graph, bright, settings.bloom_levels);
+  }
+
+  // Adds bloom to the scene and tonemaps it, giving an RGBA8 resource
+  post_resource tonemap(post_graph &graph, post_resource scene, post_resource bloom, const hdr_settings &settings) {
+    auto exposure = graph.import_texture(settings.exposure_texture != 0 ? settings.exposure_texture : _unit_exposure,
+                                         1, 1, GL_RG32F);
+    return graph.add_stage("tonemap", _shader_dir + "post_tonemap.glsl", "tonemap", scene,
+                           {{"bloom", bloom}, {"exposure_map", exposure}},
+                           [settings](GLuint program) {
+                             glUniform1f(glGetUniformLocation(program, "exposure"), settings.exposure);
+                             glUniform1f(glGetUniformLocation(program, "bloom_intensity"), settings.bloom_intensity);
+                           },
+                           GL_RGBA8);
+  }
+
+  // Bloom and tonemap in one go
+  post_resource resolve(post_graph &graph, post_resource scene, const hdr_settings &settings) {
+    return tonemap(graph, scene, bloom(graph, scene, settings), settings);
+  }
+
+private:
+  blur_library &_blurs;
+  std::string _shader_dir;
+  graphics_framework::effect _threshold_eff;
+  GLuint _unit_exposure;
+};
@@ -0,0 +1,648 @@
+#pragma once
+
+#include <fstream>
+#include <functional>
+#include <graphics_framework.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A texture passed between post-processing passes.  Every pass writes a new
+// one, so no pass can sample the target it is drawing to
+typedef int post_resource;
+// Frames a pooled target may go unused before it is freed
+const unsigned int POST_TARGET_LIFETIME = 3;
+
+// Size and format of a pass's output
+struct post_target_desc {
+  GLuint width = 0;
+  GLuint height = 0;
+  GLenum format = GL_RGBA8;
+
+  post_target_desc() {}
+  post_target_desc(GLuint w, GLuint h, GLenum f = GL_RGBA8) : width(w), height(h), format(f) {}
+  bool operator==(const post_target_desc &other) const {
+    return width == other.width && height == other.height && format == other.format;
+  }
+};
+
+// A sampler uniform and the resource bound to it
+struct post_input {
+  std::string uniform;
+  post_resource resource;
+};
+
+// Sets a pass's own uniforms.  Passes fused into one draw all get the same
+// program, so stage uniform names must be unique across stages
+typedef std::function<void(GLuint program)> post_uniforms;
+
+inline GLsizeiptr post_texel_size(GLenum format) {
+  switch (format) {
+  case GL_R8:
+    return 1;
+  case GL_RG8:
+  case GL_R16F:
+    return 2;
+  case GL_RGBA16F:
+  case GL_RG32F:
+    return 8;
+  case GL_RGBA32F:
+    return 16;
+  default:
+    return 4;
+  }
+}
+
+// Colour targets handed out to passes.  A target goes back to the pool as soon
+// as its last reader has drawn, so later passes alias the same memory and a
+// chain of passes ping-pongs between two targets
+class post_target_pool {
+public:
+  struct target {
+    post_target_desc desc;
+    GLuint texture = 0;
+    GLuint fbo = 0;
+    bool in_use = false;
+    unsigned int last_used = 0;
+  };
+
+  post_target_pool() {}
+  ~post_target_pool() {
+    for (auto &t : _targets) {
+      destroy(t);
+    }
+  }
+  post_target_pool(const post_target_pool &) = delete;
+  post_target_pool &operator=(const post_target_pool &) = delete;
+
+  // Index of a free target of the given size and format, created if there is none
+  size_t acquire(const post_target_desc &desc) {
+    for (size_t i = 0; i < _targets.size(); ++i) {
+      if (!_targets[i].in_use && _targets[i].desc == desc) {
+        _targets[i].in_use = true;
+        _targets[i].last_used = _frame;
+        return i;
+      }
+    }
+    target t;
+    t.desc = desc;
+    glGenTextures(1, &t.texture);
+    glBindTexture(GL_TEXTURE_2D, t.texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, desc.format, desc.width, desc.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &t.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "ERROR - post graph: " << desc.width << "x" << desc.height << " target of format " << desc.format
+                << " is not complete" << std::endl;
+      throw std::runtime_error("Incomplete post-processing target");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    t.in_use = true;
+    t.last_used = _frame;
+    // Reuse a slot freed by trim
+    for (size_t i = 0; i < _targets.size(); ++i) {
+      if (_targets[i].texture == 0) {
+        _targets[i] = t;
+        return i;
+      }
+    }
+    _targets.push_back(t);
+    return _targets.size() - 1;
+  }
+
+  void release(size_t index) { _targets[index].in_use = false; }
+
+  // Frees targets no frame has needed for POST_TARGET_LIFETIME frames.  Call
+  // once a frame, when nothing is in use
+  void trim() {
+    ++_frame;
+    for (auto &t : _targets) {
+      if (t.texture != 0 && !t.in_use && _frame - t.last_used > POST_TARGET_LIFETIME) {
+        destroy(t);
+      }
+    }
+  }
+
+  const target &get(size_t index) const { return _targets[index]; }
+
+  // Video memory held by the pool
+  GLsizeiptr get_bytes() const {
+    GLsizeiptr bytes = 0;
+    for (auto &t : _targets) {
+      if (t.texture != 0) {
+        bytes += GLsizeiptr(t.desc.width) * t.desc.height * post_texel_size(t.desc.format);
+      }
+    }
+    return bytes;
+  }
+  size_t get_count() const {
+    size_t count = 0;
+    for (auto &t : _targets) {
+      count += t.texture != 0 ? 1 : 0;
+    }
+    return count;
+  }
+
+private:
+  static void destroy(target &t) {
+    glDeleteFramebuffers(1, &t.fbo);
+    glDeleteTextures(1, &t.texture);
+    t = target();
+  }
+
+  std::vector<target> _targets;
+  unsigned int _frame = 0;
+};
+
+// Post-processing chain declared a frame at a time.  Passes name the resources
+// they read and get back the one they write; nothing is drawn until execute,
+// which then:
+//  - culls passes whose output doesn't lead to the presented or kept resources
+//  - fuses runs of per pixel stages, where each stage's output is only read by
+//    the next, into one generated shader and one full screen draw
+//  - gives each output a pooled target, freed after its last reader, and draws
+//    the presented resource straight to the screen
+// Typical use each frame is reset, import_texture, add_pass / add_stage, present, execute
+class post_graph {
+public:
+  post_graph() {
+    std::vector<glm::vec3> positions{glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f),
+                                     glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f)};
+    std::vector<glm::vec2> tex_coords{glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f),
+                                      glm::vec2(1.0f, 1.0f)};
+    _quad.set_type(GL_TRIANGLE_STRIP);
+    _quad.add_buffer(positions, graphics_framework::BUFFER_INDEXES::POSITION_BUFFER);
+    _quad.add_buffer(tex_coords, graphics_framework::BUFFER_INDEXES::TEXTURE_COORDS_0);
+  }
+  ~post_graph() {
+    for (auto &p : _programs) {
+      glDeleteProgram(p.second);
+    }
+  }
+  post_graph(const post_graph &) = delete;
+  post_graph &operator=(const post_graph &) = delete;
+
+  // Forgets last frame's passes and resources.  Targets stay in the pool
+  void reset() {
+    release_kept();
+    _resources.clear();
+    _passes.clear();
+    _presented = -1;
+    _executed = 0;
+    _draws = 0;
+  }
+
+  // Makes a texture rendered outside the graph readable by passes
+  post_resource import_texture(GLuint texture, GLuint width, GLuint height, GLenum format = GL_RGBA8) {
+    resource r;
+    r.desc = post_target_desc(width, height, format);
+    r.texture = texture;
+    r.imported = true;
+    _resources.push_back(r);
+    return post_resource(_resources.size() - 1);
+  }
+
+  // Copies the bottom left width x height of a framebuffer's first colour
+  // attachment into a target, for a scene drawn into part of a larger target
+  // as with dynamic resolution.  Passes then read it like any other resource
+  post_resource import_region(GLuint framebuffer, GLuint width, GLuint height, GLenum format = GL_RGBA8) {
+    pass p;
+    p.name = "import region";
+    p.source_framebuffer = framebuffer;
+    return add(p, post_target_desc(width, height, format));
+  }
+
+  // A full screen draw with an effect of its own, writing a new target.  The
+  // effect's vertex shader gets the screen quad (positions at 0, texture
+  // coordinates at 10), and MVP is set to the identity if it has one
+  post_resource add_pass(const std::string &name, const graphics_framework::effect &eff,
+                         const std::vector<post_input> &inputs, const post_target_desc &output,
+                         const post_uniforms &uniforms = nullptr) {
+    pass p;
+    p.name = name;
+    p.eff = &eff;
+    p.inputs = inputs;
+    p.uniforms = uniforms;
+    return add(p, output);
+  }
+
+  // A compute shader pass writing a new target, bound as image unit 0 and
+  // named post_output in the shader.  Inputs are bound as samplers as for
+  // add_pass, and groups work groups are dispatched
+  post_resource add_compute_pass(const std::string &name, const graphics_framework::effect &eff,
+                                 const std::vector<post_input> &inputs, const post_target_desc &output,
+                                 const glm::uvec2 &groups, const post_uniforms &uniforms = nullptr) {
+    pass p;
+    p.name = name;
+    p.eff = &eff;
+    p.compute = true;
+    p.groups = groups;
+    p.inputs = inputs;
+    p.uniforms = uniforms;
+    return add(p, output);
+  }
+
+  // A per pixel stage that adjacent stages can be fused with.  part_file
+  // defines vec4 function(vec4 colour, vec2 tex_coord) and the uniforms it
+  // uses, samplers named in extra_inputs included.  The output matches the
+  // colour input's size, and its format unless one is given.  An empty
+  // function passes colour through
+  post_resource add_stage(const std::string &name, const std::string &part_file, const std::string &function,
+                          post_resource colour, const std::vector<post_input> &extra_inputs = {},
+                          const post_uniforms &uniforms = nullptr, GLenum output_format = GL_NONE) {
+    pass p;
+    p.name = name;
+    p.part_file = part_file;
+    p.function = function;
+    p.inputs.push_back(post_input{"", colour});
+    p.inputs.insert(p.inputs.end(), extra_inputs.begin(), extra_inputs.end());
+    p.uniforms = uniforms;
+    auto desc = get_desc(colour);
+    if (output_format != GL_NONE) {
+      desc.format = output_format;
+    }
+    return add(p, desc);
+  }
+
+  // Draws the resource to the screen at the end of the graph
+  void present(post_resource r) {
+    if (_resources[r].imported) {
+      r = add_stage("present", "", "", r);
+    }
+    _presented = r;
+  }
+
+  // Keeps a resource's target alive after execute so get_texture can read it,
+  // until the next reset
+  void keep(post_resource r) { _resources[r].kept = true; }
+
+  const post_target_desc &get_desc(post_resource r) const { return _resources[r].desc; }
+  // Texture holding a resource, valid once execute has run
+  GLuint get_texture(post_resource r) const {
+    auto &res = _resources[r];
+    return res.imported ? res.texture : res.target >= 0 ? _pool.get(res.target).texture : 0;
+  }
+
+  // Culls, fuses, allocates and draws the frame's passes, leaving the screen bound
+  void execute() {
+    cull();
+    auto nodes = fuse();
+    for (auto &n : nodes) {
+      for (auto i : n) {
+        for (auto &input : _passes[i].inputs) {
+          _resources[input.resource].last_read = n.back();
+        }
+      }
+    }
+
+    GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean stencil_test = glIsEnabled(GL_STENCIL_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+    for (auto &n : nodes) {
+      draw(n);
+      // Inputs nothing later reads go back to the pool, after the draw so a
+      // pass's output never shares a target with its inputs
+      for (auto i : n) {
+        for (auto &input : _passes[i].inputs) {
+          auto &res = _resources[input.resource];
+          if (!res.imported && !res.kept && input.resource != _presented && res.target >= 0 &&
+              res.last_read == n.back()) {
+            _pool.release(res.target);
+          }
+        }
+      }
+    }
+    auto width = graphics_framework::renderer::get_screen_width();
+    auto height = graphics_framework::renderer::get_screen_height();
+    // A presented resource something else read was drawn to a target, so copy it over
+    if (_presented >= 0 && _resources[_presented].target >= 0) {
+      auto &desc = _resources[_presented].desc;
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, _pool.get(_resources[_presented].target).fbo);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      glBlitFramebuffer(0, 0, desc.width, desc.height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      // Nothing reads it after the copy, so it goes back unless it is kept
+      if (!_resources[_presented].kept) {
+        _pool.release(_resources[_presented].target);
+      }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+    if (depth_test) {
+      glEnable(GL_DEPTH_TEST);
+    }
+    if (stencil_test) {
+      glEnable(GL_STENCIL_TEST);
+    }
+  }
+
+  // Passes declared this frame, and the ones drawn after culling
+  size_t get_pass_count() const { return _passes.size(); }
+  size_t get_executed_count() const { return _executed; }
+  // Full screen draws and dispatches after fusing
+  size_t get_draw_count() const { return _draws; }
+  // Pooled targets and the video memory they hold
+  size_t get_target_count() const { return _pool.get_count(); }
+  GLsizeiptr get_target_bytes() const { return _pool.get_bytes(); }
+
+private:
+  struct resource {
+    post_target_desc desc;
+    GLuint texture = 0;
+    bool imported = false;
+    bool kept = false;
+    bool needed = false;
+    // Pass writing it, and the last pass reading it
+    int producer = -1;
+    size_t last_read = 0;
+    size_t readers = 0;
+    // Pool target, -1 until allocated
+    int target = -1;
+  };
+
+  struct pass {
+    std::string name;
+    // Effect for add_pass, null for stages
+    const graphics_framework::effect *eff = nullptr;
+    std::string part_file;
+    std::string function;
+    // A stage's first input is its colour
+    std::vector<post_input> inputs;
+    post_uniforms uniforms;
+    post_resource output = -1;
+    bool live = false;
+    // Dispatched with groups work groups rather than drawn
+    bool compute = false;
+    glm::uvec2 groups;
+    // Framebuffer import_region copies from, 0 for passes that draw
+    GLuint source_framebuffer = 0;
+  };
+
+  static bool is_stage(const pass &p) { return p.eff == nullptr && p.source_framebuffer == 0; }
+
+  post_resource add(pass &p, const post_target_desc &desc) {
+    resource r;
+    r.desc = desc;
+    r.producer = int(_passes.size());
+    _resources.push_back(r);
+    p.output = post_resource(_resources.size() - 1);
+    for (auto &input : p.inputs) {
+      if (input.resource < 0 || size_t(input.resource) >= _resources.size() - 1) {
+        std::cerr << "ERROR - post graph: pass " << p.name << " reads a resource that doesn't exist yet" << std::endl;
+        throw std::runtime_error("Invalid post-processing input");
+      }
+    }
+    _passes.push_back(p);
+    return p.output;
+  }
+
+  // Marks passes leading to the presented or kept resources, back to front
+  void cull() {
+    if (_presented >= 0) {
+      _resources[_presented].needed = true;
+    }
+    for (auto &r : _resources) {
+      r.needed |= r.kept;
+    }
+    for (size_t i = _passes.size(); i-- > 0;) {
+      auto &p = _passes[i];
+      p.live = _resources[p.output].needed;
+      if (p.live) {
+        ++_executed;
+        for (auto &input : p.inputs) {
+          _resources[input.resource].needed = true;
+          ++_resources[input.resource].readers;
+        }
+      }
+    }
+  }
+
+  // Groups live passes into draws.  A stage joins the previous group if that
+  // group is a run of stages ending in its colour input, and nothing else
+  // reads or keeps that input
+  std::vector<std::vector<size_t>> fuse() const {
+    std::vector<std::vector<size_t>> nodes;
+    for (size_t i = 0; i < _passes.size(); ++i) {
+      auto &p = _passes[i];
+      if (!p.live) {
+        continue;
+      }
+      bool joins = false;
+      if (is_stage(p) && !nodes.empty()) {
+        auto &previous = _passes[nodes.back().back()];
+        auto &colour = _resources[p.inputs[0].resource];
+        joins = is_stage(previous) && previous.output == p.inputs[0].resource && colour.readers == 1 &&
+                !colour.kept && _presented != previous.output;
+        // A part can only be pasted into a shader once
+        for (size_t j = 0; joins && j < nodes.back().size(); ++j) {
+          joins = p.part_file.empty() || _passes[nodes.back()[j]].part_file != p.part_file;
+        }
+        // Stage extra inputs must not be the fused intermediate either
+        for (size_t j = 1; joins && j < p.inputs.size(); ++j) {
+          joins = _resources[p.inputs[j].resource].producer < int(nodes.back().front());
+        }
+      }
+      if (joins) {
+        nodes.back().push_back(i);
+      } else {
+        nodes.push_back(std::vector<size_t>{i});
+      }
+    }
+    return nodes;
+  }
+
+  void draw(const std::vector<size_t> &node) {
+    using namespace graphics_framework;
+    auto &last = _passes[node.back()];
+    auto &output = _resources[last.output];
+    if (last.output == _presented && output.readers == 0 && !output.kept && !last.compute) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0, 0, renderer::get_screen_width(), renderer::get_screen_height());
+    } else {
+      output.target = int(_pool.acquire(output.desc));
+      glBindFramebuffer(GL_FRAMEBUFFER, last.compute ? 0 : _pool.get(output.target).fbo);
+      glViewport(0, 0, output.desc.width, output.desc.height);
+    }
+
+    if (last.source_framebuffer != 0) {
+      // Copied rather than drawn, and scaled up if it goes straight to the screen
+      GLint viewport[4];
+      glGetIntegerv(GL_VIEWPORT, viewport);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, last.source_framebuffer);
+      glBlitFramebuffer(0, 0, output.desc.width, output.desc.height, 0, 0, viewport[2], viewport[3],
+                        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      ++_draws;
+      return;
+    }
+
+    GLuint program;
+    GLint unit = 0;
+    if (last.eff != nullptr) {
+      renderer::bind(*last.eff);
+      program = last.eff->get_program();
+    } else {
+      program = get_stage_program(node);
+      glUseProgram(program);
+      bind_input(program, "post_source", _passes[node.front()].inputs[0].resource, unit++);
+    }
+    for (auto i : node) {
+      auto &p = _passes[i];
+      for (size_t j = p.eff == nullptr ? 1 : 0; j < p.inputs.size(); ++j) {
+        bind_input(program, p.inputs[j].uniform, p.inputs[j].resource, unit++);
+      }
+    }
+    auto mvp = last.compute ? -1 : glGetUniformLocation(program, "MVP");
+    if (mvp >= 0) {
+      glUniformMatrix4fv(mvp, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+    }
+    for (auto i : node) {
+      if (_passes[i].uniforms) {
+        _passes[i].uniforms(program);
+      }
+    }
+    if (last.compute) {
+      glBindImageTexture(0, _pool.get(output.target).texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, output.desc.format);
+      glUniform1i(glGetUniformLocation(program, "post_output"), 0);
+      glDispatchCompute(last.groups.x, last.groups.y, 1);
+      // Later passes sample what was written, or read it as an image
+      glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    } else {
+      renderer::render(_quad);
+    }
+    ++_draws;
+  }
+
+  void bind_input(GLuint program, const std::string &uniform, post_resource r, GLint unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, get_texture(r));
+    glUniform1i(glGetUniformLocation(program, uniform.c_str()), unit);
+  }
+
+  // Program running a run of stages in one draw, built the first time the run is seen
+  GLuint get_stage_program(const std::vector<size_t> &node) {
+    std::string key;
+    for (auto i : node) {
+      key += _passes[i].part_file + ":" + _passes[i].function + ";";
+    }
+    auto found = _programs.find(key);
+    if (found != _programs.end()) {
+      return found->second;
+    }
+
+    std::string fragment = "#version 440 core\n"
+                           "layout(location = 0) in vec2 tex_coord;\n"
+                           "layout(location = 0) out vec4 post_colour;\n"
+                           "uniform sampler2D post_source;\n";
+    for (auto i : node) {
+      if (!_passes[i].part_file.empty()) {
+        fragment += "#line 1\n" + read_part(_passes[i].part_file) + "\n";
+      }
+    }
+    fragment += "void main() {\n"
+                "  vec4 colour = texture(post_source, tex_coord);\n";
+    for (auto i : node) {
+      if (!_passes[i].function.empty()) {
+        fragment += "  colour = " + _passes[i].function + "(colour, tex_coord);\n";
+      }
+    }
+    fragment += "  post_colour = colour;\n"
+                "}\n";
+    const std::string vertex = "#version 440 core\n"
+                               "layout(location = 0) in vec3 position;\n"
+                               "layout(location = 10) in vec2 tex_coord_in;\n"
+                               "layout(location = 0) out vec2 tex_coord;\n"
+                               "void main() {\n"
+                               "  gl_Position = vec4(position, 1.0);\n"
+                               "  tex_coord = tex_coord_in;\n"
+                               "}\n";
+
+    GLuint program = glCreateProgram();
+    GLuint shaders[] = {compile(GL_VERTEX_SHADER, vertex, key), compile(GL_FRAGMENT_SHADER, fragment, key)};
+    for (auto s : shaders) {
+      glAttachShader(program, s);
+    }
+    glLinkProgram(program);
+    for (auto s : shaders) {
+      glDetachShader(program, s);
+      glDeleteShader(s);
+    }
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      std::cerr << "ERROR - post graph: could not link stages " << key << std::endl << program_log(program) << std::endl;
+      glDeleteProgram(program);
+      throw std::runtime_error("Error linking post-processing stages");
+    }
+    _programs[key] = program;
+    return program;
+  }
+
+  // A part file's source, without any #version line so parts can be pasted together
+  static std::string read_part(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file) {
+      std::cerr << "ERROR - post graph: could not open " << filename << std::endl;
+      throw std::runtime_error("Error reading post-processing stage");
+    }
+    std::string line, source;
+    while (std::getline(file, line)) {
+      source += line.compare(0, 8, "#version") == 0 ? "\n" : line + "\n";
+    }
+    return source;
+  }
+
+  static GLuint compile(GLenum type, const std::string &source, const std::string &key) {
+    GLuint shader = glCreateShader(type);
+    auto text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+      GLint length = 0;
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+      std::string log(length, '\0');
+      glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+      std::cerr << "ERROR - post graph: could not compile stages " << key << std::endl << log << std::endl;
+      glDeleteShader(shader);
+      throw std::runtime_error("Error compiling post-processing stages");
+    }
+    return shader;
+  }
+
+  static std::string program_log(GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length, '\0');
+    glGetProgramInfoLog(program, length, nullptr, &log[0]);
+    return log;
+  }
+
+  void release_kept() {
+    for (auto &r : _resources) {
+      if (r.kept && r.target >= 0) {
+        _pool.release(r.target);
+      }
+    }
+    _pool.trim();
+  }
+
+  post_target_pool _pool;
+  graphics_framework::geometry _quad;
+  std::vector<resource> _resources;
+  std::vector<pass> _passes;
+  post_resource _presented = -1;
+  size_t _executed = 0;
+  size_t _draws = 0;
+  // Fused stage programs, keyed by their parts and functions
+  std::map<std::string, GLuint> _programs;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "gpu_timer.h"
+#include "post_graph.h"
+#include <algorithm>
+#include <cmath>
+#include <graphics_framework.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Most kernel samples, matching MAX_SAMPLES in post_ssao.frag
+const int SSAO_MAX_SAMPLES = 32;
+// Half size occlusion in r, view depth in g for the bilateral blur
+const GLenum SSAO_FORMAT = GL_RG16F;
+
+// Quality, reach and strength of the occlusion
+struct ssao_settings {
+  // View space distance samples reach, in world units
+  float radius = 1.0f;
+  float intensity = 1.0f;
+  // Hemisphere samples per pixel, up to SSAO_MAX_SAMPLES
+  int samples = 16;
+  // Depth a sample must be behind the surface by to count
+  float bias = 0.05f;
+  // Bilateral blur radius in half size texels, 0 for none, and how sharply it stops at depth edges
+  int blur_radius = 4;
+  float blur_sharpness = 16.0f;
+};
+
+// Screen space ambient occlusion from a depth buffer.  View space positions
+// are rebuilt from depth, normals from the neighbouring positions, and a
+// hemisphere kernel around each is tested against the depth buffer at half
+// size.  A separable bilateral blur then smooths out the per pixel kernel
+// rotation without crossing depth edges.  The result scales the ambient term
+// of the lighting drawn after it.  Its GPU time is measured every frame
+class ssao {
+public:
+  explicit ssao(const std::string &shader_dir = "shaders/") : _kernel_samples(0) {
+    _ssao_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _ssao_eff.add_shader(shader_dir + "post_ssao.frag", GL_FRAGMENT_SHADER);
+    _ssao_eff.build();
+    _blur_eff.add_shader(shader_dir + "post_quad.vert", GL_VERTEX_SHADER);
+    _blur_eff.add_shader(shader_dir + "post_ssao_blur.frag", GL_FRAGMENT_SHADER);
+    _blur_eff.build();
+    // No occlusion, for when it is off
+    const float one[2] = {1.0f, 1.0f};
+    glGenTextures(1, &_unoccluded);
+    glBindTexture(GL_TEXTURE_2D, _unoccluded);
+    glTexStorage2D(GL_TEXTURE_2D, 1, SSAO_FORMAT, 1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RG, GL_FLOAT, one);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  ~ssao() { glDeleteTextures(1, &_unoccluded); }
+  ssao(const ssao &) = delete;
+  ssao &operator=(const ssao &) = delete;
+
+  // Occlusion of the bottom left width x height of a depth texture that is
+  // texture_width x texture_height in all, drawn with projection P.  Uses the
+  // graph for its own passes, so call before the frame's post-processing is
+  // declared; the result stays valid until the graph is next reset.  Returns
+  // a half size texture with the occlusion in r, 1 for none, sampled at
+  // gl_FragCoord / (width, height)
+  GLuint update(post_graph &graph, GLuint depth_texture, GLuint texture_width, GLuint texture_height, GLuint width,
+                GLuint height, const glm::mat4 &P, const ssao_settings &settings) {
+    int samples = std::max(1, std::min(settings.samples, SSAO_MAX_SAMPLES));
+    if (samples != _kernel_samples) {
+      build_kernel(samples);
+    }
+    _timer.begin();
+    graph.reset();
+    auto depth = graph.import_texture(depth_texture, width, height, GL_DEPTH24_STENCIL8);
+    post_target_desc half(std::max(width / 2, 1u), std::max(height / 2, 1u), SSAO_FORMAT);
+    glm::vec2 depth_uv_scale(float(width) / texture_width, float(height) / texture_height);
+    glm::vec2 scene_texel(1.0f / width, 1.0f / height);
+    auto kernel = _kernel;
+    auto occlusion = graph.add_pass("ssao", _ssao_eff, {{"depth_map", depth}}, half,
+                                    [=](GLuint program) {
+                                      glUniform2fv(glGetUniformLocation(program, "depth_uv_scale"), 1,
+                                                   glm::value_ptr(depth_uv_scale));
+                                      glUniform2fv(glGetUniformLocation(program, "scene_texel"), 1,
+                                                   glm::value_ptr(scene_texel));
+                                      glUniformMatrix4fv(glGetUniformLocation(program, "P"), 1, GL_FALSE,
+                                                         glm::value_ptr(P));
+                                      glUniformMatrix4fv(glGetUniformLocation(program, "inverse_P"), 1, GL_FALSE,
+                                                         glm::value_ptr(glm::inverse(P)));
+                                      glUniform3fv(glGetUniformLocation(program, "kernel"), GLsizei(kernel.size()),
+                                                   glm::value_ptr(kernel[0]));
+                                      glUniform1i(glGetUniformLocation(program, "sample_count"), samples);
+                                      glUniform1f(glGetUniformLocation(program, "radius"), settings.radius);
+                                      glUniform1f(glGetUniformLocation(program, "bias"), settings.bias);
+                                      glUniform1f(glGetUniformLocation(program, "intensity"), settings.intensity);
+                                    });
+    if (settings.blur_radius > 0) {
+      occlusion = graph.add_pass("ssao blur horizontal", _blur_eff, {{"tex", occlusion}}, half,
+                                 blur_uniforms(glm::vec2(1.0f / half.width, 0.0f), settings));
+      occlusion = graph.add_pass("ssao blur vertical", _blur_eff, {{"tex", occlusion}}, half,
+                                 blur_uniforms(glm::vec2(0.0f, 1.0f / half.height), settings));
+    }
+    graph.keep(occlusion);
+    graph.execute();
+    _timer.end();
+    return graph.get_texture(occlusion);
+  }
+
+  // 1x1 texture of no occlusion, to bind in place of update's when it is off
+  GLuint get_unoccluded_texture() const { return _unoccluded; }
+  // GPU time of the passes in milliseconds, a few frames late
+  float get_milliseconds() const { return _timer.get_milliseconds(); }
+
+private:
+  // Samples spread through the hemisphere, more of them close to the centre
+  // where occlusion matters most.  Seeded the same every time so the pattern
+  // doesn't change with the sample count
+  void build_kernel(int samples) {
+    std::default_random_engine random(1);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    _kernel.clear();
+    for (int i = 0; i < samples; ++i) {
+      glm::vec3 s(dist(random) * 2.0f - 1.0f, dist(random) * 2.0f - 1.0f, dist(random));
+      s = glm::normalize(s) * dist(random);
+      float t = float(i) / samples;
+      _kernel.push_back(s * (0.1f + 0.9f * t * t));
+    }
+    _kernel_samples = samples;
+  }
+
+  static post_uniforms blur_uniforms(const glm::vec2 &direction, const ssao_settings &settings) {
+    int radius = settings.blur_radius;
+    float sharpness = settings.blur_sharpness;
+    return [direction, radius, sharpness](GLuint program) {
+      glUniform2fv(glGetUniformLocation(program, "direction"), 1, glm::value_ptr(direction));
+      glUniform1i(glGetUniformLocation(program, "radius"), radius);
+      glUniform1f(glGetUniformLocation(program, "sharpness"), sharpness);
+    };
+  }
+
+  graphics_framework::effect _ssao_eff;
+  graphics_framework::effect _blur_eff;
+  std::vector<glm::vec3> _kernel;
+  int _kernel_samples;
+  GLuint _unoccluded;
+  gpu_timer _timer;
+};
@@ -1,20 +1,34 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../72_Blur/post_graph.h"
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
+// Longest blur in pixels, and the size of the velocity tiles
+const int MOTION_BLUR_TILE_SIZE = 20;
+// Fraction of each frame's motion that blurs, as a camera shutter would
+const float MOTION_BLUR_SCALE = 0.5f;
+// Camera clip planes, which the blur needs to linearise depth
+const float CAMERA_NEAR = 2.414f;
+const float CAMERA_FAR = 1000.0f;
+
 map<string, mesh> meshes;
 effect eff;
+effect tile_max_eff;
+effect neighbour_max_eff;
 effect motion_blur;
-effect tex_eff;
 texture tex;
 directional_light light;
-frame_buffer frames[2];
-frame_buffer temp_frame;
-unsigned int current_frame = 0;
-geometry screen_quad;
+// Scene target: colour, velocity in pixels and depth
+GLuint scene_fbo;
+GLuint scene_colour;
+GLuint scene_velocity;
+GLuint scene_depth;
+// Each mesh's MVP last frame, for its velocity
+map<string, mat4> previous_MVPs;
+unique_ptr<post_graph> post;
 chase_camera cam;
 double cursor_x = 0.0;
 double cursor_y = 0.0;
@@ -30,21 +44,39 @@ bool initialise() {
 }
 
 bool load_content() {
-  // *********************************
-  // Create 2 frame buffers - use screen width and height
-
-
-
-  // Create a temp framebuffer
-
-  // Create screen quad
-
-
-
-
-
+  // Create the scene target - velocity goes to a second colour attachment
+  auto width = renderer::get_screen_width();
+  auto height = renderer::get_screen_height();
+  GLuint textures[3];
+  glGenTextures(3, textures);
+  scene_colour = textures[0];
+  scene_velocity = textures[1];
+  scene_depth = textures[2];
+  const GLenum formats[3] = {GL_RGBA8, GL_RG16F, GL_DEPTH_COMPONENT32F};
+  for (int i = 0; i < 3; ++i) {
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &scene_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene_colour, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, scene_velocity, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth, 0);
+  const GLenum draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, draw_buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    cerr << "ERROR - motion blur: scene target is not complete" << endl;
+    throw runtime_error("Incomplete scene target");
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  // *********************************
+  // Create the post-processing graph, which owns the screen quad
+  post = unique_ptr<post_graph>(new post_graph());
 
   // Create plane mesh
   meshes["plane"] = mesh(geometry_builder::create_plane());
@@ -124,35 +156,36 @@ bool load_content() {
   light.set_light_colour(vec4(1.0f, 1.0f, 1.0f, 1.0f));
   light.set_direction(vec3(1.0f, 1.0f, -1.0f));
 
-  // Load in shaders
-  eff.add_shader("48_Phong_Shading/phong.vert", GL_VERTEX_SHADER);
-  eff.add_shader("48_Phong_Shading/phong.frag", GL_FRAGMENT_SHADER);
+  // Load in shaders - phong shading that also writes velocity
+  eff.add_shader("73_Motion_Blur/velocity.vert", GL_VERTEX_SHADER);
+  eff.add_shader("73_Motion_Blur/velocity.frag", GL_FRAGMENT_SHADER);
 
-  motion_blur.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
-  motion_blur.add_shader("73_Motion_Blur/motion_blur.frag", GL_FRAGMENT_SHADER);
+  tile_max_eff.add_shader("shaders/post_quad.vert", GL_VERTEX_SHADER);
+  tile_max_eff.add_shader("73_Motion_Blur/motion_tile_max.frag", GL_FRAGMENT_SHADER);
 
-  tex_eff.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
-  tex_eff.add_shader("27_Texturing_Shader/simple_texture.frag", GL_FRAGMENT_SHADER);
+  neighbour_max_eff.add_shader("shaders/post_quad.vert", GL_VERTEX_SHADER);
+  neighbour_max_eff.add_shader("73_Motion_Blur/motion_neighbour_max.frag", GL_FRAGMENT_SHADER);
+
+  motion_blur.add_shader("shaders/post_quad.vert", GL_VERTEX_SHADER);
+  motion_blur.add_shader("73_Motion_Blur/motion_blur.frag", GL_FRAGMENT_SHADER);
 
   // Build effects
   eff.build();
+  tile_max_eff.build();
+  neighbour_max_eff.build();
   motion_blur.build();
-  tex_eff.build();
 
   // Set camera properties
   cam.set_pos_offset(vec3(0.0f, 2.0f, 10.0f));
   cam.set_springiness(0.5f);
   cam.move(meshes["chaser"].get_transform().position, eulerAngles(meshes["chaser"].get_transform().orientation));
   auto aspect = static_cast<float>(renderer::get_screen_width()) / static_cast<float>(renderer::get_screen_height());
-  cam.set_projection(quarter_pi<float>(), aspect, 2.414f, 1000.0f);
+  cam.set_projection(quarter_pi<float>(), aspect, CAMERA_NEAR, CAMERA_FAR);
 
   return true;
 }
 
 bool update(float delta_time) {
-  // Flip frame
-  current_frame = (current_frame + 1) % 2;
-
   // The target object
   static mesh &target_mesh = meshes["chaser"];
 
@@ -216,33 +249,38 @@ bool update(float delta_time) {
 }
 
 bool render() {
-  // !!!!!!!!!!!!!!! FIRST PASS !!!!!!!!!!!!!!!!
-  // *********************************
-  // Set render target to temp frame
-
-  // Clear frame
-
-  // *********************************
-  // Render meshes
+  // Render the scene and its velocities
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+  const float clear_colour[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  const float no_velocity[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  const float far_depth = 1.0f;
+  glClearBufferfv(GL_COLOR, 0, clear_colour);
+  glClearBufferfv(GL_COLOR, 1, no_velocity);
+  glClearBufferfv(GL_DEPTH, 0, &far_depth);
+  auto V = cam.get_view();
+  auto P = cam.get_projection();
+  GLuint w = renderer::get_screen_width();
+  GLuint h = renderer::get_screen_height();
   for (auto &e : meshes) {
     auto m = e.second;
     // Bind effect
     renderer::bind(eff);
     // Create MVP matrix
     auto M = m.get_transform().get_transform_matrix();
-    auto V = cam.get_view();
-    auto P = cam.get_projection();
     auto MVP = P * V * M;
-    // Set MVP matrix uniform
+    // Last frame's MVP, or this frame's the first time the mesh is drawn
+    auto previous = previous_MVPs.find(e.first);
+    auto previous_MVP = previous != previous_MVPs.end() ? previous->second : MVP;
+    previous_MVPs[e.first] = MVP;
+    // Set matrix uniforms
     glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-    // Create MV matrix
-    auto MV = V * M;
-    // Set MV matrix uniform
-    glUniformMatrix4fv(eff.get_uniform_location("MV"), 1, GL_FALSE, value_ptr(MV));
-    // Set M matrix uniform
+    glUniformMatrix4fv(eff.get_uniform_location("previous_MVP"), 1, GL_FALSE, value_ptr(previous_MVP));
     glUniformMatrix4fv(eff.get_uniform_location("M"), 1, GL_FALSE, value_ptr(M));
-    // Set N matrix uniform
     glUniformMatrix3fv(eff.get_uniform_location("N"), 1, GL_FALSE, value_ptr(m.get_transform().get_normal_matrix()));
+    // Set velocity uniforms
+    glUniform2f(eff.get_uniform_location("half_screen_size"), w * 0.5f, h * 0.5f);
+    glUniform1f(eff.get_uniform_location("blur_scale"), MOTION_BLUR_SCALE);
+    glUniform1f(eff.get_uniform_location("max_blur"), static_cast<float>(MOTION_BLUR_TILE_SIZE));
     // Bind material
     renderer::bind(m.get_material(), "mat");
     // Bind light
@@ -256,45 +294,39 @@ bool render() {
     // Render mesh
     renderer::render(m);
   }
-
-  // !!!!!!!!!!!!!!! SECOND PASS !!!!!!!!!!!!!!!!
-  // *********************************
-  // Set render target to current frame
-
-  // Clear frame
-
-  // Bind motion blur effect
-
-  // MVP is now the identity matrix
-
-  // Set MVP matrix uniform
-
-  // Bind tempframe to TU 0.
-
-  // Bind frames[(current_frame + 1) % 2] to TU 1.
-
-  // Set tex uniforms
-
-
-  // Set blend factor (0.9f)
-
-  // Render screen quad
-
-
-  // !!!!!!!!!!!!!!! SCREEN PASS !!!!!!!!!!!!!!!!
-
-  // Set render target back to the screen
-
-
-  // Set MVP matrix uniform
-
-  // Bind texture from frame buffer
-
-  // Set the uniform
-
-  // Render the screen quad
-
-  // *********************************
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Reduce the velocities to the longest in each tile, rows then columns, then
+  // to the longest around each tile, and gather along that
+  GLuint tiles_x = (w + MOTION_BLUR_TILE_SIZE - 1) / MOTION_BLUR_TILE_SIZE;
+  GLuint tiles_y = (h + MOTION_BLUR_TILE_SIZE - 1) / MOTION_BLUR_TILE_SIZE;
+  auto tile_uniforms = [](int x, int y) {
+    return [x, y](GLuint program) {
+      glUniform2i(glGetUniformLocation(program, "direction"), x, y);
+      glUniform1i(glGetUniformLocation(program, "tile_size"), MOTION_BLUR_TILE_SIZE);
+    };
+  };
+  post->reset();
+  auto colour = post->import_texture(scene_colour, w, h);
+  auto velocity = post->import_texture(scene_velocity, w, h, GL_RG16F);
+  auto depth = post->import_texture(scene_depth, w, h, GL_DEPTH_COMPONENT32F);
+  auto rows = post->add_pass("tile max rows", tile_max_eff, {{"tex", velocity}},
+                             post_target_desc(tiles_x, h, GL_RG16F), tile_uniforms(1, 0));
+  auto tiles = post->add_pass("tile max columns", tile_max_eff, {{"tex", rows}},
+                              post_target_desc(tiles_x, tiles_y, GL_RG16F), tile_uniforms(0, 1));
+  auto neighbours = post->add_pass("neighbour max", neighbour_max_eff, {{"tex", tiles}},
+                                   post_target_desc(tiles_x, tiles_y, GL_RG16F));
+  auto blurred = post->add_pass(
+      "motion blur", motion_blur,
+      {{"tex", colour}, {"velocity_map", velocity}, {"depth_map", depth}, {"neighbour_max", neighbours}},
+      post_target_desc(w, h, GL_RGBA8), [w, h](GLuint program) {
+        glUniform1i(glGetUniformLocation(program, "tile_size"), MOTION_BLUR_TILE_SIZE);
+        glUniform2f(glGetUniformLocation(program, "inverse_screen_size"), 1.0f / w, 1.0f / h);
+        glUniform1f(glGetUniformLocation(program, "near"), CAMERA_NEAR);
+        glUniform1f(glGetUniformLocation(program, "far"), CAMERA_FAR);
+      });
+  post->present(blurred);
+  post->execute();
   return true;
 }
 
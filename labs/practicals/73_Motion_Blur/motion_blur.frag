@@ -1,12 +1,25 @@
 #version 440 core
 
-// Current frame being rendered
-uniform sampler2D tex;
-// Previous frame
-uniform sampler2D previous_frame;
+// Samples gathered per pixel, so the cost is the same however fast things move
+const int SAMPLES = 15;
+// Depth difference over which one surface goes from in front of another to behind it
+const float SOFT_Z_EXTENT = 0.5;
 
-// Blend factor between frames
-uniform float blend_factor;
+// Sharp scene colour
+uniform sampler2D tex;
+// Per pixel velocity in pixels
+uniform sampler2D velocity_map;
+// Scene depth buffer
+uniform sampler2D depth_map;
+// Longest velocity around each tile
+uniform sampler2D neighbour_max;
+// Pixels per tile
+uniform int tile_size;
+// 1 / screen size
+uniform vec2 inverse_screen_size;
+// Camera clip planes, to linearise depth
+uniform float near;
+uniform float far;
 
 // Incoming texture coordinate
 layout(location = 0) in vec2 tex_coord;
@@ -14,14 +27,58 @@ layout(location = 0) in vec2 tex_coord;
 // Outgoing colour
 layout(location = 0) out vec4 colour;
 
+float linear_depth(in vec2 uv) {
+  float z = texture(depth_map, uv).r * 2.0 - 1.0;
+  return 2.0 * near * far / (far + near - z * (far - near));
+}
+
+// 1 where depth a is in front of depth b, fading over SOFT_Z_EXTENT
+float in_front(in float a, in float b) { return clamp(1.0 - (a - b) / SOFT_Z_EXTENT, 0.0, 1.0); }
+
+// How much a pixel moving at speed covers a point distance away
+float cone(in float distance, in float speed) { return clamp(1.0 - distance / speed, 0.0, 1.0); }
+float cylinder(in float distance, in float speed) { return 1.0 - smoothstep(0.95 * speed, 1.05 * speed, distance); }
+
+// Noise that differs between neighbouring pixels, hiding the banding of few samples
+float interleaved_gradient_noise(in vec2 pixel) {
+  return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+// Gathers along the fastest nearby motion, weighing each sample by whether it
+// or the centre is in front and which one's motion reaches the other (McGuire
+// et al., A Reconstruction Filter for Plausible Motion Blur)
 void main() {
-  // *********************************
-  // Sample the two textures
+  vec2 largest = texelFetch(neighbour_max, ivec2(gl_FragCoord.xy) / tile_size, 0).xy;
+  colour = texture(tex, tex_coord);
+  if (dot(largest, largest) < 0.25) {
+    // Nothing nearby moves as much as half a pixel
+    return;
+  }
 
+  float centre_speed = max(length(texture(velocity_map, tex_coord).xy), 0.5);
+  float centre_depth = linear_depth(tex_coord);
+  float jitter = interleaved_gradient_noise(gl_FragCoord.xy) - 0.5;
 
-  // Mix between these two colours
+  float total = 1.0 / centre_speed;
+  vec3 sum = colour.rgb * total;
+  for (int i = 0; i < SAMPLES; i++) {
+    // Spread the samples from -1 to 1 along the motion, skipping the centre
+    float t = mix(-1.0, 1.0, (float(i) + jitter + 1.0) / float(SAMPLES + 1));
+    vec2 offset = largest * t;
+    vec2 uv = tex_coord + offset * inverse_screen_size;
+    float distance = length(offset);
 
-  // Ensure alpha is 1.0
+    float sample_speed = max(length(texture(velocity_map, uv).xy), 0.5);
+    float sample_depth = linear_depth(uv);
+    float foreground = in_front(sample_depth, centre_depth);
+    float background = in_front(centre_depth, sample_depth);
 
-  // *********************************
-}
\ No newline at end of file
+    // A sample in front blurring over the centre, the centre's blur revealing
+    // what is behind it, and both blurring together
+    float weight = foreground * cone(distance, sample_speed) + background * cone(distance, centre_speed) +
+                   cylinder(distance, sample_speed) * cylinder(distance, centre_speed) * 2.0;
+    total += weight;
+    sum += texture(tex, uv).rgb * weight;
+  }
+  colour = vec4(sum / total, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 440 core
+
+// Longest velocity of each tile
+uniform sampler2D tex;
+
+// Outgoing longest velocity of the tile and its neighbours
+layout(location = 0) out vec4 colour;
+
+// Anything moving in a neighbouring tile can blur over this one, as velocities
+// are clamped to a tile
+void main() {
+  ivec2 size = textureSize(tex, 0);
+  ivec2 tile = ivec2(gl_FragCoord.xy);
+  vec2 longest = vec2(0.0);
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      vec2 v = texelFetch(tex, clamp(tile + ivec2(x, y), ivec2(0), size - 1), 0).xy;
+      if (dot(v, v) > dot(longest, longest)) {
+        longest = v;
+      }
+    }
+  }
+  colour = vec4(longest, 0.0, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 440 core
+
+// Velocities in pixels, or the tile maxima of the previous direction
+uniform sampler2D tex;
+// (1, 0) to reduce along rows, (0, 1) along columns
+uniform ivec2 direction;
+// Texels reduced into one
+uniform int tile_size;
+
+// Outgoing longest velocity of the texels covered
+layout(location = 0) out vec4 colour;
+
+// One direction of the tile max reduction - two passes give the longest
+// velocity of each tile_size x tile_size tile
+void main() {
+  ivec2 size = textureSize(tex, 0);
+  ivec2 start = ivec2(gl_FragCoord.xy) * (ivec2(1) + direction * (tile_size - 1));
+  vec2 longest = vec2(0.0);
+  for (int i = 0; i < tile_size; i++) {
+    vec2 v = texelFetch(tex, min(start + direction * i, size - 1), 0).xy;
+    if (dot(v, v) > dot(longest, longest)) {
+      longest = v;
+    }
+  }
+  colour = vec4(longest, 0.0, 1.0);
+}
@@ -0,0 +1,65 @@
+#version 440
+
+// A directional light structure
+struct directional_light {
+  vec4 ambient_intensity;
+  vec4 light_colour;
+  vec3 light_dir;
+};
+
+// A material structure
+struct material {
+  vec4 emissive;
+  vec4 diffuse_reflection;
+  vec4 specular_reflection;
+  float shininess;
+};
+
+// Directional light for the scene
+uniform directional_light light;
+// Material of the object
+uniform material mat;
+// Position of the camera
+uniform vec3 eye_pos;
+// Texture
+uniform sampler2D tex;
+// Half the screen size, pixels per unit of normalised device coordinates
+uniform vec2 half_screen_size;
+// Fraction of the frame's motion that blurs, as a camera shutter would
+uniform float blur_scale;
+// Longest velocity kept, in pixels - the tile size
+uniform float max_blur;
+
+// Incoming position
+layout(location = 0) in vec3 vertex_position;
+// Incoming normal
+layout(location = 1) in vec3 transformed_normal;
+// Incoming texture coordinate
+layout(location = 2) in vec2 tex_coord_out;
+// Incoming clip space position this frame and last frame
+layout(location = 3) in vec4 current_position;
+layout(location = 4) in vec4 previous_position;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+// Outgoing screen space motion in pixels since last frame
+layout(location = 1) out vec2 velocity;
+
+void main() {
+  // Phong shading as in 48_Phong_Shading
+  vec4 ambient = mat.diffuse_reflection * light.ambient_intensity;
+  vec4 diffuse = max(dot(transformed_normal, light.light_dir), 0.0) * (mat.diffuse_reflection * light.light_colour);
+  vec3 view_dir = normalize(eye_pos - vertex_position);
+  vec3 h = normalize(view_dir + light.light_dir);
+  vec4 specular = pow(max(dot(transformed_normal, h), 0.0), mat.shininess) * (mat.specular_reflection * light.light_colour);
+  colour = texture(tex, tex_coord_out) * (ambient + diffuse + mat.emissive) + specular;
+  colour.a = 1.0;
+
+  // Screen space motion, clamped so no pixel blurs further than a tile
+  velocity = (current_position.xy / current_position.w - previous_position.xy / previous_position.w) *
+             half_screen_size * blur_scale;
+  float speed = length(velocity);
+  if (speed > max_blur) {
+    velocity *= max_blur / speed;
+  }
+}
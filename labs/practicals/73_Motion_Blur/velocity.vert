@@ -0,0 +1,36 @@
+#version 440
+
+// The model matrix
+uniform mat4 M;
+// The transformation matrix
+uniform mat4 MVP;
+// Last frame's transformation matrix
+uniform mat4 previous_MVP;
+// The normal matrix
+uniform mat3 N;
+
+// Incoming position
+layout(location = 0) in vec3 position;
+// Incoming normal
+layout(location = 2) in vec3 normal;
+// Incoming texture coordinates
+layout(location = 10) in vec2 tex_coord_in;
+
+// Outgoing position
+layout(location = 0) out vec3 vertex_position;
+// Outgoing normal
+layout(location = 1) out vec3 transformed_normal;
+// Outgoing texture coordinate
+layout(location = 2) out vec2 tex_coord_out;
+// Outgoing clip space position this frame and last frame
+layout(location = 3) out vec4 current_position;
+layout(location = 4) out vec4 previous_position;
+
+void main() {
+  current_position = MVP * vec4(position, 1.0);
+  previous_position = previous_MVP * vec4(position, 1.0);
+  gl_Position = current_position;
+  vertex_position = (M * vec4(position, 1.0)).xyz;
+  transformed_normal = N * normal;
+  tex_coord_out = tex_coord_in;
+}
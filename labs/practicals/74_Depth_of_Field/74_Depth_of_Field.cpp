@@ -1,5 +1,6 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include "../72_Blur/depth_of_field.h"
 
 using namespace std;
 using namespace graphics_framework;
@@ -7,13 +8,12 @@ using namespace glm;
 
 map<string, mesh> meshes;
 effect eff;
-effect blur;
-effect dof;
 texture tex;
 directional_light light;
 frame_buffer first_pass;
-frame_buffer temp_frames[2];
-geometry screen_quad;
+unique_ptr<post_graph> post;
+unique_ptr<depth_of_field> dof;
+dof_settings dof_controls;
 chase_camera cam;
 double cursor_x = 0.0;
 double cursor_y = 0.0;
@@ -30,19 +30,10 @@ bool initialise() {
 
 bool load_content() {
   // *********************************
-  // Create 2 frame buffers - use screen width and height
-
-
-
-  // Create a first_pass frame
-
-  // Create screen quad
-
-
-
-
-
-
+  // Create a first_pass frame - use screen width and height
+  first_pass = frame_buffer(renderer::get_screen_width(), renderer::get_screen_height());
+  // Create the post-processing graph, which owns the screen quad
+  post = unique_ptr<post_graph>(new post_graph());
   // *********************************
 
   // Create plane mesh
@@ -126,17 +117,11 @@ bool load_content() {
   // Load in shaders
   eff.add_shader("48_Phong_Shading/phong.vert", GL_VERTEX_SHADER);
   eff.add_shader("48_Phong_Shading/phong.frag", GL_FRAGMENT_SHADER);
-  // Load in blur
-  blur.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
-  blur.add_shader("72_Blur/blur.frag", GL_FRAGMENT_SHADER);
-  // Load in depth of field effect
-  dof.add_shader("27_Texturing_Shader/simple_texture.vert", GL_VERTEX_SHADER);
-  dof.add_shader("74_Depth_of_Field/depth_of_field.frag", GL_FRAGMENT_SHADER);
+  // Load in depth of field
+  dof = unique_ptr<depth_of_field>(new depth_of_field());
 
   // Build effects
   eff.build();
-  blur.build();
-  dof.build();
 
   // Set camera properties
   cam.set_pos_offset(vec3(0.0f, 2.0f, 10.0f));
@@ -144,6 +129,8 @@ bool load_content() {
   cam.move(meshes["chaser"].get_transform().position, eulerAngles(meshes["chaser"].get_transform().orientation));
   auto aspect = static_cast<float>(renderer::get_screen_width()) / static_cast<float>(renderer::get_screen_height());
   cam.set_projection(quarter_pi<float>(), aspect, 2.414f, 1000.0f);
+  dof_controls.near_plane = 2.414f;
+  dof_controls.far_plane = 1000.0f;
 
   return true;
 }
@@ -206,6 +193,15 @@ bool update(float delta_time) {
   // Rotate the sphere
   meshes["sphere"].get_transform().rotate(vec3(0.0f, half_pi<float>(), 0.0f) * delta_time);
 
+  // Keep the chaser in focus.  Up and down open and close the aperture
+  dof_controls.focus_distance = length(cam.get_position() - tm->position);
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_UP)) {
+    dof_controls.max_radius = std::min(dof_controls.max_radius + 16.0f * delta_time, 64.0f);
+  }
+  if (glfwGetKey(renderer::get_window(), GLFW_KEY_DOWN)) {
+    dof_controls.max_radius = std::max(dof_controls.max_radius - 16.0f * delta_time, 1.0f);
+  }
+
   return true;
 }
 
@@ -213,9 +209,9 @@ bool render() {
   // !!!!!!!!!!!!!!! FIRST PASS !!!!!!!!!!!!!!!!
   // *********************************
   // Set render target to first_pass
-
+  renderer::set_render_target(first_pass);
   // Clear frame
-
+  renderer::clear();
   // *********************************
 
   // Render meshes
@@ -254,65 +250,15 @@ bool render() {
   }
 
   // !!!!!!!!!!!!!!! SECOND PASS !!!!!!!!!!!!!!!!
-
-  frame_buffer last_pass = first_pass;
-
   // *********************************
-  // Perform blur twice
-
-    // Set render target to temp_frames[i]
-
-    // Clear frame
-
-    // Bind motion blur effect
-
-    // MVP is now the identity matrix
-
-    // Set MVP matrix uniform
-
-    // Bind frames
-
-
-    // Set inverse width
-
-    // Set inverse height
-
-    // Render screen quad
-
-    // Set last pass to this pass
-
-
-
-  // !!!!!!!!!!!!!!! SCREEN PASS !!!!!!!!!!!!!!!!
-
-  // Set render target back to the screen
-
-  //Bid Dof effect
-
-  // Set MVP matrix uniform, identity
-
-
-  // Bind texture from last pass, 0
-
-  // Set the uniform, 0
-
-  // Sharp texture is taken from first pass
-  // bind first pass, 1
-
-  //set sharp tex uniform, 1
-
-  // Depth also taken from first pass
-  // bind first pass **depth** to  TU 2
-
-  //set depth tex uniform, 2
-
-  // Set range and focus values
-  // - range distance to chaser (get from camera)
-  // - focus 0.3
-
-
-  // Render the screen quad
-
+  // Blur by depth at half size and blend over the sharp frame on the screen
+  post->reset();
+  auto w = first_pass.get_width();
+  auto h = first_pass.get_height();
+  auto sharp = post->import_texture(first_pass.get_frame().get_id(), w, h);
+  auto depth = post->import_texture(first_pass.get_depth().get_id(), w, h, GL_DEPTH_COMPONENT);
+  post->present(dof->apply(*post, sharp, depth, dof_controls));
+  post->execute();
   // *********************************
 
   return true;
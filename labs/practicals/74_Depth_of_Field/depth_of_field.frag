@@ -1,34 +0,0 @@
-#version 410
-
-// Previous pass capture
-uniform sampler2D tex;
-// Initial render capture
-uniform sampler2D sharp;
-// Initial render depth capture
-uniform sampler2D depth;
-
-// The range value of the dof
-uniform float range;
-// The focus distance of the dof
-uniform float focus;
-
-// Incoming texture coordinate
-layout(location = 0) in vec2 tex_coord;
-
-// Outgoing colour
-layout(location = 0) out vec4 colour;
-
-void main() {
-  // *********************************
-  // Sample sharp texture
-
-  // Sample blur texture
-
-  // Calculate distance from the camera - based on depth sample
-
-  // Mix samples together based on distance
-
-  // Ensure alpha is 1.0
-
-  // *********************************
-}
\ No newline at end of file
@@ -0,0 +1,137 @@
+// Particle collision.  Can be added to any particle simulation stage (compute,
+// geometry or vertex) - call collide() after integrating the particle
+
+// Colliders of each type, must match MAX_PARTICLE_COLLIDERS on the CPU
+const int MAX_COLLIDERS = 8;
+
+// Planes as normal (xyz) and offset (w) - particles stay where dot(normal, p) >= offset
+uniform vec4 collision_planes[MAX_COLLIDERS];
+uniform int collision_plane_count;
+// Spheres as centre (xyz) and radius (w)
+uniform vec4 collision_spheres[MAX_COLLIDERS];
+uniform int collision_sphere_count;
+// Axis aligned boxes
+uniform vec3 collision_box_min[MAX_COLLIDERS];
+uniform vec3 collision_box_max[MAX_COLLIDERS];
+uniform int collision_box_count;
+// Fraction of normal velocity kept on impact
+uniform float collision_bounce;
+// Fraction of tangential velocity lost on impact
+uniform float collision_friction;
+
+// Heightfield, height taken from the green channel as 60_Terrain does
+uniform bool collision_use_heightmap;
+uniform sampler2D collision_heightmap;
+// Centre of the heightfield
+uniform vec3 collision_heightmap_origin;
+// World width and depth of the heightfield
+uniform vec2 collision_heightmap_size;
+// World height of a texel value of 1.0
+uniform float collision_heightmap_scale;
+
+// Previous frame depth buffer and optional world space normal buffer
+uniform bool collision_use_depth;
+uniform bool collision_use_normals;
+uniform sampler2D collision_depth;
+uniform sampler2D collision_normals;
+// View projection the depth buffer was rendered with, and its inverse
+uniform mat4 collision_view_projection;
+uniform mat4 collision_inverse_view_projection;
+// How far behind a depth buffer surface a particle still collides with it
+uniform float collision_thickness;
+
+// Pushes the particle out along normal and reflects any velocity into the surface
+void resolve_collision(inout vec3 position, inout vec3 velocity, vec3 normal, float penetration) {
+	position += normal * penetration;
+	float vn = dot(velocity, normal);
+	if (vn < 0.0) {
+		vec3 tangent = velocity - vn * normal;
+		velocity = tangent * (1.0 - collision_friction) - vn * collision_bounce * normal;
+	}
+}
+
+// Height of the heightfield at uv
+float heightmap_height(vec2 uv) {
+	return collision_heightmap_origin.y + textureLod(collision_heightmap, uv, 0.0).g * collision_heightmap_scale;
+}
+
+// World position of the depth buffer surface at uv
+vec3 depth_surface(vec2 uv) {
+	float depth = textureLod(collision_depth, uv, 0.0).r;
+	vec4 world = collision_inverse_view_projection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return world.xyz / world.w;
+}
+
+void collide(inout vec3 position, inout vec3 velocity) {
+	for (int i = 0; i < collision_plane_count; ++i) {
+		float penetration = collision_planes[i].w - dot(collision_planes[i].xyz, position);
+		if (penetration > 0.0) {
+			resolve_collision(position, velocity, collision_planes[i].xyz, penetration);
+		}
+	}
+
+	for (int i = 0; i < collision_sphere_count; ++i) {
+		vec3 d = position - collision_spheres[i].xyz;
+		float len = length(d);
+		if (len < collision_spheres[i].w && len > 0.0) {
+			resolve_collision(position, velocity, d / len, collision_spheres[i].w - len);
+		}
+	}
+
+	for (int i = 0; i < collision_box_count; ++i) {
+		vec3 to_min = position - collision_box_min[i];
+		vec3 to_max = collision_box_max[i] - position;
+		if (all(greaterThan(to_min, vec3(0.0))) && all(greaterThan(to_max, vec3(0.0)))) {
+			// Leave through the nearest face
+			vec3 nearest = min(to_min, to_max);
+			vec3 side = mix(vec3(-1.0), vec3(1.0), lessThan(to_max, to_min));
+			if (nearest.x <= nearest.y && nearest.x <= nearest.z) {
+				resolve_collision(position, velocity, vec3(side.x, 0.0, 0.0), nearest.x);
+			} else if (nearest.y <= nearest.z) {
+				resolve_collision(position, velocity, vec3(0.0, side.y, 0.0), nearest.y);
+			} else {
+				resolve_collision(position, velocity, vec3(0.0, 0.0, side.z), nearest.z);
+			}
+		}
+	}
+
+	if (collision_use_heightmap) {
+		vec2 uv = (position.xz - collision_heightmap_origin.xz) / collision_heightmap_size + 0.5;
+		if (all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+			float height = heightmap_height(uv);
+			if (position.y < height) {
+				// Normal from central differences
+				vec2 texel = 1.0 / vec2(textureSize(collision_heightmap, 0));
+				vec2 span = 2.0 * texel * collision_heightmap_size;
+				float dx = heightmap_height(uv + vec2(texel.x, 0.0)) - heightmap_height(uv - vec2(texel.x, 0.0));
+				float dz = heightmap_height(uv + vec2(0.0, texel.y)) - heightmap_height(uv - vec2(0.0, texel.y));
+				vec3 normal = normalize(vec3(-dx / span.x, 1.0, -dz / span.y));
+				resolve_collision(position, velocity, normal, (height - position.y) * normal.y);
+			}
+		}
+	}
+
+	if (collision_use_depth) {
+		vec4 clip = collision_view_projection * vec4(position, 1.0);
+		vec3 ndc = clip.xyz / clip.w;
+		vec2 uv = ndc.xy * 0.5 + 0.5;
+		// Only particles in front of the camera and on screen can be tested
+		if (clip.w > 0.0 && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+			vec3 surface = depth_surface(uv);
+			vec3 normal;
+			if (collision_use_normals) {
+				normal = normalize(textureLod(collision_normals, uv, 0.0).xyz * 2.0 - 1.0);
+			} else {
+				// Rebuild the normal from neighbouring depths - faces the camera
+				vec2 texel = 1.0 / vec2(textureSize(collision_depth, 0));
+				vec3 right = depth_surface(uv + vec2(texel.x, 0.0)) - surface;
+				vec3 up = depth_surface(uv + vec2(0.0, texel.y)) - surface;
+				normal = normalize(cross(right, up));
+			}
+			float penetration = dot(surface - position, normal);
+			if (penetration > 0.0 && penetration < collision_thickness) {
+				resolve_collision(position, velocity, normal, penetration);
+			}
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#version 440 core
+
+// HDR scene, twice the size of the target
+uniform sampler2D tex;
+// One texel of tex
+uniform vec2 texel;
+// Luminance where bloom starts
+uniform float threshold;
+// Width of the soft ramp either side of the threshold, as a fraction of it
+uniform float knee;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+float luminance(in vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Weights a tap down by its brightness, so single very bright texels don't
+// flicker into large bloom blobs as they move between texels
+vec3 karis_weighted(in vec3 c, out float weight)
+{
+	weight = 1.0 / (1.0 + luminance(c));
+	return c * weight;
+}
+
+void main()
+{
+	// The target texel's centre is a corner between source texels, and so is each point a source texel
+	// away diagonally: each linear fetch averages a 2x2 block and the four cover the 4x4 around the target
+	float w0, w1, w2, w3;
+	vec3 c = karis_weighted(texture(tex, tex_coord + vec2(-texel.x, -texel.y)).rgb, w0);
+	c += karis_weighted(texture(tex, tex_coord + vec2(texel.x, -texel.y)).rgb, w1);
+	c += karis_weighted(texture(tex, tex_coord + vec2(-texel.x, texel.y)).rgb, w2);
+	c += karis_weighted(texture(tex, tex_coord + vec2(texel.x, texel.y)).rgb, w3);
+	c /= w0 + w1 + w2 + w3;
+
+	// Quadratic soft knee below the threshold, linear above it
+	float brightness = max(c.r, max(c.g, c.b));
+	float soft = clamp(brightness - threshold * (1.0 - knee), 0.0, 2.0 * threshold * knee);
+	soft = soft * soft / (4.0 * threshold * knee + 0.00001);
+	float contribution = max(soft, brightness - threshold) / max(brightness, 0.00001);
+	colour = vec4(c * contribution, 1.0);
+}
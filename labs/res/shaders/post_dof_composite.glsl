@@ -0,0 +1,55 @@
+// Post-processing stage: blends the half size near and far fields over the sharp scene
+
+// Half size fields from post_dof_gather.frag
+uniform sampler2D dof_far;
+uniform sampler2D dof_near;
+// Full size scene depth
+uniform sampler2D dof_depth;
+// Distance in focus, and the distance either side over which blur reaches its most
+uniform float dof_focus_distance;
+uniform float dof_focus_range;
+// Camera clip planes, to linearise depth
+uniform float dof_near_plane;
+uniform float dof_far_plane;
+// Largest circle of confusion radius in pixels
+uniform float dof_max_radius;
+
+float dof_circle_of_confusion(in float depth)
+{
+	float z = depth * 2.0 - 1.0;
+	z = 2.0 * dof_near_plane * dof_far_plane / (dof_far_plane + dof_near_plane - z * (dof_far_plane - dof_near_plane));
+	return clamp((z - dof_focus_distance) / dof_focus_range, -1.0, 1.0);
+}
+
+// Bilinear upsample of the far field, each texel also weighted by how close
+// its circle of confusion is to this pixel's, so blur doesn't bleed across
+// depth edges
+vec3 dof_upsample_far(in vec2 tex_coord, in float coc)
+{
+	ivec2 size = textureSize(dof_far, 0);
+	vec2 position = tex_coord * vec2(size) - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = fract(position);
+	vec3 sum = vec3(0.0);
+	float total = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		vec4 texel = texelFetch(dof_far, clamp(base + offset, ivec2(0), size - 1), 0);
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		float weight = bilinear.x * bilinear.y / (0.01 + abs(texel.a - coc));
+		sum += texel.rgb * weight;
+		total += weight;
+	}
+	return sum / max(total, 0.0001);
+}
+
+vec4 depth_of_field(in vec4 colour, in vec2 tex_coord)
+{
+	float coc = dof_circle_of_confusion(texture(dof_depth, tex_coord).r);
+	// Blend to the far field once the circle is over half a pixel
+	float far_blend = smoothstep(0.5, 1.5, coc * dof_max_radius);
+	vec3 result = mix(colour.rgb, dof_upsample_far(tex_coord, coc), far_blend);
+	vec4 near = texture(dof_near, tex_coord);
+	return vec4(mix(result, near.rgb, near.a), colour.a);
+}
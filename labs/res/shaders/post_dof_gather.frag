@@ -0,0 +1,78 @@
+#version 440 core
+
+// Taps of the bokeh disc
+const int SAMPLES = 48;
+// Angle between consecutive taps, spreading them evenly over the disc
+const float GOLDEN_ANGLE = 2.39996323;
+
+// Half size colour with signed circle of confusion in a, from post_dof_prepare.frag
+uniform sampler2D tex;
+// Largest circle of confusion radius in texels of tex
+uniform float max_radius;
+// One texel of tex
+uniform vec2 texel_size;
+// 1 to gather the field in front of the focus, 0 for the field behind it
+uniform int near_field;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing blurred colour.  For the near field a is how much of the pixel it covers
+layout(location = 0) out vec4 colour;
+
+// Tap i of a disc of radius 1, on a Vogel spiral
+vec2 bokeh_tap(in int i)
+{
+	float r = sqrt((float(i) + 0.5) / float(SAMPLES));
+	float theta = float(i) * GOLDEN_ANGLE;
+	return r * vec2(cos(theta), sin(theta));
+}
+
+// Scatter as gather: each tap is spread over its own circle of confusion, so
+// it adds to this pixel only if that circle reaches here
+void main()
+{
+	vec4 centre = texture(tex, tex_coord);
+	if (near_field == 0)
+	{
+		// The far field blurs by the centre's own circle, and a tap can't blur
+		// further than its own, so focused and near taps don't leak in
+		float radius = max(centre.a, 0.0) * max_radius;
+		if (radius < 0.5)
+		{
+			colour = vec4(centre.rgb, 0.0);
+			return;
+		}
+		vec3 sum = centre.rgb;
+		float total = 1.0;
+		for (int i = 0; i < SAMPLES; i++)
+		{
+			vec2 offset = bokeh_tap(i) * radius;
+			vec4 tap = texture(tex, tex_coord + offset * texel_size);
+			float reach = min(max(tap.a, 0.0) * max_radius, radius);
+			float weight = clamp(reach - length(offset) + 1.0, 0.0, 1.0);
+			sum += tap.rgb * weight;
+			total += weight;
+		}
+		colour = vec4(sum / total, centre.a);
+	}
+	else
+	{
+		// The near field spreads over anything behind it, so every pixel
+		// looks as far as the largest circle.  Taps are weighted by the inverse
+		// of their circle's area, so coverage is 1 inside a blurred object
+		// whatever its size and fades across its edge
+		vec3 sum = vec3(0.0);
+		float total = 0.0;
+		for (int i = 0; i < SAMPLES; i++)
+		{
+			vec2 offset = bokeh_tap(i) * max_radius;
+			vec4 tap = texture(tex, tex_coord + offset * texel_size);
+			float reach = max(-tap.a, 0.0) * max_radius;
+			float weight = clamp(reach - length(offset) + 1.0, 0.0, 1.0) * max_radius * max_radius / max(reach * reach, 1.0);
+			sum += tap.rgb * weight;
+			total += weight;
+		}
+		colour = vec4(sum / max(total, 0.0001), clamp(total / float(SAMPLES), 0.0, 1.0));
+	}
+}
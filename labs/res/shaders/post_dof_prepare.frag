@@ -0,0 +1,44 @@
+#version 440 core
+
+// Full size scene colour
+uniform sampler2D tex;
+// Full size scene depth
+uniform sampler2D depth_map;
+// Distance in focus, and the distance either side over which blur reaches its most
+uniform float focus_distance;
+uniform float focus_range;
+// Camera clip planes, to linearise depth
+uniform float near_plane;
+uniform float far_plane;
+
+// Outgoing half size colour, with the signed circle of confusion in a: -1 to 0
+// in front of the focus, 0 to 1 behind it, as a fraction of the largest
+layout(location = 0) out vec4 colour;
+
+float circle_of_confusion(in float depth)
+{
+	float z = depth * 2.0 - 1.0;
+	z = 2.0 * near_plane * far_plane / (far_plane + near_plane - z * (far_plane - near_plane));
+	return clamp((z - focus_distance) / focus_range, -1.0, 1.0);
+}
+
+// Each half size texel covers a 2x2 block.  Colours are averaged, while the
+// nearest circle of confusion in front of the focus wins so near blur spreads
+// over the focused edges around it
+void main()
+{
+	ivec2 size = textureSize(tex, 0);
+	ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+	vec3 sum = vec3(0.0);
+	float near_coc = 0.0;
+	float average_coc = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 texel = min(base + ivec2(i & 1, i >> 1), size - 1);
+		float coc = circle_of_confusion(texelFetch(depth_map, texel, 0).r);
+		sum += texelFetch(tex, texel, 0).rgb;
+		near_coc = min(near_coc, coc);
+		average_coc += coc;
+	}
+	colour = vec4(sum * 0.25, near_coc < 0.0 ? near_coc : average_coc * 0.25);
+}
@@ -0,0 +1,26 @@
+#version 440 core
+
+// Texture to downsample, twice the size of the target
+uniform sampler2D tex;
+// Half a texel of the target, which is one texel of tex
+uniform vec2 half_texel;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+// Dual filter downsample: the centre and four diagonal taps, each linear
+// fetch averaging a 2x2 block.  The centre sits on the corner between four
+// texels and each diagonal tap a texel further out, so the five fetches
+// cover the 4x4 texels around the target texel
+void main()
+{
+	colour = texture(tex, tex_coord) * 4.0;
+	colour += texture(tex, tex_coord - half_texel);
+	colour += texture(tex, tex_coord + half_texel);
+	colour += texture(tex, tex_coord + vec2(half_texel.x, -half_texel.y));
+	colour += texture(tex, tex_coord - vec2(half_texel.x, -half_texel.y));
+	colour /= 8.0;
+}
@@ -0,0 +1,27 @@
+#version 440 core
+
+// Texture to upsample, half the size of the target
+uniform sampler2D tex;
+// Half a texel of tex
+uniform vec2 half_texel;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+// Dual filter upsample: a ring of four edge taps and four diagonal taps
+// weighted twice, which smooths out the blocks the downsample left
+void main()
+{
+	colour = texture(tex, tex_coord + vec2(-half_texel.x * 2.0, 0.0));
+	colour += texture(tex, tex_coord + vec2(half_texel.x * 2.0, 0.0));
+	colour += texture(tex, tex_coord + vec2(0.0, -half_texel.y * 2.0));
+	colour += texture(tex, tex_coord + vec2(0.0, half_texel.y * 2.0));
+	colour += texture(tex, tex_coord + vec2(-half_texel.x, half_texel.y)) * 2.0;
+	colour += texture(tex, tex_coord + vec2(half_texel.x, half_texel.y)) * 2.0;
+	colour += texture(tex, tex_coord + vec2(half_texel.x, -half_texel.y)) * 2.0;
+	colour += texture(tex, tex_coord + vec2(-half_texel.x, -half_texel.y)) * 2.0;
+	colour /= 12.0;
+}
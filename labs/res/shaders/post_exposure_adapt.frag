@@ -0,0 +1,34 @@
+#version 330 core
+
+// log2 luminance of the scene, with mipmaps down to 1x1
+uniform sampler2D log_luminance;
+// Its 1x1 mip level
+uniform float top_level;
+// Last frame's exposure (r) and adapted average luminance (g)
+uniform sampler2D previous_exposure;
+// Seconds since the last frame
+uniform float delta_time;
+// How fast the eye adapts to brighter and darker scenes, per second
+uniform float adapt_up;
+uniform float adapt_down;
+// Luminance the average is exposed to
+uniform float key;
+// Exposure limits
+uniform float min_exposure;
+uniform float max_exposure;
+
+// Outgoing exposure (r) and adapted average luminance (g)
+layout(location = 0) out vec4 exposure;
+
+void main()
+{
+	float target = exp2(textureLod(log_luminance, vec2(0.5), top_level).r);
+	float adapted = texelFetch(previous_exposure, ivec2(0), 0).g;
+	if (!(adapted > 0.0))
+	{
+		adapted = target;
+	}
+	float rate = target > adapted ? adapt_up : adapt_down;
+	adapted += (target - adapted) * (1.0 - exp(-delta_time * rate));
+	exposure = vec4(clamp(key / adapted, min_exposure, max_exposure), adapted, 0.0, 1.0);
+}
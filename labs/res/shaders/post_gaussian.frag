@@ -0,0 +1,32 @@
+#version 440 core
+
+// Most taps either side of the centre, matching GAUSSIAN_MAX_TAPS
+const int MAX_TAPS = 16;
+
+// Texture to blur
+uniform sampler2D tex;
+// One texel along the blur direction
+uniform vec2 direction;
+// Tap distances in texels.  Each one falls between two texels so the linear
+// filter blends them by their Gaussian weights in a single fetch
+uniform float offsets[MAX_TAPS];
+// Tap weights, the first for the centre and the rest for each side
+uniform float weights[MAX_TAPS];
+// Taps in use, the centre included
+uniform int tap_count;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing colour
+layout(location = 0) out vec4 colour;
+
+void main()
+{
+	colour = texture(tex, tex_coord) * weights[0];
+	for (int i = 1; i < tap_count; i++)
+	{
+		colour += texture(tex, tex_coord + direction * offsets[i]) * weights[i];
+		colour += texture(tex, tex_coord - direction * offsets[i]) * weights[i];
+	}
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+// HDR scene
+uniform sampler2D tex;
+// Fraction of tex the scene covers, from the bottom left
+uniform vec2 uv_scale;
+
+// Incoming texture coordinate
+in vec2 tex_coord;
+
+// Outgoing log2 luminance.  Averaged down the mip chain this gives the log of the geometric mean
+layout(location = 0) out float log_luminance;
+
+void main()
+{
+	float luminance = dot(texture(tex, tex_coord * uv_scale).rgb, vec3(0.2126, 0.7152, 0.0722));
+	log_luminance = log2(max(luminance, 0.0001));
+}
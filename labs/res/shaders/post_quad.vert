@@ -0,0 +1,15 @@
+#version 440 core
+
+// Screen quad corner, already in clip space
+layout(location = 0) in vec3 position;
+// Incoming texture coordinate
+layout(location = 10) in vec2 tex_coord_in;
+
+// Outgoing texture coordinate
+layout(location = 0) out vec2 tex_coord;
+
+void main()
+{
+	gl_Position = vec4(position, 1.0);
+	tex_coord = tex_coord_in;
+}
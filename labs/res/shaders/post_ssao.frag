@@ -0,0 +1,91 @@
+#version 440 core
+
+// Most kernel samples, matching SSAO_MAX_SAMPLES
+const int MAX_SAMPLES = 32;
+
+// Scene depth buffer
+uniform sampler2D depth_map;
+// Fraction of depth_map the scene covers, from the bottom left
+uniform vec2 depth_uv_scale;
+// One scene pixel in texture coordinates
+uniform vec2 scene_texel;
+// Projection the scene was drawn with, and its inverse
+uniform mat4 P;
+uniform mat4 inverse_P;
+// Hemisphere samples around +z, within a radius of 1
+uniform vec3 kernel[MAX_SAMPLES];
+uniform int sample_count;
+// View space distance samples reach
+uniform float radius;
+// Depth a sample must be behind the surface by to count, stopping flat surfaces shadowing themselves
+uniform float bias;
+// Strength of the occlusion
+uniform float intensity;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing ambient occlusion in r, 1 for none, and view depth in g for the blur
+layout(location = 0) out vec4 colour;
+
+float scene_depth(in vec2 uv)
+{
+	return texture(depth_map, uv * depth_uv_scale).r;
+}
+
+vec3 view_position(in vec2 uv, in float depth)
+{
+	vec4 p = inverse_P * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	return p.xyz / p.w;
+}
+
+vec3 view_position(in vec2 uv)
+{
+	return view_position(uv, scene_depth(uv));
+}
+
+// Noise that differs between neighbouring pixels, which the blur then averages out
+float interleaved_gradient_noise(in vec2 pixel)
+{
+	return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+void main()
+{
+	float depth = scene_depth(tex_coord);
+	if (depth >= 1.0)
+	{
+		// Nothing drawn here
+		colour = vec4(1.0, 1.0e4, 0.0, 1.0);
+		return;
+	}
+	vec3 position = view_position(tex_coord, depth);
+
+	// Normal from the neighbours, taking the nearer of each pair so it doesn't bend across edges
+	vec3 left = position - view_position(tex_coord - vec2(scene_texel.x, 0.0));
+	vec3 right = view_position(tex_coord + vec2(scene_texel.x, 0.0)) - position;
+	vec3 down = position - view_position(tex_coord - vec2(0.0, scene_texel.y));
+	vec3 up = view_position(tex_coord + vec2(0.0, scene_texel.y)) - position;
+	vec3 dx = abs(left.z) < abs(right.z) ? left : right;
+	vec3 dy = abs(down.z) < abs(up.z) ? down : up;
+	vec3 normal = normalize(cross(dx, dy));
+
+	// Kernel turned about the normal by a different angle each pixel
+	float angle = 6.28318531 * interleaved_gradient_noise(gl_FragCoord.xy);
+	vec3 random = vec3(cos(angle), sin(angle), 0.0);
+	vec3 tangent = normalize(random - normal * dot(random, normal));
+	mat3 TBN = mat3(tangent, cross(normal, tangent), normal);
+
+	float occlusion = 0.0;
+	for (int i = 0; i < sample_count; i++)
+	{
+		vec3 sample_position = position + TBN * kernel[i] * radius;
+		vec4 clip = P * vec4(sample_position, 1.0);
+		float surface = view_position(clip.xy / clip.w * 0.5 + 0.5).z;
+		// Surfaces far in front of the sample are something else, not the occluder
+		float in_range = smoothstep(0.0, 1.0, radius / abs(position.z - surface));
+		occlusion += (surface >= sample_position.z + bias ? 1.0 : 0.0) * in_range;
+	}
+	float ao = clamp(1.0 - intensity * occlusion / float(sample_count), 0.0, 1.0);
+	colour = vec4(ao, -position.z, 0.0, 1.0);
+}
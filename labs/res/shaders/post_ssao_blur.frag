@@ -0,0 +1,39 @@
+#version 440 core
+
+// Ambient occlusion in r and view depth in g
+uniform sampler2D tex;
+// One texel along the blur direction
+uniform vec2 direction;
+// Texels either side
+uniform int radius;
+// How quickly a difference in depth, relative to the centre's, stops a texel counting
+uniform float sharpness;
+
+// Incoming texture coordinate
+layout(location = 0) in vec2 tex_coord;
+
+// Outgoing blurred occlusion, with the depth passed on
+layout(location = 0) out vec4 colour;
+
+// Gaussian weighted average that leaves out texels at a different depth, so
+// occlusion doesn't bleed across the edges of objects
+void main()
+{
+	vec2 centre = texture(tex, tex_coord).rg;
+	float sigma = float(radius) * 0.5 + 0.5;
+	float sum = centre.r;
+	float total = 1.0;
+	for (int i = -radius; i <= radius; i++)
+	{
+		if (i == 0)
+		{
+			continue;
+		}
+		vec2 texel = texture(tex, tex_coord + direction * float(i)).rg;
+		float weight = exp(-float(i * i) / (2.0 * sigma * sigma)) *
+		               exp(-sharpness * abs(texel.g - centre.g) / max(centre.g, 0.001));
+		sum += texel.r * weight;
+		total += weight;
+	}
+	colour = vec4(sum / total, centre.g, 0.0, 1.0);
+}
@@ -0,0 +1,22 @@
+// Post-processing stage: adds bloom to the HDR scene, exposes and tonemaps it to [0, 1]
+
+// Blurred bright parts of the scene, any size
+uniform sampler2D bloom;
+// How much bloom is added
+uniform float bloom_intensity;
+// Scale applied before tonemapping
+uniform float exposure;
+// 1x1 exposure from auto-exposure in r, 1 when it is off
+uniform sampler2D exposure_map;
+
+// Filmic curve fitted to the ACES reference tonemapper (Narkowicz)
+vec3 filmic(in vec3 x)
+{
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec4 tonemap(in vec4 colour, in vec2 tex_coord)
+{
+	vec3 hdr = colour.rgb + texture(bloom, tex_coord).rgb * bloom_intensity;
+	return vec4(filmic(hdr * exposure * texelFetch(exposure_map, ivec2(0), 0).r), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// Outgoing texture coordinate
+out vec2 tex_coord;
+
+// One triangle covering the screen, made from the vertex index so no vertex
+// buffer is needed.  Draw three vertices with an empty vertex array object.
+// GLSL 3.30, as the auto-exposure fallback for contexts without compute uses it
+void main()
+{
+	tex_coord = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	gl_Position = vec4(tex_coord * 2.0 - 1.0, 0.0, 1.0);
+}
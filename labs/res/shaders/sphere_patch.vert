@@ -0,0 +1,9 @@
+#version 440
+
+// Icosahedron corner on the unit sphere
+layout(location = 0) in vec3 position;
+
+// Passed through untransformed - the evaluation shader projects the refined points
+layout(location = 0) out vec3 position_out;
+
+void main() { position_out = position; }